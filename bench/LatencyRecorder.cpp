@@ -0,0 +1,99 @@
+#include "LatencyRecorder.hpp"
+
+LatencyRecorder::LatencyRecorder() : _buckets(BUCKET_COUNT, 0), _count(0), _min(0), _max(0), _sum(0) {}
+
+unsigned long LatencyRecorder::getCount() const { return _count; }
+unsigned long LatencyRecorder::getMin() const { return _min; }
+unsigned long LatencyRecorder::getMax() const { return _max; }
+double LatencyRecorder::getMean() const { return _count ? _sum / _count : 0; }
+
+int LatencyRecorder::_bucket_index(unsigned long micros) {
+    /**
+     * @brief Values below two sub-bucket ranges get a bucket each; above that, a
+     * value of magnitude m (2^m <= value < 2^(m+1)) lands in row m - SUB_BUCKET_BITS,
+     * at the column given by its top SUB_BUCKET_BITS + 1 bits. This is the layout of
+     * the server's LatencyHistogram (src/Metrics.cpp) with finer rows, so the two
+     * report comparable latencies; a change to one belongs in the other.
+     */
+    const unsigned long sub_buckets = 1UL << SUB_BUCKET_BITS;
+    if (micros < 2 * sub_buckets) {
+        return static_cast<int>(micros);
+    }
+    int magnitude = 0;
+    for (unsigned long rest = micros; rest > 1; rest >>= 1) {
+        ++magnitude;
+    }
+    if (magnitude >= MAX_MAGNITUDE) {
+        return BUCKET_COUNT - 1;
+    }
+    int shift = magnitude - SUB_BUCKET_BITS;
+    return shift * static_cast<int>(sub_buckets) + static_cast<int>(micros >> shift);
+}
+
+unsigned long LatencyRecorder::_bucket_start(int index) {
+    // The inverse of _bucket_index(): the smallest value of a bucket
+    const int sub_buckets = 1 << SUB_BUCKET_BITS;
+    if (index < 2 * sub_buckets) {
+        return static_cast<unsigned long>(index);
+    }
+    int shift = index / sub_buckets - 1;
+    return static_cast<unsigned long>(index % sub_buckets + sub_buckets) << shift;
+}
+
+void LatencyRecorder::record(unsigned long micros) {
+    ++_buckets[_bucket_index(micros)];
+    if (_count == 0 || micros < _min) {
+        _min = micros;
+    }
+    if (micros > _max) {
+        _max = micros;
+    }
+    ++_count;
+    _sum += micros;
+}
+
+void LatencyRecorder::merge(const LatencyRecorder& other) {
+    if (other._count == 0) {
+        return;
+    }
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        _buckets[i] += other._buckets[i];
+    }
+    if (_count == 0 || other._min < _min) {
+        _min = other._min;
+    }
+    if (other._max > _max) {
+        _max = other._max;
+    }
+    _count += other._count;
+    _sum += other._sum;
+}
+
+unsigned long LatencyRecorder::getPercentile(double percentile) const {
+    /**
+     * @brief Walks the buckets up to the requested rank and reports the highest
+     * value of the bucket it falls in, so a percentile is never understated.
+     */
+    if (_count == 0) {
+        return 0;
+    }
+    unsigned long rank = static_cast<unsigned long>(percentile / 100.0 * _count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    if (rank > _count) {
+        rank = _count;
+    }
+    unsigned long seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        seen += _buckets[i];
+        if (seen >= rank) {
+            unsigned long highest = _bucket_start(i + 1) - 1;
+            if (highest > _max || i == BUCKET_COUNT - 1) {
+                return _max;
+            }
+            return highest < _min ? _min : highest;
+        }
+    }
+    return _max;
+}
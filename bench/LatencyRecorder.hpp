@@ -0,0 +1,40 @@
+#ifndef LATENCYRECORDER_HPP
+#define LATENCYRECORDER_HPP
+
+#include <vector>
+#include <cstddef>
+
+// Latency distribution in microseconds with HDR histogram bucketing: every power
+// of two is split into 128 buckets, so percentiles are exact to within 1% from
+// microseconds to hours while recording stays an index computation. Each load
+// thread records into its own instance; they are merged after the run.
+class LatencyRecorder {
+public:
+    LatencyRecorder();
+
+    void record(unsigned long micros);
+    void merge(const LatencyRecorder& other);
+
+    unsigned long getCount() const;
+    unsigned long getMin() const;
+    unsigned long getMax() const;
+    double getMean() const;
+    // The smallest value that at least percentile % of the samples do not exceed
+    unsigned long getPercentile(double percentile) const;
+
+private:
+    static const int SUB_BUCKET_BITS = 7;
+    static const int MAX_MAGNITUDE = 40;   // values from 2^40 us on share the last bucket
+    static const int BUCKET_COUNT = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+    std::vector<unsigned long> _buckets;
+    unsigned long _count;
+    unsigned long _min;
+    unsigned long _max;
+    double _sum;
+
+    static int _bucket_index(unsigned long micros);
+    static unsigned long _bucket_start(int index);
+};
+
+#endif
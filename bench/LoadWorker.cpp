@@ -0,0 +1,330 @@
+#include "LoadWorker.hpp"
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctime>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0   // SIGPIPE is ignored by the caller instead
+#endif
+
+// Pause before a connection that failed is tried again, so a server that is down
+// is not hammered with connect() calls
+static const unsigned long RECONNECT_DELAY_US = 10000;
+// Open loop: requests kept waiting for a free connection before further ones are
+// counted as unsent, which bounds memory when the server stalls
+static const size_t MAX_DUE_REQUESTS = 1000000;
+
+unsigned long monotonicMicros() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<unsigned long>(now.tv_sec) * 1000000UL + now.tv_nsec / 1000;
+}
+
+WorkerResults::WorkerResults()
+    : completed(0), connect_errors(0), io_errors(0), parse_errors(0), timeouts(0), unsent(0),
+      bytes_read(0), bytes_written(0), connections_opened(0) {
+    for (int i = 0; i < 6; ++i) {
+        status_classes[i] = 0;
+    }
+}
+
+LoadWorker::LoadWorker(const WorkerOptions& options) : _options(options) {
+    if (!_options.keep_alive || _options.pipeline == 0) {
+        _options.pipeline = 1;
+    }
+    _results.per_entry.assign(_options.mix->size(), 0);
+    Client idle;
+    idle.fd = -1;
+    idle.connecting = false;
+    idle.retry_at = 0;
+    idle.output_offset = 0;
+    _clients.assign(_options.connections, idle);
+}
+
+LoadWorker::~LoadWorker() {
+    for (size_t i = 0; i < _clients.size(); ++i) {
+        if (_clients[i].fd >= 0) {
+            close(_clients[i].fd);
+        }
+    }
+}
+
+const WorkerResults& LoadWorker::getResults() const { return _results; }
+
+void* LoadWorker::threadMain(void* arg) {
+    static_cast<LoadWorker*>(arg)->run();
+    return NULL;
+}
+
+void LoadWorker::_connect(Client& client, unsigned long now) {
+    /**
+     * @brief Starts a non-blocking connect(); run() finishes it once the socket is writable.
+     */
+    client.fd = socket(_options.address.ss_family, SOCK_STREAM, 0);
+    if (client.fd < 0) {
+        ++_results.connect_errors;
+        client.retry_at = now + RECONNECT_DELAY_US;
+        return;
+    }
+    fcntl(client.fd, F_SETFL, O_NONBLOCK);
+    int one = 1;
+    setsockopt(client.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(client.fd, reinterpret_cast<const struct sockaddr*>(&_options.address), _options.address_length) < 0
+        && errno != EINPROGRESS) {
+        ++_results.connect_errors;
+        _disconnect(client, now, true);
+        return;
+    }
+    client.connecting = true;
+    ++_results.connections_opened;
+}
+
+void LoadWorker::_disconnect(Client& client, unsigned long now, bool failed) {
+    /**
+     * @brief Closes a connection and drops its outstanding requests; it is opened
+     * again right away, or after RECONNECT_DELAY_US if it failed.
+     */
+    if (client.fd >= 0) {
+        close(client.fd);
+    }
+    client.fd = -1;
+    client.connecting = false;
+    client.retry_at = failed ? now + RECONNECT_DELAY_US : now;
+    client.output.clear();
+    client.output_offset = 0;
+    client.in_flight.clear();
+    client.parser.reset();
+}
+
+void LoadWorker::_queue_requests(Client& client, unsigned long now) {
+    /**
+     * @brief Tops up a connection to its pipeline depth: with requests that are due
+     * in an open loop, with new ones at once in a closed loop.
+     */
+    while (client.in_flight.size() < _options.pipeline) {
+        InFlight request;
+        if (_options.rate > 0) {
+            if (_due.empty()) {
+                return;
+            }
+            request.start = _due.front();
+            _due.pop_front();
+        } else {
+            request.start = now;
+        }
+        request.entry = _options.mix->pick(_options.seed);
+        client.output += _options.mix->getRendered(request.entry);
+        client.in_flight.push_back(request);
+    }
+}
+
+bool LoadWorker::_write(Client& client, unsigned long now) {
+    /**
+     * @return false if the connection failed and was closed.
+     */
+    while (client.output_offset < client.output.length()) {
+        ssize_t sent = send(client.fd, client.output.data() + client.output_offset,
+                            client.output.length() - client.output_offset, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return true;
+            }
+            _results.io_errors += client.in_flight.size();
+            _disconnect(client, now, true);
+            return false;
+        }
+        _results.bytes_written += sent;
+        client.output_offset += sent;
+    }
+    client.output.clear();
+    client.output_offset = 0;
+    return true;
+}
+
+bool LoadWorker::_complete_response(Client& client, unsigned long now) {
+    /**
+     * @brief Records the response to the oldest outstanding request.
+     * @return false if the server closes the connection after it.
+     */
+    InFlight request = client.in_flight.front();
+    client.in_flight.pop_front();
+    _results.latency.record(now - request.start);
+    ++_results.completed;
+    ++_results.per_entry[request.entry];
+    int status_class = client.parser.getStatusCode() / 100;
+    ++_results.status_classes[status_class >= 1 && status_class <= 5 ? status_class : 0];
+    bool keep_alive = client.parser.getKeepAlive();
+    client.parser.reset();
+    if (!keep_alive) {
+        // Pipelined requests behind the last response were never answered; in an open
+        // loop they are sent again on another connection, still timed from when due
+        if (_options.rate > 0) {
+            while (!client.in_flight.empty()) {
+                _due.push_front(client.in_flight.back().start);
+                client.in_flight.pop_back();
+            }
+        }
+        _disconnect(client, now, false);
+        return false;
+    }
+    return true;
+}
+
+bool LoadWorker::_read(Client& client, unsigned long now) {
+    /**
+     * @brief Reads what arrived and splits it into responses.
+     * @return false if the connection was closed.
+     */
+    char buffer[65536];
+    ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+    if (received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return true;
+        }
+        _results.io_errors += client.in_flight.size();
+        _disconnect(client, now, true);
+        return false;
+    }
+    if (received == 0) {
+        if (!client.in_flight.empty() && client.parser.hasStarted()
+            && client.parser.finish() == ResponseParser::PARSE_COMPLETE && !_complete_response(client, now)) {
+            return false;
+        }
+        // A keep-alive connection the server closed between requests is no error
+        _results.io_errors += client.in_flight.size();
+        _disconnect(client, now, false);
+        return false;
+    }
+    _results.bytes_read += received;
+    size_t offset = 0;
+    while (offset < static_cast<size_t>(received)) {
+        if (client.in_flight.empty()) {
+            ++_results.parse_errors; // A response to nothing
+            _disconnect(client, now, true);
+            return false;
+        }
+        size_t consumed = 0;
+        ResponseParser::Status status = client.parser.feed(buffer + offset, received - offset, consumed);
+        offset += consumed;
+        if (status == ResponseParser::PARSE_ERROR) {
+            ++_results.parse_errors;
+            _results.io_errors += client.in_flight.size() - 1;
+            _disconnect(client, now, true);
+            return false;
+        }
+        if (status == ResponseParser::PARSE_COMPLETE && !_complete_response(client, now)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void LoadWorker::_expire_requests(unsigned long now) {
+    if (_options.timeout_us == 0) {
+        return;
+    }
+    for (size_t i = 0; i < _clients.size(); ++i) {
+        Client& client = _clients[i];
+        if (!client.in_flight.empty() && now - client.in_flight.front().start > _options.timeout_us) {
+            _results.timeouts += client.in_flight.size();
+            _disconnect(client, now, false);
+        }
+    }
+}
+
+void LoadWorker::run() {
+    /**
+     * @brief Generates load until the duration is up. Responses that are still
+     * outstanding at the end are not counted.
+     */
+    unsigned long start = monotonicMicros();
+    unsigned long end = start + _options.duration_us;
+    double interval = _options.rate > 0 ? 1000000.0 / _options.rate : 0;
+    double next_due = start;
+    std::vector<struct pollfd> fds(_clients.size());
+
+    for (size_t i = 0; i < _clients.size(); ++i) {
+        _connect(_clients[i], start);
+    }
+    while (true) {
+        unsigned long now = monotonicMicros();
+        if (now >= end) {
+            break;
+        }
+        if (interval > 0) {
+            while (next_due <= now) {
+                if (_due.size() < MAX_DUE_REQUESTS) {
+                    _due.push_back(static_cast<unsigned long>(next_due));
+                } else {
+                    ++_results.unsent;
+                }
+                next_due += interval;
+            }
+        }
+
+        unsigned long wake = end;
+        if (interval > 0 && next_due < wake) {
+            wake = static_cast<unsigned long>(next_due);
+        }
+        for (size_t i = 0; i < _clients.size(); ++i) {
+            Client& client = _clients[i];
+            if (client.fd < 0 && client.retry_at <= now) {
+                _connect(client, now);
+            }
+            if (client.fd >= 0 && !client.connecting) {
+                _queue_requests(client, now);
+                if (!client.output.empty()) {
+                    _write(client, now);
+                }
+            }
+            fds[i].fd = client.fd;
+            fds[i].events = client.connecting ? POLLOUT : POLLIN;
+            if (!client.connecting && client.output_offset < client.output.length()) {
+                fds[i].events |= POLLOUT;
+            }
+            fds[i].revents = 0;
+            if (client.fd < 0 && client.retry_at < wake) {
+                wake = client.retry_at;
+            }
+        }
+
+        int timeout = wake > now ? static_cast<int>((wake - now + 999) / 1000) : 0;
+        if (timeout > 100) {
+            timeout = 100;   // Request timeouts are checked at least this often
+        }
+        if (poll(&fds[0], fds.size(), timeout) < 0 && errno != EINTR) {
+            break;
+        }
+
+        now = monotonicMicros();
+        for (size_t i = 0; i < _clients.size(); ++i) {
+            Client& client = _clients[i];
+            if (fds[i].revents == 0 || client.fd != fds[i].fd) {
+                continue;
+            }
+            if (client.connecting) {
+                int error = 0;
+                socklen_t length = sizeof(error);
+                if (getsockopt(client.fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+                    ++_results.connect_errors;
+                    _disconnect(client, now, true);
+                    continue;
+                }
+                client.connecting = false;
+                continue;
+            }
+            if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && !_read(client, now)) {
+                continue;
+            }
+            if (fds[i].revents & POLLOUT) {
+                _write(client, now);
+            }
+        }
+        _expire_requests(now);
+    }
+    _results.unsent += _due.size();
+}
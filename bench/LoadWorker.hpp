@@ -0,0 +1,95 @@
+#ifndef LOADWORKER_HPP
+#define LOADWORKER_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <sys/socket.h>
+#include "LatencyRecorder.hpp"
+#include "RequestMix.hpp"
+#include "ResponseParser.hpp"
+
+struct WorkerOptions {
+    struct sockaddr_storage address;
+    socklen_t address_length;
+    size_t connections;
+    size_t pipeline;          // requests in flight per connection
+    double rate;              // requests per second for this worker, 0 for a closed loop
+    bool keep_alive;
+    unsigned long duration_us;
+    unsigned long timeout_us; // a request without its response for this long fails
+    const RequestMix* mix;
+    unsigned int seed;
+};
+
+struct WorkerResults {
+    LatencyRecorder latency;
+    unsigned long completed;
+    unsigned long status_classes[6];  // index 0 for unparseable codes, then 1xx to 5xx
+    std::vector<unsigned long> per_entry; // completed requests by mix entry
+    unsigned long connect_errors;
+    unsigned long io_errors;          // resets and early closes with requests in flight
+    unsigned long parse_errors;
+    unsigned long timeouts;
+    unsigned long unsent;             // open loop: due but still waiting for a free connection at the end
+    unsigned long bytes_read;
+    unsigned long bytes_written;
+    unsigned long connections_opened;
+
+    WorkerResults();
+};
+
+// One load-generating thread: drives its share of the connections with poll()
+// until the run's duration is up. In a closed loop every connection keeps
+// `pipeline` requests outstanding and sends the next as soon as a response
+// arrives. In an open loop requests are due at a fixed rate whether or not the
+// server keeps up; one that waits for a free connection is timed from when it
+// was due, so a stalled server shows up in the latencies instead of quietly
+// lowering the offered load (coordinated omission).
+class LoadWorker {
+public:
+    explicit LoadWorker(const WorkerOptions& options);
+    ~LoadWorker();
+
+    void run();
+    const WorkerResults& getResults() const;
+
+    // pthread entry point; arg is the LoadWorker
+    static void* threadMain(void* arg);
+
+private:
+    struct InFlight {
+        size_t entry;
+        unsigned long start;    // when the request was sent, or due in an open loop
+    };
+
+    struct Client {
+        int fd;
+        bool connecting;
+        unsigned long retry_at; // when a failed connection may be tried again
+        std::string output;
+        size_t output_offset;
+        std::deque<InFlight> in_flight;
+        ResponseParser parser;
+    };
+
+    WorkerOptions _options;
+    WorkerResults _results;
+    std::vector<Client> _clients;
+    std::deque<unsigned long> _due;   // open loop: requests that are due but not sent
+
+    void _connect(Client& client, unsigned long now);
+    void _disconnect(Client& client, unsigned long now, bool failed);
+    void _queue_requests(Client& client, unsigned long now);
+    bool _write(Client& client, unsigned long now);
+    bool _read(Client& client, unsigned long now);
+    bool _complete_response(Client& client, unsigned long now);
+    void _expire_requests(unsigned long now);
+
+    LoadWorker(const LoadWorker&);
+    LoadWorker& operator=(const LoadWorker&);
+};
+
+unsigned long monotonicMicros();
+
+#endif
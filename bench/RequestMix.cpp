@@ -0,0 +1,236 @@
+#include "RequestMix.hpp"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <cctype>
+
+// Reads the flat JSON objects of a mix file: string, number and boolean values,
+// and one level of nested object for "headers"
+class JsonCursor {
+public:
+    explicit JsonCursor(const std::string& text) : _text(text), _pos(0) {}
+
+    void skipSpace() {
+        while (_pos < _text.length() && isspace(static_cast<unsigned char>(_text[_pos]))) {
+            ++_pos;
+        }
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (_pos < _text.length() && _text[_pos] == c) {
+            ++_pos;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!consume(c)) {
+            throw std::runtime_error(std::string("expected '") + c + "'");
+        }
+    }
+
+    bool atEnd() {
+        skipSpace();
+        return _pos >= _text.length();
+    }
+
+    char peek() {
+        skipSpace();
+        return _pos < _text.length() ? _text[_pos] : '\0';
+    }
+
+    std::string readString() {
+        expect('"');
+        std::string value;
+        while (_pos < _text.length() && _text[_pos] != '"') {
+            char c = _text[_pos++];
+            if (c != '\\') {
+                value += c;
+                continue;
+            }
+            if (_pos >= _text.length()) {
+                break;
+            }
+            char escaped = _text[_pos++];
+            switch (escaped) {
+                case 'n': value += '\n'; break;
+                case 'r': value += '\r'; break;
+                case 't': value += '\t'; break;
+                case 'u': {
+                    // Only code points below 0x80 are expected in requests
+                    unsigned long code = strtoul(_text.substr(_pos, 4).c_str(), NULL, 16);
+                    value += static_cast<char>(code < 0x80 ? code : '?');
+                    _pos += 4;
+                    break;
+                }
+                default: value += escaped; break;
+            }
+        }
+        expect('"');
+        return value;
+    }
+
+    std::string readScalar() {
+        /**
+         * @brief Reads a number or a literal (true, false, null) as its text.
+         */
+        skipSpace();
+        size_t start = _pos;
+        while (_pos < _text.length() && (isalnum(static_cast<unsigned char>(_text[_pos])) || _text[_pos] == '.'
+                                         || _text[_pos] == '-' || _text[_pos] == '+')) {
+            ++_pos;
+        }
+        if (start == _pos) {
+            throw std::runtime_error("expected a value");
+        }
+        return _text.substr(start, _pos - start);
+    }
+
+private:
+    const std::string& _text;
+    size_t _pos;
+};
+
+static unsigned long parseCount(const std::string& key, const std::string& value) {
+    char* end;
+    unsigned long count = strtoul(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || value[0] == '-') {
+        throw std::runtime_error("\"" + key + "\" must be a non-negative integer");
+    }
+    return count;
+}
+
+RequestMix::RequestMix() {}
+
+bool RequestMix::empty() const { return _entries.empty(); }
+size_t RequestMix::size() const { return _entries.size(); }
+const MixEntry& RequestMix::getEntry(size_t index) const { return _entries[index]; }
+const std::string& RequestMix::getRendered(size_t index) const { return _rendered[index]; }
+
+void RequestMix::add(const MixEntry& entry) {
+    if (entry.weight == 0) {
+        return;
+    }
+    _entries.push_back(entry);
+}
+
+MixEntry RequestMix::_parse_line(const std::string& line) {
+    MixEntry entry;
+    JsonCursor cursor(line);
+    cursor.expect('{');
+    bool first = true;
+    while (!cursor.consume('}')) {
+        if (!first) {
+            cursor.expect(',');
+        }
+        first = false;
+        std::string key = cursor.readString();
+        cursor.expect(':');
+        if (key == "headers") {
+            cursor.expect('{');
+            bool first_header = true;
+            while (!cursor.consume('}')) {
+                if (!first_header) {
+                    cursor.expect(',');
+                }
+                first_header = false;
+                std::string name = cursor.readString();
+                cursor.expect(':');
+                entry.headers.push_back(std::make_pair(name, cursor.readString()));
+            }
+            continue;
+        }
+        std::string value = cursor.peek() == '"' ? cursor.readString() : cursor.readScalar();
+        if (key == "method") {
+            entry.method = value;
+        } else if (key == "path") {
+            entry.path = value;
+        } else if (key == "host") {
+            entry.host = value;
+        } else if (key == "body") {
+            entry.body = value;
+        } else if (key == "body_size") {
+            entry.body.assign(parseCount(key, value), 'x');
+        } else if (key == "weight") {
+            entry.weight = parseCount(key, value);
+        } else {
+            throw std::runtime_error("unknown key \"" + key + "\"");
+        }
+    }
+    if (!cursor.atEnd()) {
+        throw std::runtime_error("trailing characters after the object");
+    }
+    if (entry.path.empty() || entry.path[0] != '/') {
+        throw std::runtime_error("\"path\" must start with '/'");
+    }
+    return entry;
+}
+
+void RequestMix::loadFile(const std::string& path) {
+    std::ifstream file(path.c_str());
+    if (!file) {
+        throw std::runtime_error("Cannot open request mix " + path);
+    }
+    std::string line;
+    size_t number = 0;
+    while (std::getline(file, line)) {
+        ++number;
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+        try {
+            add(_parse_line(line));
+        } catch (const std::exception& e) {
+            std::ostringstream message;
+            message << path << ":" << number << ": " << e.what();
+            throw std::runtime_error(message.str());
+        }
+    }
+    if (_entries.empty()) {
+        throw std::runtime_error("No requests in " + path);
+    }
+}
+
+void RequestMix::render(const std::string& default_host, bool keep_alive, const std::vector<std::string>& extra_headers) {
+    /**
+     * @brief Serializes every request once and builds the weight table for pick().
+     */
+    _rendered.clear();
+    _cumulative_weights.clear();
+    unsigned long total = 0;
+    for (size_t i = 0; i < _entries.size(); ++i) {
+        const MixEntry& entry = _entries[i];
+        std::ostringstream request;
+        request << entry.method << " " << entry.path << " HTTP/1.1\r\n"
+                << "Host: " << (entry.host.empty() ? default_host : entry.host) << "\r\n";
+        for (size_t h = 0; h < entry.headers.size(); ++h) {
+            request << entry.headers[h].first << ": " << entry.headers[h].second << "\r\n";
+        }
+        for (size_t h = 0; h < extra_headers.size(); ++h) {
+            request << extra_headers[h] << "\r\n";
+        }
+        if (!entry.body.empty() || entry.method == "POST") {
+            request << "Content-Length: " << entry.body.length() << "\r\n";
+        }
+        if (!keep_alive) {
+            request << "Connection: close\r\n";
+        }
+        request << "\r\n" << entry.body;
+        _rendered.push_back(request.str());
+        total += entry.weight;
+        _cumulative_weights.push_back(total);
+    }
+}
+
+size_t RequestMix::pick(unsigned int& seed) const {
+    if (_cumulative_weights.size() == 1) {
+        return 0;
+    }
+    unsigned long draw = static_cast<unsigned long>(rand_r(&seed)) % _cumulative_weights.back();
+    return std::upper_bound(_cumulative_weights.begin(), _cumulative_weights.end(), draw) - _cumulative_weights.begin();
+}
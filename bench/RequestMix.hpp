@@ -0,0 +1,55 @@
+#ifndef REQUESTMIX_HPP
+#define REQUESTMIX_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+
+// One kind of request in the mix and how often it is picked relative to the others
+struct MixEntry {
+    std::string method;
+    std::string path;
+    std::string host;       // the target's host:port when empty
+    std::vector<std::pair<std::string, std::string> > headers;
+    std::string body;
+    unsigned long weight;
+
+    MixEntry() : method("GET"), path("/"), weight(1) {}
+};
+
+// The requests a load run sends, drawn at random by weight. A mix file holds one
+// JSON object per line (JSON Lines); blank lines and lines starting with '#' are
+// skipped:
+//
+//   {"path": "/index.html", "weight": 8}
+//   {"method": "POST", "path": "/uploads/b.bin", "body_size": 65536, "weight": 1}
+//   {"path": "/api", "headers": {"Accept": "application/json"}, "host": "example.com"}
+//
+// Keys: method, path, host, headers, body, body_size (that many filler bytes),
+// weight. Each request is rendered once before the run, so picking one is a
+// random number and a binary search.
+class RequestMix {
+public:
+    RequestMix();
+
+    void add(const MixEntry& entry);
+    // Throws std::runtime_error naming the line of the first invalid entry
+    void loadFile(const std::string& path);
+    void render(const std::string& default_host, bool keep_alive, const std::vector<std::string>& extra_headers);
+
+    bool empty() const;
+    size_t size() const;
+    const MixEntry& getEntry(size_t index) const;
+    // Draws the index of a request by weight, advancing the rand_r() seed
+    size_t pick(unsigned int& seed) const;
+    const std::string& getRendered(size_t index) const;
+
+private:
+    std::vector<MixEntry> _entries;
+    std::vector<std::string> _rendered;
+    std::vector<unsigned long> _cumulative_weights;
+
+    static MixEntry _parse_line(const std::string& line);
+};
+
+#endif
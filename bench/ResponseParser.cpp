@@ -0,0 +1,173 @@
+#include "ResponseParser.hpp"
+#include <cstdlib>
+#include <cctype>
+
+// Longest head or chunk line accepted before the response is considered broken
+static const size_t MAX_LINE_LENGTH = 65536;
+
+ResponseParser::ResponseParser() { reset(); }
+
+void ResponseParser::reset() {
+    _stage = STAGE_HEAD;
+    _line.clear();
+    _remaining = 0;
+    _status_code = 0;
+    _keep_alive = true;
+}
+
+int ResponseParser::getStatusCode() const { return _status_code; }
+bool ResponseParser::getKeepAlive() const { return _keep_alive; }
+bool ResponseParser::hasStarted() const { return _stage != STAGE_HEAD || !_line.empty(); }
+
+static std::string lowercase(const std::string& value) {
+    std::string result(value);
+    for (size_t i = 0; i < result.length(); ++i) {
+        result[i] = static_cast<char>(tolower(static_cast<unsigned char>(result[i])));
+    }
+    return result;
+}
+
+static std::string trim(const std::string& value) {
+    size_t begin = value.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    return value.substr(begin, value.find_last_not_of(" \t\r\n") - begin + 1);
+}
+
+bool ResponseParser::_parse_head() {
+    /**
+     * @brief Reads the status code and the headers that decide how the body is framed.
+     * @return false if the head is not a valid response head.
+     */
+    size_t line_end = _line.find('\n');
+    std::string status_line = _line.substr(0, line_end);
+    if (status_line.compare(0, 7, "HTTP/1.") != 0 || status_line.length() < 12) {
+        return false;
+    }
+    bool http10 = status_line[7] == '0';
+    _status_code = atoi(status_line.c_str() + 9);
+    if (_status_code < 100 || _status_code > 999) {
+        return false;
+    }
+
+    bool chunked = false;
+    bool has_length = false;
+    size_t content_length = 0;
+    std::string connection;
+    size_t pos = line_end + 1;
+    while (pos < _line.length()) {
+        size_t end = _line.find('\n', pos);
+        std::string header = _line.substr(pos, end - pos);
+        pos = end + 1;
+        size_t colon = header.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string name = lowercase(trim(header.substr(0, colon)));
+        std::string value = lowercase(trim(header.substr(colon + 1)));
+        if (name == "content-length") {
+            has_length = true;
+            content_length = strtoul(value.c_str(), NULL, 10);
+        } else if (name == "transfer-encoding") {
+            chunked = value.find("chunked") != std::string::npos;
+        } else if (name == "connection") {
+            connection = value;
+        }
+    }
+    _line.clear();
+
+    if (_status_code < 200) {
+        _status_code = 0;   // An interim response; the real one follows
+        return true;
+    }
+    _keep_alive = http10 ? connection.find("keep-alive") != std::string::npos
+                         : connection.find("close") == std::string::npos;
+    if (_status_code == 204 || _status_code == 304) {
+        _stage = STAGE_DONE;
+    } else if (chunked) {
+        _stage = STAGE_CHUNK_SIZE;
+    } else if (has_length) {
+        _remaining = content_length;
+        _stage = content_length > 0 ? STAGE_BODY : STAGE_DONE;
+    } else {
+        _keep_alive = false;
+        _stage = STAGE_UNTIL_CLOSE;
+    }
+    return true;
+}
+
+bool ResponseParser::_parse_chunk_size(const std::string& line) {
+    std::string digits = trim(line.substr(0, line.find(';')));
+    if (digits.empty() || digits.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+        return false;
+    }
+    _remaining = strtoul(digits.c_str(), NULL, 16);
+    _stage = _remaining > 0 ? STAGE_CHUNK_DATA : STAGE_TRAILERS;
+    return true;
+}
+
+ResponseParser::Status ResponseParser::feed(const char* data, size_t length, size_t& consumed) {
+    /**
+     * @brief Advances through a response. Head and chunk lines are collected a byte
+     * at a time; body bytes are skipped in one step however many arrived.
+     * @param consumed Set to the bytes used; the rest belongs to the next response.
+     */
+    consumed = 0;
+    while (consumed < length && _stage != STAGE_DONE) {
+        if (_stage == STAGE_UNTIL_CLOSE) {
+            consumed = length;
+            return PARSE_INCOMPLETE;
+        }
+        if (_stage == STAGE_BODY || _stage == STAGE_CHUNK_DATA) {
+            size_t take = length - consumed < _remaining ? length - consumed : _remaining;
+            consumed += take;
+            _remaining -= take;
+            if (_remaining == 0) {
+                _stage = _stage == STAGE_BODY ? STAGE_DONE : STAGE_CHUNK_END;
+            }
+            continue;
+        }
+
+        char c = data[consumed++];
+        _line += c;
+        if (_line.length() > MAX_LINE_LENGTH) {
+            return PARSE_ERROR;
+        }
+        if (c != '\n') {
+            continue;
+        }
+        if (_stage == STAGE_HEAD) {
+            size_t size = _line.length();
+            bool blank_line = (size >= 2 && _line[size - 2] == '\n')
+                              || (size >= 4 && _line.compare(size - 4, 4, "\r\n\r\n") == 0);
+            if (blank_line && !_parse_head()) {
+                return PARSE_ERROR;
+            }
+            continue;
+        }
+        std::string line = trim(_line);
+        _line.clear();
+        if (_stage == STAGE_CHUNK_SIZE) {
+            if (!_parse_chunk_size(line)) {
+                return PARSE_ERROR;
+            }
+        } else if (_stage == STAGE_CHUNK_END) {
+            if (!line.empty()) {
+                return PARSE_ERROR;
+            }
+            _stage = STAGE_CHUNK_SIZE;
+        } else if (line.empty()) {
+            _stage = STAGE_DONE;    // The blank line after the trailers
+        }
+    }
+    return _stage == STAGE_DONE ? PARSE_COMPLETE : PARSE_INCOMPLETE;
+}
+
+ResponseParser::Status ResponseParser::finish() {
+    if (_stage == STAGE_UNTIL_CLOSE || _stage == STAGE_DONE) {
+        _stage = STAGE_DONE;
+        return PARSE_COMPLETE;
+    }
+    return PARSE_ERROR;
+}
@@ -0,0 +1,53 @@
+#ifndef RESPONSEPARSER_HPP
+#define RESPONSEPARSER_HPP
+
+#include <string>
+#include <cstddef>
+
+// Incremental HTTP/1.x response framer for the load generator. It finds where
+// one response ends (Content-Length, chunked or close-delimited body) without
+// keeping the body, so pipelined responses can be split out of one read and
+// large downloads cost no copying. Interim 1xx responses are skipped.
+class ResponseParser {
+public:
+    enum Status {
+        PARSE_INCOMPLETE,
+        PARSE_COMPLETE,
+        PARSE_ERROR
+    };
+
+    ResponseParser();
+
+    void reset();
+    // Consumes bytes up to the end of the current response at most
+    Status feed(const char* data, size_t length, size_t& consumed);
+    // The server closed the connection; ends a close-delimited body
+    Status finish();
+    bool hasStarted() const;
+
+    int getStatusCode() const;
+    bool getKeepAlive() const; // false if the server will close after this response
+
+private:
+    enum Stage {
+        STAGE_HEAD,
+        STAGE_BODY,
+        STAGE_CHUNK_SIZE,
+        STAGE_CHUNK_DATA,
+        STAGE_CHUNK_END,
+        STAGE_TRAILERS,
+        STAGE_UNTIL_CLOSE,
+        STAGE_DONE
+    };
+
+    Stage _stage;
+    std::string _line;      // the head, or the current chunk size or trailer line
+    size_t _remaining;      // body or chunk bytes still to come
+    int _status_code;
+    bool _keep_alive;
+
+    bool _parse_head();
+    bool _parse_chunk_size(const std::string& line);
+};
+
+#endif
@@ -0,0 +1,253 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <ctime>
+#include <unistd.h>
+#include <netdb.h>
+#include <pthread.h>
+#include "LoadWorker.hpp"
+#include "RequestMix.hpp"
+
+struct BenchOptions {
+    std::string target;
+    std::string host;        // Host header: the target's host[:port]
+    std::string path;
+    size_t connections;
+    size_t threads;
+    double duration;
+    size_t pipeline;
+    double rate;
+    bool keep_alive;
+    double timeout;
+    std::string mix_file;
+    std::string method;
+    size_t body_size;
+    std::vector<std::string> headers;
+    std::string name;
+
+    BenchOptions()
+        : path("/"), connections(16), threads(2), duration(10), pipeline(1), rate(0), keep_alive(true), timeout(10),
+          method("GET"), body_size(0) {}
+};
+
+static void usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options] <host:port | http://host:port/path>\n"
+              << "  -c <n>       connections (default 16)\n"
+              << "  -t <n>       threads (default 2)\n"
+              << "  -d <sec>     duration in seconds (default 10)\n"
+              << "  -p <n>       requests pipelined on each connection (default 1)\n"
+              << "  -r <rps>     open loop at this many requests per second (default: closed loop)\n"
+              << "  -m <file>    request mix, one JSON object per line\n"
+              << "  -X <method>  method of the request when no mix is given (default GET)\n"
+              << "  -b <bytes>   body size of the request when no mix is given\n"
+              << "  -H <header>  extra header on every request, may be repeated\n"
+              << "  -K           close the connection after every request\n"
+              << "  -T <sec>     fail a request without a response after this long (default 10)\n"
+              << "  -n <name>    also print a tab-separated summary line with this label\n";
+}
+
+static double parseNumber(const char* option, const char* value) {
+    char* end;
+    double number = strtod(value, &end);
+    if (*value == '\0' || *end != '\0' || number < 0) {
+        throw std::runtime_error(std::string("Invalid value for ") + option + ": " + value);
+    }
+    return number;
+}
+
+static BenchOptions parseOptions(int argc, char** argv) {
+    BenchOptions options;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:t:d:p:r:m:X:b:H:KT:n:")) != -1) {
+        switch (opt) {
+            case 'c': options.connections = static_cast<size_t>(parseNumber("-c", optarg)); break;
+            case 't': options.threads = static_cast<size_t>(parseNumber("-t", optarg)); break;
+            case 'd': options.duration = parseNumber("-d", optarg); break;
+            case 'p': options.pipeline = static_cast<size_t>(parseNumber("-p", optarg)); break;
+            case 'r': options.rate = parseNumber("-r", optarg); break;
+            case 'm': options.mix_file = optarg; break;
+            case 'X': options.method = optarg; break;
+            case 'b': options.body_size = static_cast<size_t>(parseNumber("-b", optarg)); break;
+            case 'H': options.headers.push_back(optarg); break;
+            case 'K': options.keep_alive = false; break;
+            case 'T': options.timeout = parseNumber("-T", optarg); break;
+            case 'n': options.name = optarg; break;
+            default: throw std::invalid_argument("usage");
+        }
+    }
+    if (optind != argc - 1 || options.connections == 0 || options.threads == 0 || options.duration <= 0) {
+        throw std::invalid_argument("usage");
+    }
+    options.target = argv[optind];
+    std::string rest = options.target;
+    if (rest.compare(0, 7, "http://") == 0) {
+        rest = rest.substr(7);
+    }
+    size_t slash = rest.find('/');
+    if (slash != std::string::npos) {
+        options.path = rest.substr(slash);
+        rest = rest.substr(0, slash);
+    }
+    options.host = rest;
+    if (options.threads > options.connections) {
+        options.threads = options.connections;
+    }
+    return options;
+}
+
+static void resolve(const std::string& host_port, WorkerOptions& worker) {
+    /**
+     * @brief Resolves host:port (or [v6-address]:port) once for all workers.
+     */
+    std::string host = host_port;
+    std::string port = "80";
+    size_t colon = host_port.rfind(':');
+    if (colon != std::string::npos && host_port.find(']', colon) == std::string::npos) {
+        host = host_port.substr(0, colon);
+        port = host_port.substr(colon + 1);
+    }
+    if (host.length() > 1 && host[0] == '[') {
+        host = host.substr(1, host.length() - 2);
+    }
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = NULL;
+    int status = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+    if (status != 0) {
+        throw std::runtime_error("Cannot resolve " + host_port + ": " + gai_strerror(status));
+    }
+    memcpy(&worker.address, result->ai_addr, result->ai_addrlen);
+    worker.address_length = result->ai_addrlen;
+    freeaddrinfo(result);
+}
+
+static void printReport(const BenchOptions& options, const RequestMix& mix, const WorkerResults& total, double elapsed) {
+    const LatencyRecorder& latency = total.latency;
+    double rate = total.completed / elapsed;
+    double megabytes = total.bytes_read / (1024.0 * 1024.0);
+    unsigned long errors = total.connect_errors + total.io_errors + total.parse_errors + total.timeouts;
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Target:      " << options.target << "\n"
+              << "Load:        " << options.threads << " threads, " << options.connections << " connections, pipeline "
+              << options.pipeline << (options.keep_alive ? "" : ", no keep-alive") << ", ";
+    if (options.rate > 0) {
+        std::cout << "open loop at " << options.rate << " req/s\n";
+    } else {
+        std::cout << "closed loop\n";
+    }
+    std::cout << "Duration:    " << elapsed << " s\n"
+              << "Requests:    " << total.completed << " (" << rate << " req/s)\n"
+              << "Transfer:    " << megabytes << " MB read (" << megabytes / elapsed << " MB/s), "
+              << total.bytes_written / (1024.0 * 1024.0) << " MB written\n"
+              << "Responses:   1xx " << total.status_classes[1] << ", 2xx " << total.status_classes[2]
+              << ", 3xx " << total.status_classes[3] << ", 4xx " << total.status_classes[4]
+              << ", 5xx " << total.status_classes[5] << "\n"
+              << "Errors:      connect " << total.connect_errors << ", read/write " << total.io_errors
+              << ", parse " << total.parse_errors << ", timeout " << total.timeouts;
+    if (options.rate > 0) {
+        std::cout << ", unsent " << total.unsent;
+    }
+    std::cout << "\n" << "Connections: " << total.connections_opened << " opened\n";
+    std::cout << "Latency (us): min " << latency.getMin() << "  mean " << static_cast<unsigned long>(latency.getMean())
+              << "  p50 " << latency.getPercentile(50) << "  p90 " << latency.getPercentile(90)
+              << "  p99 " << latency.getPercentile(99) << "  p99.9 " << latency.getPercentile(99.9)
+              << "  max " << latency.getMax() << "\n";
+    if (mix.size() > 1) {
+        std::cout << "Mix:\n";
+        for (size_t i = 0; i < mix.size(); ++i) {
+            std::cout << "  " << std::setw(8) << total.per_entry[i] << "  " << mix.getEntry(i).method << " "
+                      << mix.getEntry(i).path << "\n";
+        }
+    }
+    if (!options.name.empty()) {
+        std::cout << "summary\t" << options.name << "\t" << rate << "\t" << megabytes / elapsed << "\t"
+                  << latency.getPercentile(50) << "\t" << latency.getPercentile(99) << "\t"
+                  << latency.getPercentile(99.9) << "\t" << errors + total.status_classes[5] << "\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    RequestMix mix;
+    WorkerOptions worker;
+    try {
+        options = parseOptions(argc, argv);
+        if (!options.mix_file.empty()) {
+            mix.loadFile(options.mix_file);
+        } else {
+            MixEntry entry;
+            entry.method = options.method;
+            entry.path = options.path;
+            entry.body.assign(options.body_size, 'x');
+            mix.add(entry);
+        }
+        mix.render(options.host, options.keep_alive, options.headers);
+        resolve(options.host, worker);
+    } catch (const std::invalid_argument&) {
+        usage(argv[0]);
+        return 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    worker.pipeline = options.pipeline;
+    worker.rate = options.rate / options.threads;
+    worker.keep_alive = options.keep_alive;
+    worker.duration_us = static_cast<unsigned long>(options.duration * 1000000);
+    worker.timeout_us = static_cast<unsigned long>(options.timeout * 1000000);
+    worker.mix = &mix;
+
+    // Connections are spread evenly; each thread gets its own random sequence
+    std::vector<LoadWorker*> workers;
+    std::vector<pthread_t> threads(options.threads);
+    for (size_t i = 0; i < options.threads; ++i) {
+        worker.connections = options.connections / options.threads + (i < options.connections % options.threads ? 1 : 0);
+        worker.seed = static_cast<unsigned int>(time(NULL)) ^ static_cast<unsigned int>(i * 2654435761UL);
+        workers.push_back(new LoadWorker(worker));
+    }
+    unsigned long start = monotonicMicros();
+    for (size_t i = 0; i < workers.size(); ++i) {
+        if (pthread_create(&threads[i], NULL, LoadWorker::threadMain, workers[i]) != 0) {
+            std::cerr << "Error: cannot start thread " << i << std::endl;
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = (monotonicMicros() - start) / 1000000.0;
+
+    WorkerResults total;
+    total.per_entry.assign(mix.size(), 0);
+    for (size_t i = 0; i < workers.size(); ++i) {
+        const WorkerResults& results = workers[i]->getResults();
+        total.latency.merge(results.latency);
+        total.completed += results.completed;
+        for (int c = 0; c < 6; ++c) {
+            total.status_classes[c] += results.status_classes[c];
+        }
+        for (size_t e = 0; e < mix.size(); ++e) {
+            total.per_entry[e] += results.per_entry[e];
+        }
+        total.connect_errors += results.connect_errors;
+        total.io_errors += results.io_errors;
+        total.parse_errors += results.parse_errors;
+        total.timeouts += results.timeouts;
+        total.unsent += results.unsent;
+        total.bytes_read += results.bytes_read;
+        total.bytes_written += results.bytes_written;
+        total.connections_opened += results.connections_opened;
+        delete workers[i];
+    }
+    printReport(options, mix, total, elapsed);
+    return total.completed > 0 ? 0 : 2;
+}
@@ -0,0 +1,141 @@
+#!/bin/bash
+# Runs webserv-bench against a freshly started webserv for a set of scenarios.
+# The server gets a scratch document root with small and large static files, an
+# upload location and a shell CGI script, so results do not depend on the tree.
+#
+# Usage: bench/run.sh [scenario...]    (every scenario when none is named)
+#
+# Environment:
+#   DURATION      seconds per scenario (5)
+#   CONNECTIONS   concurrent connections (32)
+#   THREADS       load generator threads (2)
+#   WORKERS       worker_processes of the server (1)
+#   RATE          requests per second of the open-loop scenario (5000)
+#   PORT          port the server listens on (8180)
+#   RESULTS       file the summary of this run is written to (bench/results.tsv)
+#   BASELINE      summary of an earlier run; a scenario whose throughput falls more
+#                 than TOLERANCE percent (10) below it makes the run fail
+
+set -u
+cd "$(dirname "$0")/.."
+
+DURATION=${DURATION:-5}
+CONNECTIONS=${CONNECTIONS:-32}
+THREADS=${THREADS:-2}
+WORKERS=${WORKERS:-1}
+RATE=${RATE:-5000}
+PORT=${PORT:-8180}
+RESULTS=${RESULTS:-bench/results.tsv}
+BASELINE=${BASELINE:-}
+TOLERANCE=${TOLERANCE:-10}
+ALL_SCENARIOS="static-small static-small-pipelined static-large no-keepalive upload cgi mix open-loop"
+
+for binary in ./webserv ./webserv-bench; do
+    if [ ! -x "$binary" ]; then
+        echo "$binary not found, run 'make bench'" >&2
+        exit 1
+    fi
+done
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/webserv-bench.XXXXXX")
+SERVER_PID=
+cleanup() {
+    if [ -n "$SERVER_PID" ]; then
+        kill "$SERVER_PID" 2>/dev/null
+        wait "$SERVER_PID" 2>/dev/null
+    fi
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+mkdir -p "$WORK/www/uploads" "$WORK/www/cgi-bin"
+head -c 1024 /dev/zero | tr '\0' 'a' > "$WORK/www/small.html"
+head -c 1048576 /dev/urandom > "$WORK/www/large.bin"
+printf 'printf "Content-Type: text/plain\\r\\n\\r\\nhello\\n"\n' > "$WORK/www/cgi-bin/hello.sh"
+cat > "$WORK/webserv.conf" <<CONF
+worker_processes $WORKERS;
+error_log $WORK/error.log warn;
+cgi_max_processes 256;
+
+server {
+    listen $PORT;
+    server_name localhost;
+    client_max_body_size 10m;
+    keepalive_requests 100000;
+
+    location / {
+        root $WORK/www;
+        allowed_methods GET;
+    }
+
+    location /uploads {
+        root $WORK/www/uploads;
+        allowed_methods POST;
+    }
+
+    location /cgi-bin {
+        root $WORK/www;
+        allowed_methods GET;
+        cgi_path .sh /bin/sh;
+    }
+}
+CONF
+
+./webserv "$WORK/webserv.conf" > "$WORK/server.out" 2>&1 &
+SERVER_PID=$!
+for attempt in $(seq 50); do
+    if (exec 3<>/dev/tcp/127.0.0.1/$PORT) 2>/dev/null; then
+        break
+    fi
+    if ! kill -0 "$SERVER_PID" 2>/dev/null || [ "$attempt" = 50 ]; then
+        echo "webserv did not start:" >&2
+        cat "$WORK/server.out" "$WORK/error.log" >&2 2>/dev/null
+        exit 1
+    fi
+    sleep 0.1
+done
+
+TARGET=127.0.0.1:$PORT
+run_scenario() {
+    local name=$1
+    local args
+    case "$name" in
+        static-small)           args="$TARGET/small.html" ;;
+        static-small-pipelined) args="-p 16 $TARGET/small.html" ;;
+        static-large)           args="$TARGET/large.bin" ;;
+        no-keepalive)           args="-K $TARGET/small.html" ;;
+        upload)                 args="-X POST -b 65536 $TARGET/uploads/bench.bin" ;;
+        cgi)                    args="$TARGET/cgi-bin/hello.sh" ;;
+        mix)                    args="-m bench/mix.jsonl $TARGET" ;;
+        open-loop)              args="-r $RATE $TARGET/small.html" ;;
+        *) echo "Unknown scenario: $name (one of: $ALL_SCENARIOS)" >&2; return 1 ;;
+    esac
+    echo "== $name"
+    ./webserv-bench -c "$CONNECTIONS" -t "$THREADS" -d "$DURATION" -n "$name" $args | tee "$WORK/$name.out" | grep -v '^summary'
+    grep '^summary' "$WORK/$name.out" | cut -f2- >> "$WORK/results.tsv"
+    echo
+}
+
+status=0
+printf 'scenario\treq_per_s\tmb_per_s\tp50_us\tp99_us\tp999_us\terrors\n' > "$WORK/results.tsv"
+for scenario in ${@:-$ALL_SCENARIOS}; do
+    run_scenario "$scenario" || status=1
+done
+cp "$WORK/results.tsv" "$RESULTS"
+column -t -s "$(printf '\t')" "$RESULTS" 2>/dev/null || cat "$RESULTS"
+
+if [ -n "$BASELINE" ]; then
+    echo
+    # Compares the throughput of every scenario that is in both runs
+    awk -F '\t' -v tolerance="$TOLERANCE" '
+        NR == FNR { if (FNR > 1) baseline[$1] = $2; next }
+        FNR > 1 && ($1 in baseline) && baseline[$1] > 0 {
+            change = ($2 - baseline[$1]) * 100 / baseline[$1]
+            verdict = change < -tolerance ? "REGRESSION" : "ok"
+            printf "%-24s %12.1f -> %12.1f req/s  %+6.1f%%  %s\n", $1, baseline[$1], $2, change, verdict
+            if (verdict != "ok") failed = 1
+        }
+        END { exit failed }
+    ' "$BASELINE" "$RESULTS" || status=1
+fi
+exit $status
@@ -0,0 +1,78 @@
+#ifndef ACCESSLOG_HPP
+#define ACCESSLOG_HPP
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include "HttpRequest.hpp"
+
+class LogBuffer;
+
+// What is known about an answered request when it is logged
+struct AccessLogEntry {
+    const std::string* remote_addr;
+    const HttpRequest* request;
+    int status;
+    unsigned long bytes_sent;        // response bytes queued, headers included
+    unsigned long request_time_us;   // from the first byte of the request
+    long upstream_time_us;           // time spent in CGI or FastCGI, -1 if none
+};
+
+// The access log (access_log / log_format). The format is compiled once into
+// literal text and variables; each request is then rendered into a reused line
+// buffer and handed to a LogBuffer, which the event loop flushes in batches.
+//
+// Variables: $remote_addr $time_local $time_iso8601 $request $request_method
+// $request_uri $server_protocol $host $status $bytes_sent $request_time_us
+// $upstream_time_us. Values that could break up a line, such as quotes and
+// control characters in request fields, are escaped as \xHH.
+class AccessLog {
+public:
+    static const char* const DEFAULT_FORMAT;
+
+    // Throws std::runtime_error for an unknown variable or an unusable path
+    AccessLog(const std::string& path, const std::string& format);
+    ~AccessLog();
+
+    void log(const AccessLogEntry& entry);
+    void flush();
+
+private:
+    enum Field {
+        FIELD_LITERAL,
+        FIELD_REMOTE_ADDR,
+        FIELD_TIME_LOCAL,
+        FIELD_TIME_ISO8601,
+        FIELD_REQUEST,
+        FIELD_REQUEST_METHOD,
+        FIELD_REQUEST_URI,
+        FIELD_SERVER_PROTOCOL,
+        FIELD_HOST,
+        FIELD_STATUS,
+        FIELD_BYTES_SENT,
+        FIELD_REQUEST_TIME_US,
+        FIELD_UPSTREAM_TIME_US
+    };
+
+    struct Segment {
+        Field field;
+        std::string text; // for FIELD_LITERAL
+    };
+
+    std::vector<Segment> _segments;
+    LogBuffer* _buffer;
+    std::string _line;
+    time_t _cached_time;
+    std::string _time_local;
+    std::string _time_iso8601;
+
+    void _compile(const std::string& format);
+    void _update_time();
+    static void _append_number(std::string& out, unsigned long value);
+    static void _append_escaped(std::string& out, const std::string& value);
+
+    AccessLog(const AccessLog&);
+    AccessLog& operator=(const AccessLog&);
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef CACHEDFILE_HPP
+#define CACHEDFILE_HPP
+
+#include <string>
+#include <ctime>
+#include <sys/types.h>
+
+// The result of opening a path: an open descriptor for regular files plus the
+// stat data and Content-Type needed to answer a request, or the error that
+// occurred. Instances are reference counted so that a response can keep
+// streaming from the descriptor after the cache has dropped the entry.
+class CachedFile {
+public:
+    static CachedFile* open(const std::string& path);
+
+    void retain();
+    void release();
+
+    const std::string& getPath() const;
+    int getFd() const;
+    bool exists() const;
+    bool isDirectory() const;
+    bool isRegularFile() const;
+    off_t getSize() const;
+    time_t getMtime() const;
+    ino_t getInode() const;
+    const std::string& getContentType() const;
+
+    bool matches(const struct stat& s) const;
+
+    static std::string detectContentType(const std::string& path);
+
+private:
+    std::string _path;
+    int _fd;
+    int _refcount;
+    int _error;
+    bool _is_directory;
+    off_t _size;
+    time_t _mtime;
+    ino_t _inode;
+    std::string _content_type;
+
+    CachedFile(const std::string& path);
+    ~CachedFile();
+    CachedFile(const CachedFile&);
+    CachedFile& operator=(const CachedFile&);
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef CGIPROCESS_HPP
+#define CGIPROCESS_HPP
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "EventLoop.hpp"
+#include "CgiRequest.hpp"
+
+// A running CGI script serving one request. Its stdin and stdout are
+// non-blocking pipes watched by the event loop: the request body is fed in as
+// the pipe accepts it and output is collected as it is produced, so the server
+// never waits on the script. The child is reaped via SIGCHLD; the request is
+// finished once the child has exited and its stdout reached end-of-file.
+class CgiProcess : public CgiRequest {
+public:
+    enum IoStatus {
+        IO_OK,      // made progress, more may follow
+        IO_AGAIN,   // the pipe is not ready
+        IO_DONE     // finished with this pipe (EOF, all input written, or an error)
+    };
+
+    CgiProcess(Connection* connection, bool keep_alive, int timeout);
+    ~CgiProcess();
+
+    bool start(const std::string& interpreter, const std::string& script,
+               const std::vector<std::string>& environment, const std::string& input);
+    void kill();
+
+    IoStatus writeInput();
+    IoStatus readOutput();
+    void closeStdin();
+    void closeStdout();
+    void setExitStatus(int status);
+
+    pid_t getPid() const;
+    int getStdinFd() const;
+    int getStdoutFd() const;
+    EventTarget* getStdinTarget();
+    EventTarget* getStdoutTarget();
+    bool hasExited() const;
+    int getExitStatus() const;
+    bool isFinished() const;
+
+private:
+    pid_t _pid;
+    int _stdin_fd;
+    int _stdout_fd;
+    EventTarget _stdin_target;
+    EventTarget _stdout_target;
+    std::string _input;
+    size_t _input_offset;
+    bool _exited;
+    int _exit_status;
+
+    CgiProcess(const CgiProcess&);
+    CgiProcess& operator=(const CgiProcess&);
+};
+
+#endif
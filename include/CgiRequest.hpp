@@ -0,0 +1,93 @@
+#ifndef CGIREQUEST_HPP
+#define CGIREQUEST_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <ctime>
+
+class Connection;
+
+// A request handed to a dynamic content backend: either a forked CGI script
+// (CgiProcess) or a FastCGI application server (FastCgiRequest). The client
+// connection waits for it without blocking the event loop. Output is relayed
+// as it arrives: the CGI header block is parsed incrementally, and once it is
+// complete WebServer sends the response head and then streams the body,
+// framed with the script's Content-Length or chunked encoding. If the client
+// goes away first the request is detached and its output discarded.
+class CgiRequest {
+public:
+    enum Type {
+        PROCESS,
+        FASTCGI
+    };
+
+    enum HeaderStatus {
+        HEADERS_INCOMPLETE,
+        HEADERS_COMPLETE,
+        HEADERS_INVALID
+    };
+
+    enum Framing {
+        FRAMING_LENGTH,    // the script's Content-Length, surplus output is dropped
+        FRAMING_CHUNKED,
+        FRAMING_CLOSE      // HTTP/1.0 client: the body ends when the connection closes
+    };
+
+    CgiRequest(Type type, Connection* connection, bool keep_alive, int timeout);
+    virtual ~CgiRequest();
+
+    Type getType() const;
+    Connection* getConnection() const;
+    void detach();
+    bool getKeepAlive() const;
+    void setKeepAlive(bool keep_alive);
+    unsigned long getDeadline() const;
+    const std::string& getOutput() const;
+
+    // Output is no longer read while the client has this much left to receive
+    bool isThrottled() const;
+    void setPaused(bool paused);
+    bool isPaused() const;
+
+    HeaderStatus parseHeaders();
+    int getStatusCode() const;
+    const std::vector<std::pair<std::string, std::string> >& getHeaders() const;
+
+    void startBody(Framing framing, size_t content_length);
+    bool hasStartedBody() const;
+    Framing getFraming() const;
+    bool takeBody(std::string& wire);
+    void discardOutput();
+    bool isBodyComplete() const;
+
+protected:
+    std::string _output;     // backend output not yet relayed to the client
+
+    void _touch();           // records progress for the timeout
+
+private:
+    Type _type;
+    Connection* _connection; // NULL once the client is gone or was answered
+    bool _keep_alive;
+    int _timeout;
+    unsigned long _last_activity; // TimerWheel::now() of the last progress
+    bool _paused;
+
+    HeaderStatus _header_status;
+    size_t _header_scan;     // start of the first header line not yet parsed
+    int _status_code;        // from a Status header, 0 if none
+    bool _has_location;
+    std::vector<std::pair<std::string, std::string> > _headers;
+
+    bool _body_started;
+    Framing _framing;
+    size_t _body_remaining;  // with FRAMING_LENGTH
+
+    HeaderStatus _invalid_headers();
+
+    CgiRequest(const CgiRequest&);
+    CgiRequest& operator=(const CgiRequest&);
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef CHUNKEDDECODER_HPP
+#define CHUNKEDDECODER_HPP
+
+#include <string>
+#include "RequestBody.hpp"
+
+// Incremental decoder for a "Transfer-Encoding: chunked" request body. Input can
+// be fed in arbitrary pieces as it arrives; chunk data is written straight into
+// a RequestBody and everything else (sizes, extensions, trailers) is consumed
+// without being buffered, so memory use does not depend on chunk or body size.
+class ChunkedDecoder {
+public:
+    enum Status {
+        DECODE_MORE,   // all input consumed, the body continues
+        DECODE_DONE,   // last chunk and trailers read
+        DECODE_ERROR   // see getErrorStatus()
+    };
+
+    ChunkedDecoder();
+
+    void reset(size_t limit);
+    Status decode(const char* data, size_t length, size_t& consumed, RequestBody& body);
+    int getErrorStatus() const; // 400 malformed, 413 too large, 500 write failure
+    size_t getDecodedSize() const;
+
+private:
+    enum State {
+        STATE_SIZE,
+        STATE_EXTENSION,
+        STATE_SIZE_LF,
+        STATE_DATA,
+        STATE_DATA_CR,
+        STATE_DATA_LF,
+        STATE_TRAILER,
+        STATE_TRAILER_LF,
+        STATE_DONE,
+        STATE_ERROR
+    };
+
+    State _state;
+    size_t _chunk_size;
+    size_t _size_digits;
+    size_t _remaining;     // data bytes left in the current chunk
+    size_t _line_length;   // bytes in the current size or trailer line
+    size_t _trailer_bytes;
+    size_t _decoded;
+    size_t _limit;
+    int _error_status;
+
+    Status _fail(int status);
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef CONFIGGENERATION_HPP
+#define CONFIGGENERATION_HPP
+
+#include <vector>
+#include "ServerConfig.hpp"
+#include "VirtualHostMap.hpp"
+
+// One loaded set of server blocks together with the routing compiled from it.
+// A reload builds a new generation and makes it current. A request whose head
+// arrived earlier stays pinned to the generation it started under until it has
+// been answered, so the previous generation lives on until its last request is done.
+struct ConfigGeneration {
+    std::vector<ServerConfig> servers;
+    VirtualHostMap virtual_hosts;  // points into servers
+    size_t requests;               // requests pinned to this generation
+
+    explicit ConfigGeneration(const std::vector<ServerConfig>& configs) : servers(configs), requests(0) {
+        virtual_hosts.build(servers);
+    }
+
+private:
+    ConfigGeneration(const ConfigGeneration&);
+    ConfigGeneration& operator=(const ConfigGeneration&);
+};
+
+#endif
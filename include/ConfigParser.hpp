@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include "ServerConfig.hpp"
+#include "GlobalConfig.hpp"
 
 class ConfigParser {
 public:
@@ -11,14 +12,18 @@ public:
     ~ConfigParser();
 
     std::vector<ServerConfig> parse();
+    const GlobalConfig& getGlobalConfig() const;
 
 private:
     std::string _filename;
     std::string _content;
     size_t _pos;
+    GlobalConfig _global_config;
 
     void _eat_whitespace();
     std::string _next_token();
+    static size_t _parse_size(const std::string& size_str);
+    static int _parse_duration(const std::string& duration_str);
     void _parse_server_block(std::vector<ServerConfig>& configs);
     void _parse_location_block(Location& location);
 };
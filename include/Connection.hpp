@@ -0,0 +1,199 @@
+#ifndef CONNECTION_HPP
+#define CONNECTION_HPP
+
+#include <string>
+#include <deque>
+#include <ctime>
+#include <sys/types.h>
+#include "EventLoop.hpp"
+#include "TimerWheel.hpp"
+#include "CachedFile.hpp"
+#include "SharedBuffer.hpp"
+#include "HttpRequest.hpp"
+#include "RequestBody.hpp"
+#include "ChunkedDecoder.hpp"
+
+class CgiRequest;
+class HttpResponse;
+struct ConfigGeneration;
+struct LocationMetrics;
+
+// A piece of queued output: bytes held in memory (owned, or a shared buffer) or
+// a region of an open file that is streamed to the socket with sendfile().
+struct OutputChunk {
+    std::string data;
+    SharedBuffer* shared;   // sent instead of data when set; one reference is held
+    size_t data_offset;
+    size_t shared_end;      // end of the part of shared that is sent
+    CachedFile* file;       // NULL for an in-memory chunk; one reference is held
+    off_t file_offset;
+    size_t file_remaining;
+};
+
+// Per-client state kept between poll() wakeups. Bytes are accumulated in the
+// read buffer until a full request is framed, and serialized responses are
+// flushed from the output queue as the socket becomes writable. On a persistent
+// connection several pipelined requests may sit in the read buffer at once;
+// they are consumed one at a time and their responses queued in order.
+// Consecutive in-memory chunks (headers, bodies, shared renderings) are sent
+// together with writev(), so a header block and its body never need to be
+// copied into one buffer.
+class Connection {
+public:
+    enum State {
+        READING_HEADERS,
+        HEAD_COMPLETE,    // waiting for startBody() to say where the body goes
+        READING_BODY
+    };
+
+    enum IoStatus {
+        IO_OK,
+        IO_AGAIN,
+        IO_EOF,
+        IO_ERROR
+    };
+
+    Connection(int fd, int port, const std::string& remote_address);
+    ~Connection();
+
+    int getFd() const;
+    int getPort() const;
+    const std::string& getRemoteAddress() const;
+    EventTarget* getEventTarget();
+    State getState() const;
+
+    IoStatus readFromSocket();
+    bool readRequestHead();
+    void startBody(size_t limit);
+    bool hasCompleteRequest();
+    int getErrorStatus() const;
+    const std::string& getReadBuffer() const;
+    size_t getRequestLength() const;
+    const HttpRequest& getRequest() const;
+    RequestBody& getBody();
+    void consumeRequest();
+    size_t getRequestsServed() const;
+
+    // For the access log and metrics: when the current request began, when its head
+    // was complete, when it went to its handler and when a CGI script or FastCGI
+    // application was given it (TimerWheel::nowMicros(), 0 if not yet), and the
+    // response bytes queued since the previous call
+    unsigned long getRequestStart() const;
+    unsigned long getHeadComplete() const;
+    void setHandlerStart(unsigned long start);
+    unsigned long getHandlerStart() const;
+    void setUpstreamStart(unsigned long start);
+    unsigned long getUpstreamStart() const;
+    unsigned long takeResponseBytes();
+
+    // Where the current request's latencies are recorded, NULL if it matched no location
+    void setLocationMetrics(LocationMetrics* metrics);
+    LocationMetrics* getLocationMetrics() const;
+
+    // Bytes read from and written to the socket over the connection's lifetime
+    unsigned long getBytesReceived() const;
+    unsigned long getBytesSent() const;
+
+    void queueResponse(const std::string& data);
+    void queueHeaders(const HttpResponse& response);
+    void queueBody(std::string& body);
+    void queueRendered(SharedBuffer* rendered);
+    void queueFile(CachedFile* file, off_t offset, size_t length);
+    IoStatus writeToSocket();
+    bool hasPendingOutput() const;
+    size_t getPendingOutputSize() const;
+
+    void setCloseAfterWrite(bool close_after_write);
+    bool getCloseAfterWrite() const;
+    void setKeepAliveTimeout(int seconds);
+    int getKeepAliveTimeout() const;
+    bool isIdle() const;
+
+    // Seconds allowed for a whole request head, and between two reads of a body or
+    // two writes of a response
+    void setTimeouts(int header_timeout, int body_timeout, int send_timeout);
+    Timer* getTimer();
+    unsigned long getDeadline() const;
+
+    // The configuration the current request started under, NULL between requests
+    void setConfig(ConfigGeneration* config);
+    ConfigGeneration* getConfig() const;
+
+    // Set while a CGI script or FastCGI application produces the response to the current request
+    void setCgi(CgiRequest* cgi);
+    CgiRequest* getCgi() const;
+
+    // A closed connection stays allocated until the end of the event loop
+    // iteration, so notifications already collected for it can be skipped
+    void markClosed();
+    bool isClosed() const;
+
+    // Closing while the client still sends a rejected body could reset the
+    // connection before it reads the error, so such input is drained first
+    void setLingerOnClose(bool linger);
+    bool getLingerOnClose() const;
+    void startLingeringClose();
+    bool isLingering() const;
+    IoStatus discardInput();
+
+private:
+    int _fd;
+    int _port;
+    std::string _remote_address;
+    EventTarget _event_target;
+    State _state;
+
+    std::string _read_buffer;
+    HttpRequest _request;     // parsed incrementally from _read_buffer, reused per request
+    size_t _header_length;    // includes the blank line, 0 until known
+    size_t _request_length;   // full request size, 0 until known
+    size_t _body_remaining;   // Content-Length bytes not yet moved to _body
+    size_t _body_limit;
+    RequestBody _body;
+    ChunkedDecoder _chunked_decoder;
+    int _error_status;        // parse or body error to answer with, 0 if none
+
+    size_t _requests_served;
+    unsigned long _request_start;
+    unsigned long _head_complete;
+    unsigned long _handler_start;
+    unsigned long _upstream_start;
+    unsigned long _response_bytes;
+    LocationMetrics* _location_metrics;
+    unsigned long _bytes_received;
+    unsigned long _bytes_sent;
+
+    std::deque<OutputChunk> _output;
+    size_t _pending_output;   // bytes left across all queued chunks
+    std::string _spare_buffer; // storage of a sent chunk, reused for the next header block
+    bool _close_after_write;
+    int _keepalive_timeout;
+    int _header_timeout;
+    int _body_timeout;
+    int _send_timeout;
+    unsigned long _last_activity; // TimerWheel::now() of the last read or write
+    unsigned long _head_start;    // when the current request head began to arrive
+    Timer _timer;
+    ConfigGeneration* _config;
+    CgiRequest* _cgi;
+    bool _closed;
+    bool _linger_on_close;
+    bool _lingering;
+    unsigned long _linger_start;
+
+    bool _decode_chunked_body();
+    bool _store_body(const char* data, size_t length);
+    void _fail_body(int status);
+    std::string& _append_buffer(size_t length);
+    void _add_pending(size_t length);
+    void _queue_shared(SharedBuffer* buffer, size_t begin, size_t end);
+    IoStatus _write_memory();
+    IoStatus _write_file(OutputChunk& chunk);
+    void _pop_chunk();
+    static void _release_chunk(OutputChunk& chunk);
+
+    Connection(const Connection&);
+    Connection& operator=(const Connection&);
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef EPOLLEVENTLOOP_HPP
+#define EPOLLEVENTLOOP_HPP
+
+#ifdef __linux__
+
+#include <vector>
+#include <sys/epoll.h>
+#include "EventLoop.hpp"
+
+// Linux backend using edge-triggered epoll. Every descriptor is registered once
+// for both directions, so changing interest never costs a system call; the
+// EventTarget pointer is stored in the epoll data and returned as-is.
+class EpollEventLoop : public EventLoop {
+public:
+    EpollEventLoop();
+    ~EpollEventLoop();
+
+    void add(int fd, int events, EventTarget* target);
+    void modify(int fd, int events, EventTarget* target);
+    void remove(int fd);
+    int wait(std::vector<Event>& ready, int timeout_ms);
+    bool isEdgeTriggered() const;
+    const char* getName() const;
+
+private:
+    int _epoll_fd;
+    std::vector<epoll_event> _events;
+
+    EpollEventLoop(const EpollEventLoop&);
+    EpollEventLoop& operator=(const EpollEventLoop&);
+};
+
+#endif
+
+#endif
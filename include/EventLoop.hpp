@@ -0,0 +1,53 @@
+#ifndef EVENTLOOP_HPP
+#define EVENTLOOP_HPP
+
+#include <string>
+#include <vector>
+
+// What a registered descriptor belongs to. The event loop hands this pointer
+// back with every readiness notification, so dispatch needs no fd lookup.
+struct EventTarget {
+    enum Type {
+        LISTENER,
+        CLIENT,
+        CGI,      // a pipe of a CgiProcess; fd tells stdin from stdout
+        FASTCGI,  // a FastCgiConnection to an application server
+        SIGNAL    // the read end of the SIGCHLD self-pipe
+    };
+
+    Type type;
+    int fd;
+    void* owner;
+};
+
+// Readiness notification backend used by WebServer::run(). Implementations may
+// be level-triggered (poll) or edge-triggered (epoll); with an edge-triggered
+// backend callers must read and write until EAGAIN before waiting again.
+class EventLoop {
+public:
+    enum {
+        EVENT_READ = 1,
+        EVENT_WRITE = 2,
+        EVENT_ERROR = 4,
+        EVENT_HANGUP = 8,        // the connection is gone; reported whether watched or not
+        EVENT_PEER_SHUTDOWN = 16 // the peer will send nothing more; can be watched without EVENT_READ
+    };
+
+    struct Event {
+        EventTarget* target;
+        int events;
+    };
+
+    virtual ~EventLoop();
+
+    virtual void add(int fd, int events, EventTarget* target) = 0;
+    virtual void modify(int fd, int events, EventTarget* target) = 0;
+    virtual void remove(int fd) = 0;
+    virtual int wait(std::vector<Event>& ready, int timeout_ms) = 0;
+    virtual bool isEdgeTriggered() const = 0;
+    virtual const char* getName() const = 0;
+
+    static EventLoop* create(const std::string& backend);
+};
+
+#endif
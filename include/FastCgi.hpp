@@ -0,0 +1,59 @@
+#ifndef FASTCGI_HPP
+#define FASTCGI_HPP
+
+#include <string>
+
+// A complete record read from a FastCGI application, with padding removed
+struct FastCgiRecord {
+    unsigned char type;
+    unsigned short request_id;
+    std::string content;
+};
+
+// Encoder and decoder for the FastCGI 1.0 record protocol. Records are appended
+// to an output string ready to be written to the application socket, and parsed
+// from the front of an input buffer once they have fully arrived.
+class FastCgi {
+public:
+    enum RecordType {
+        BEGIN_REQUEST = 1,
+        ABORT_REQUEST = 2,
+        END_REQUEST = 3,
+        PARAMS = 4,
+        STDIN = 5,
+        STDOUT = 6,
+        STDERR = 7,
+        DATA = 8,
+        GET_VALUES = 9,
+        GET_VALUES_RESULT = 10,
+        UNKNOWN_TYPE = 11
+    };
+
+    enum ProtocolStatus {
+        REQUEST_COMPLETE = 0,
+        CANT_MPX_CONN = 1,
+        OVERLOADED = 2,
+        UNKNOWN_ROLE = 3
+    };
+
+    static const size_t HEADER_LENGTH = 8;
+    static const size_t MAX_CONTENT_LENGTH = 65535;
+
+    static void appendBeginRequest(std::string& out, unsigned short request_id, bool keep_conn);
+    static void appendAbortRequest(std::string& out, unsigned short request_id);
+    static void appendStream(std::string& out, unsigned char type, unsigned short request_id,
+                             const char* data, size_t length);
+    static void appendNameValue(std::string& out, const std::string& name, const std::string& value);
+
+    static bool parseRecord(const std::string& buffer, size_t& offset, FastCgiRecord& record);
+    static bool parseEndRequest(const std::string& content, unsigned int& app_status, unsigned char& protocol_status);
+
+private:
+    static void _append_record(std::string& out, unsigned char type, unsigned short request_id,
+                               const char* data, size_t length);
+    static void _append_length(std::string& out, size_t length);
+
+    FastCgi();
+};
+
+#endif
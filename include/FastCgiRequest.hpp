@@ -0,0 +1,45 @@
+#ifndef FASTCGIREQUEST_HPP
+#define FASTCGIREQUEST_HPP
+
+#include <string>
+#include <vector>
+#include "CgiRequest.hpp"
+
+class FastCgiUpstream;
+
+// A request passed to a FastCGI application through a FastCgiUpstream. The
+// CGI meta-variables and the body are kept until the request is sent on a
+// backend connection, which may happen later if every connection is busy.
+class FastCgiRequest : public CgiRequest {
+public:
+    FastCgiRequest(Connection* connection, bool keep_alive, int timeout, FastCgiUpstream* upstream,
+                   const std::vector<std::string>& environment, const std::string& input);
+    ~FastCgiRequest();
+
+    FastCgiUpstream* getUpstream() const;
+
+    void encode(std::string& out, unsigned short request_id, bool reused_connection);
+    unsigned short getRequestId() const;
+    bool isOnReusedConnection() const;
+    void setRetried();
+    bool wasRetried() const;
+
+    void appendOutput(const std::string& data);
+    void complete(unsigned int app_status, unsigned char protocol_status);
+    void fail();
+
+    bool hasFailed() const;   // the connection to the application broke
+    unsigned char getProtocolStatus() const;
+
+private:
+    FastCgiUpstream* _upstream;
+    std::string _params;      // encoded name-value pairs, released once sent
+    std::string _input;
+    unsigned short _request_id;
+    bool _reused_connection;  // sent on a connection that served earlier requests
+    bool _retried;
+    bool _failed;
+    unsigned char _protocol_status;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef FASTCGIUPSTREAM_HPP
+#define FASTCGIUPSTREAM_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <sys/socket.h>
+#include "EventLoop.hpp"
+#include "FastCgi.hpp"
+#include "FastCgiRequest.hpp"
+
+class FastCgiUpstream;
+
+// A socket to a FastCGI application, registered with the event loop
+struct FastCgiConnection {
+    FastCgiUpstream* upstream;
+    int fd;                      // -1 once closed; freed at the end of the loop iteration
+    EventTarget target;
+    bool connecting;             // non-blocking connect() still in progress
+    bool reused;                 // has completed at least one request
+    bool paused;                 // not watched while a client has too much output queued
+    size_t capacity;             // requests it may carry at once
+    std::string write_buffer;
+    size_t write_offset;
+    std::string read_buffer;
+    std::map<unsigned short, FastCgiRequest*> requests; // by FastCGI request id
+};
+
+// A pool of persistent connections to one FastCGI application (fastcgi_pass).
+// Requests are sent with FCGI_KEEP_CONN so connections stay open for the next
+// request. With multiplex=N up to N requests share a connection, distinguished
+// by their request id; otherwise each connection carries one request at a time.
+// Requests that find every connection busy and the pool at max_conns wait in
+// arrival order. Finished requests are handed back to the caller, which answers
+// their clients and deletes them.
+class FastCgiUpstream {
+public:
+    FastCgiUpstream(const std::string& address, size_t max_connections, size_t multiplex, EventLoop* event_loop);
+    ~FastCgiUpstream();
+
+    static bool resolveAddress(const std::string& address, sockaddr_storage& addr, socklen_t& addr_len);
+
+    bool submit(FastCgiRequest* request, std::vector<FastCgiRequest*>& finished);
+    void handleEvent(FastCgiConnection& conn, int events, std::vector<FastCgiRequest*>& finished);
+    void abort(FastCgiRequest* request, std::vector<FastCgiRequest*>& finished);
+    void resume(FastCgiRequest* request);
+    void deleteClosed();
+
+private:
+    std::string _address;
+    sockaddr_storage _addr;
+    socklen_t _addr_len;
+    bool _resolved;
+    size_t _max_connections;
+    size_t _multiplex;
+    EventLoop* _event_loop;
+    std::vector<FastCgiConnection*> _connections;
+    std::deque<FastCgiRequest*> _waiting;
+    std::vector<FastCgiConnection*> _closed;
+
+    FastCgiConnection* _find_connection(const FastCgiRequest* request) const;
+    FastCgiConnection* _connect();
+    FastCgiConnection* _pick_connection();
+    void _dispatch(FastCgiConnection& conn, FastCgiRequest* request, std::vector<FastCgiRequest*>& finished);
+    void _dispatch_waiting(std::vector<FastCgiRequest*>& finished);
+    bool _flush(FastCgiConnection& conn);
+    bool _read(FastCgiConnection& conn, std::vector<FastCgiRequest*>& finished);
+    void _handle_record(FastCgiConnection& conn, const FastCgiRecord& record, std::vector<FastCgiRequest*>& finished);
+    void _update_events(FastCgiConnection& conn);
+    void _close(FastCgiConnection& conn, std::vector<FastCgiRequest*>& finished);
+
+    FastCgiUpstream(const FastCgiUpstream&);
+    FastCgiUpstream& operator=(const FastCgiUpstream&);
+};
+
+#endif
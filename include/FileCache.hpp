@@ -0,0 +1,46 @@
+#ifndef FILECACHE_HPP
+#define FILECACHE_HPP
+
+#include <string>
+#include <map>
+#include <list>
+#include <ctime>
+#include "CachedFile.hpp"
+
+// LRU cache of open files and their metadata, keyed by resolved path. Lookups
+// of missing paths are cached too, so probing for an index file costs nothing
+// on a hit. An entry older than the validity period is re-checked with stat()
+// and reopened if the file changed. With max_entries 0 nothing is cached.
+class FileCache {
+public:
+    FileCache(size_t max_entries, int valid_seconds);
+    ~FileCache();
+
+    CachedFile* get(const std::string& path);
+    void invalidate(const std::string& path);
+
+    size_t getHits() const;
+    size_t getMisses() const;
+    size_t size() const;
+
+private:
+    struct Entry {
+        CachedFile* file;
+        time_t validated;
+        std::list<const std::string*>::iterator lru_pos;
+    };
+
+    size_t _max_entries;
+    int _valid_seconds;
+    std::map<std::string, Entry> _entries;
+    std::list<const std::string*> _lru; // most recently used first
+    size_t _hits;
+    size_t _misses;
+
+    void _erase(std::map<std::string, Entry>::iterator it);
+
+    FileCache(const FileCache&);
+    FileCache& operator=(const FileCache&);
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef GLOBALCONFIG_HPP
+#define GLOBALCONFIG_HPP
+
+#include <string>
+#include "Logger.hpp"
+
+// Process-wide settings declared outside of any server block.
+class GlobalConfig {
+public:
+    GlobalConfig();
+    ~GlobalConfig();
+
+    void setEventBackend(const std::string& backend);
+    const std::string& getEventBackend() const;
+
+    void setWorkerProcesses(int count);
+    int getWorkerProcesses() const;
+
+    void setOpenFileCache(size_t max_entries, int valid_seconds);
+    size_t getOpenFileCacheMax() const;
+    int getOpenFileCacheValid() const;
+
+    void setStaticCacheSize(size_t bytes);
+    size_t getStaticCacheSize() const;
+
+    void setStaticCacheMaxFileSize(size_t bytes);
+    size_t getStaticCacheMaxFileSize() const;
+
+    void setCgiMaxProcesses(size_t count);
+    size_t getCgiMaxProcesses() const;
+
+    void setWorkerConnections(size_t count);
+    size_t getWorkerConnections() const; // client connections open at once in each worker
+
+    void setAcceptBatch(size_t count);
+    size_t getAcceptBatch() const; // connections accepted per listener wakeup
+
+    void setLimitConnPerIp(size_t count);
+    size_t getLimitConnPerIp() const; // 0 for no limit
+
+    void setErrorLog(const std::string& path, Logger::Level level);
+    const std::string& getErrorLogPath() const; // a file or "stderr"
+    Logger::Level getErrorLogLevel() const;
+
+    void setAccessLog(const std::string& path);
+    const std::string& getAccessLog() const; // empty for off
+    void setLogFormat(const std::string& format);
+    const std::string& getLogFormat() const;
+
+private:
+    std::string _event_backend;
+    int _worker_processes;
+    size_t _open_file_cache_max;
+    int _open_file_cache_valid;
+    size_t _static_cache_size;
+    size_t _static_cache_max_file_size;
+    size_t _cgi_max_processes;
+    size_t _worker_connections;
+    size_t _accept_batch;
+    size_t _limit_conn_per_ip;
+    std::string _error_log_path;
+    Logger::Level _error_log_level;
+    std::string _access_log;
+    std::string _log_format;
+};
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef GZIP_HPP
+#define GZIP_HPP
+
+#include <string>
+
+// Compression of response bodies into the gzip format (RFC 1952) with zlib.
+// A whole body is compressed in one call, so it is only used for representations
+// small enough to hold in memory; larger files are better served precompressed.
+class Gzip {
+public:
+    static bool compress(const char* data, size_t length, int level, std::string& out);
+
+private:
+    Gzip();
+};
+
+#endif
@@ -2,30 +2,108 @@
 #define HTTPREQUEST_HPP
 
 #include <string>
-#include <map>
+#include <vector>
+#include <ctime>
+#include <sys/types.h>
 
+// An inclusive byte range resolved against the size of the selected representation
+struct ByteRange {
+    off_t first;
+    off_t last;
+};
+
+// A header line as offsets into the buffer the request was parsed from
+struct HeaderField {
+    size_t name_offset;
+    size_t name_length;
+    size_t value_offset;
+    size_t value_length;
+};
+
+// An HTTP request head, parsed incrementally from a connection's read buffer.
+// parse() may be called again each time more bytes arrive; it resumes where it
+// stopped and reports PARSE_INCOMPLETE until the blank line that ends the headers.
+// Header fields are kept as offset/length views into the buffer, so they stay
+// valid only until the request is consumed from it. Frequently used headers are
+// recognized while parsing and copied into per-request slots that keep their
+// capacity across reset(), so a reused HttpRequest parses without allocating.
 class HttpRequest {
 public:
+    enum ParseStatus {
+        PARSE_INCOMPLETE,
+        PARSE_COMPLETE,
+        PARSE_ERROR
+    };
+
+    enum HeaderId {
+        HEADER_HOST,
+        HEADER_CONNECTION,
+        HEADER_CONTENT_LENGTH,
+        HEADER_TRANSFER_ENCODING,
+        HEADER_CONTENT_TYPE,
+        HEADER_EXPECT,
+        HEADER_IF_NONE_MATCH,
+        HEADER_IF_MODIFIED_SINCE,
+        HEADER_IF_RANGE,
+        HEADER_RANGE,
+        HEADER_ACCEPT_ENCODING,
+        HEADER_COUNT
+    };
+
     HttpRequest();
     ~HttpRequest();
 
-    void parse(const std::string& raw_request);
+    ParseStatus parse(const std::string& buffer);
+    void reset();
+    int getErrorStatus() const;   // 400, 431, 501 or 505 after PARSE_ERROR
+    size_t getHeaderLength() const;
 
     const std::string& getMethod() const; // GET, POST, DELETE
     const std::string& getUri() const;
     const std::string& getHttpVersion() const;
-    const std::string& getHeader(const std::string& name) const;
-    const std::string& getBody() const;
+    const std::string& getHeader(HeaderId id) const;
+    size_t getHeaderCount() const;
+    std::string getHeaderName(size_t index) const;
+    std::string getHeaderValue(size_t index) const;
+
+    bool isChunked() const;
+    size_t getContentLength() const;
+
+    bool getByteRanges(off_t entity_size, std::vector<ByteRange>& ranges) const;
+    bool acceptsEncoding(const std::string& coding) const;
+
+    static time_t parseHttpDate(const std::string& value);
 
 private:
+    enum Stage {
+        STAGE_REQUEST_LINE,
+        STAGE_HEADERS,
+        STAGE_DONE
+    };
+
+    const std::string* _buffer;  // the buffer being parsed; only valid until consumed
+    Stage _stage;
+    size_t _parse_pos;           // first byte not yet scanned for a line break
+    size_t _line_start;
+    int _error_status;
+
     std::string _method;
     std::string _uri;
     std::string _http_version;
-    std::map<std::string, std::string> _headers;
-    std::string _body;
+    std::vector<HeaderField> _fields;
+    int _known_fields[HEADER_COUNT];        // index into _fields, -1 if absent
+    std::string _known_values[HEADER_COUNT];
+    bool _chunked;
+    size_t _content_length;
+
+    ParseStatus _fail(int status);
+    bool _parse_request_line(const char* line, size_t length);
+    bool _parse_header_line(size_t offset, size_t length);
+    bool _finish_headers();
+    static int _lookup_known_header(const char* name, size_t length);
 
-    void _parse_request_line(const std::string& line);
-    void _parse_header_line(const std::string& line);
+    HttpRequest(const HttpRequest&);
+    HttpRequest& operator=(const HttpRequest&);
 };
 
 #endif
@@ -3,6 +3,18 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <ctime>
+#include <sys/types.h>
+#include "CachedFile.hpp"
+#include "SharedBuffer.hpp"
+
+// A region of the body file, preceded by in-memory bytes such as a multipart boundary
+struct BodyFileRange {
+    std::string preamble;
+    off_t offset;
+    size_t length;
+};
 
 class HttpResponse {
 public:
@@ -11,14 +23,53 @@ public:
 
     void setStatusCode(int code);
     void setHeader(const std::string& name, const std::string& value);
+    const std::string& getHeader(const std::string& name) const;
+    int getStatusCode() const;
     void setBody(const std::string& body);
+    void releaseBody(std::string& body);
+    size_t getBodyLength() const;
+
+    // Takes over one reference to file until releaseBodyFile() hands it on
+    void setBodyFile(CachedFile* file, off_t offset, size_t length);
+    void addBodyFileRange(const std::string& preamble, off_t offset, size_t length);
+    void setBodyEpilogue(const std::string& epilogue);
+    bool hasBodyFile() const;
+    CachedFile* releaseBodyFile();
+    const std::vector<BodyFileRange>& getBodyFileRanges() const;
+    const std::string& getBodyEpilogue() const;
+
+    // Complete wire bytes prepared elsewhere, e.g. by ResponseCache, rendered without a
+    // Date line; one reference is taken over
+    void setRendered(SharedBuffer* rendered);
+    bool hasRendered() const;
+    SharedBuffer* releaseRendered();
 
-    std::string toString() const;
+    // The body is streamed by the caller and ends when the connection is closed
+    void setCloseDelimited(bool close_delimited);
+
+    void appendHeaders(std::string& out, bool with_date) const;
+    std::string headersToString() const;
+
+    static std::string formatHttpDate(time_t t);
+    static std::string getReasonPhrase(int code);
+    static SharedBuffer* getDateLine();
 
 private:
     int _status_code;
     std::map<std::string, std::string> _headers;
     std::string _body;
+    CachedFile* _body_file;
+    std::vector<BodyFileRange> _body_ranges;
+    std::string _body_epilogue;
+    size_t _body_length;      // total of all ranges, preambles and the epilogue
+    SharedBuffer* _rendered;
+    bool _close_delimited;
+
+    void _close_body_file();
+    void _drop_rendered();
+
+    HttpResponse(const HttpResponse&);
+    HttpResponse& operator=(const HttpResponse&);
 };
 
 #endif
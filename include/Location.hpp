@@ -7,6 +7,13 @@
 
 class Location {
 public:
+    // Built-in pages that answer a location's requests instead of its files
+    enum StatusPage {
+        STATUS_OFF,
+        STATUS_STUB,      // stub_status: nginx's plain-text connection summary
+        STATUS_METRICS    // metrics: Prometheus text format
+    };
+
     Location();
     ~Location();
 
@@ -28,6 +35,34 @@ public:
     void setCgiPath(const std::string& extension, const std::string& path);
     const std::string* getCgiPath(const std::string& extension) const;
 
+    void setCgiTimeout(int seconds);
+    int getCgiTimeout() const; // seconds a script may go without I/O, 0 for no limit
+
+    void setFastCgiPass(const std::string& address, size_t max_connections, size_t multiplex);
+    const std::string& getFastCgiPass() const; // empty unless requests go to a FastCGI application
+    size_t getFastCgiMaxConnections() const;
+    size_t getFastCgiMultiplex() const;
+
+    void setStatusPage(StatusPage page);
+    StatusPage getStatusPage() const;
+
+    void setExpires(int seconds);
+    int getExpires() const; // -1 when no Expires/max-age is added
+
+    void setCacheControl(const std::string& value);
+    const std::string& getCacheControl() const;
+
+    void setGzip(bool gzip);
+    bool getGzip() const; // compress suitable responses on the fly
+    void setGzipStatic(bool gzip_static);
+    bool getGzipStatic() const; // serve a precompressed "<file>.gz" sibling when one exists
+    void setGzipMinLength(size_t length);
+    size_t getGzipMinLength() const;
+    void setGzipCompLevel(int level);
+    int getGzipCompLevel() const;
+    void setGzipTypes(const std::vector<std::string>& types);
+    bool isGzipType(const std::string& content_type) const;
+
 private:
     std::string _path;
     std::vector<std::string> _allowed_methods;
@@ -35,6 +70,18 @@ private:
     bool _autoindex;
     std::string _index;
     std::map<std::string, std::string> _cgi_paths;
+    int _cgi_timeout;
+    std::string _fastcgi_pass;
+    size_t _fastcgi_max_connections;
+    size_t _fastcgi_multiplex;
+    StatusPage _status_page;
+    int _expires;
+    std::string _cache_control;
+    bool _gzip;
+    bool _gzip_static;
+    size_t _gzip_min_length;
+    int _gzip_comp_level;
+    std::vector<std::string> _gzip_types;
 };
 
 #endif
@@ -0,0 +1,35 @@
+#ifndef LOCATIONTRIE_HPP
+#define LOCATIONTRIE_HPP
+
+#include <string>
+#include <vector>
+
+// Longest-prefix index of location paths, kept as a radix tree: each edge is
+// labelled with a run of bytes and the children of a node start with distinct
+// bytes. A lookup walks the URI once, so it costs O(path length) however many
+// locations a server has. Nodes refer to each other and to their values by
+// index, which keeps the trie copyable along with the ServerConfig that owns it.
+class LocationTrie {
+public:
+    LocationTrie();
+    ~LocationTrie();
+
+    // A path inserted twice keeps its first value
+    void insert(const std::string& path, size_t value);
+    bool findLongestPrefix(const std::string& uri, size_t& value) const;
+
+private:
+    static const size_t NONE = static_cast<size_t>(-1);
+
+    struct Node {
+        std::string label;             // bytes on the edge leading to this node
+        size_t value;                  // NONE unless an inserted path ends here
+        std::vector<size_t> children;  // indexes into _nodes
+    };
+
+    std::vector<Node> _nodes; // _nodes[0] is the root, reached by the empty path
+
+    size_t _find_child(size_t node, char first) const;
+};
+
+#endif
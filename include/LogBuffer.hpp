@@ -0,0 +1,39 @@
+#ifndef LOGBUFFER_HPP
+#define LOGBUFFER_HPP
+
+#include <string>
+#include <vector>
+
+// Fixed-size ring of log output waiting to be written to one descriptor. Lines
+// are copied in as they are produced and written out in batches by flush(),
+// which the event loop calls once per iteration, so a log line costs a memcpy
+// rather than a write() of its own. The ring has a single producer and a single
+// consumer, both the event loop, so it needs no locking. When it is full it is
+// flushed on the spot; a line that still does not fit is dropped and counted.
+class LogBuffer {
+public:
+    LogBuffer(int fd, bool owns_fd, size_t capacity);
+    ~LogBuffer();
+
+    // Opens a file for appending, or standard error for "stderr"; throws on failure
+    static LogBuffer* open(const std::string& path, size_t capacity);
+
+    void append(const char* data, size_t length);
+    void append(const std::string& line);
+    bool flush();
+    bool hasPending() const;
+    size_t getDropped() const;
+
+private:
+    int _fd;
+    bool _owns_fd;
+    std::vector<char> _ring;
+    size_t _head;      // first byte not yet written
+    size_t _size;      // bytes waiting from _head on, wrapping around
+    size_t _dropped;   // lines given up on
+
+    LogBuffer(const LogBuffer&);
+    LogBuffer& operator=(const LogBuffer&);
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <string>
+#include <sstream>
+
+class LogBuffer;
+
+// The process-wide error log (error_log). Each message carries a severity and
+// is kept only at or above the configured level; the LOG macro checks the level
+// before formatting anything, so disabled debug messages cost a comparison.
+// Output goes through a LogBuffer. Outside the event loop every message is
+// written at once; the event loop turns on batching and flushes once per
+// iteration instead.
+class Logger {
+public:
+    enum Level {
+        LEVEL_DEBUG,
+        LEVEL_INFO,
+        LEVEL_NOTICE,
+        LEVEL_WARN,
+        LEVEL_ERROR,
+        LEVEL_CRIT
+    };
+
+    // path is a file name or "stderr"; throws if the file cannot be opened
+    static void configure(const std::string& path, Level level);
+    static bool isEnabled(Level level);
+    static void write(Level level, const std::string& message);
+    static void setBatching(bool batching);
+    static void flush();
+    static bool parseLevel(const std::string& name, Level& level);
+
+private:
+    static LogBuffer* _buffer;
+    static Level _level;
+    static bool _batching;
+};
+
+#define LOG(level, message)                                  \
+    do {                                                     \
+        if (Logger::isEnabled(level)) {                      \
+            std::ostringstream log_message_;                 \
+            log_message_ << message;                         \
+            Logger::write(level, log_message_.str());        \
+        }                                                    \
+    } while (0)
+
+#endif
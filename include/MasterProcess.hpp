@@ -0,0 +1,33 @@
+#ifndef MASTERPROCESS_HPP
+#define MASTERPROCESS_HPP
+
+#include <string>
+#include <map>
+#include <ctime>
+#include <sys/types.h>
+
+// Supervises worker processes. Each worker builds its own WebServer, binding
+// its own SO_REUSEPORT listeners so the kernel spreads incoming connections
+// across them. Crashed workers are restarted; SIGINT/SIGTERM received by the
+// master are forwarded so workers can finish in-flight requests, and SIGHUP is
+// forwarded once the configuration file has been checked, so each worker reloads it.
+class MasterProcess {
+public:
+    MasterProcess(const std::string& config_file, int worker_count);
+    ~MasterProcess();
+
+    int run();
+
+private:
+    std::string _config_file;
+    int _worker_count;
+    std::map<pid_t, time_t> _workers; // pid -> start time
+
+    bool _spawn_worker();
+    void _signal_workers(int signum);
+    void _reload_workers();
+    void _wait_for_workers();
+    int _run_worker();
+};
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <map>
+#include <ostream>
+
+class ServerConfig;
+class Location;
+
+// Latency distribution in microseconds, bucketed log-linearly like an HDR
+// histogram: values below 4 get a bucket each, above that every power of two is
+// split into two buckets, so a bucket is at most 50% wide whatever the scale.
+// Recording is an index computation and an increment. Values of 2^26 us (about
+// 67 seconds) and more are only counted in the total.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(unsigned long micros);
+    unsigned long getCount() const;
+
+    // Writes the histogram in the Prometheus text format, in seconds
+    void write(std::ostream& out, const std::string& name, const std::string& labels) const;
+
+private:
+    static const int SUB_BUCKET_BITS = 1;
+    static const int BUCKET_COUNT = 52;
+
+    unsigned long _buckets[BUCKET_COUNT];
+    unsigned long _count;
+    unsigned long _sum;
+
+    static int _bucket_index(unsigned long micros);
+    static unsigned long _bucket_start(int index);
+};
+
+// Request phases timed per location: reading the request head, the handler from
+// the complete request to the queued response, and the whole request
+struct LocationMetrics {
+    std::string labels;
+    LatencyHistogram parse;
+    LatencyHistogram handler;
+    LatencyHistogram total;
+};
+
+// Values the server owns and reads out when the metrics are rendered
+struct MetricsSnapshot {
+    size_t active_connections;
+    size_t reading_connections;
+    size_t writing_connections;
+    size_t waiting_connections;
+    unsigned long open_bytes_received;   // by connections that are still open
+    unsigned long open_bytes_sent;
+    size_t cgi_processes;
+    size_t file_cache_hits;
+    size_t file_cache_misses;
+    size_t response_cache_hits;
+    size_t response_cache_misses;
+};
+
+// Counters and latency histograms of one worker process. The event loop is the
+// only writer, so they are plain integers updated without locks or atomics.
+// Each worker reports its own numbers; with worker_processes above 1 a scrape
+// sees the worker that accepted it.
+class Metrics {
+public:
+    enum Backend {
+        BACKEND_CGI,
+        BACKEND_FASTCGI,
+        BACKEND_COUNT
+    };
+
+    Metrics();
+    ~Metrics();
+
+    void connectionAccepted();
+    void connectionRefused();   // turned away with 503 right after accept()
+    void connectionClosed(unsigned long bytes_received, unsigned long bytes_sent);
+    void requestCompleted(const std::string& method, int status);
+    void backendStarted(Backend backend);
+    void backendFailed(Backend backend);
+    void retireResponseCache(size_t hits, size_t misses);
+
+    // The histograms of a location, created on first use and kept across reloads
+    LocationMetrics* getLocation(const ServerConfig& server, const Location& location);
+    // Drops cached Location pointers once a configuration generation is freed
+    void forgetLocations();
+
+    void writeStubStatus(std::ostream& out, const MetricsSnapshot& snapshot) const;
+    void writePrometheus(std::ostream& out, const MetricsSnapshot& snapshot) const;
+
+private:
+    enum Method {
+        METHOD_GET,
+        METHOD_POST,
+        METHOD_DELETE,
+        METHOD_OTHER,
+        METHOD_COUNT
+    };
+
+    static const int STATUS_CLASS_COUNT = 5;   // 1xx to 5xx
+
+    unsigned long _accepted;
+    unsigned long _handled;
+    unsigned long _closed;
+    unsigned long _requests;
+    unsigned long _requests_by[METHOD_COUNT][STATUS_CLASS_COUNT];
+    unsigned long _bytes_received;   // by closed connections
+    unsigned long _bytes_sent;
+    unsigned long _backend_started[BACKEND_COUNT];
+    unsigned long _backend_failed[BACKEND_COUNT];
+    size_t _retired_cache_hits;      // of response caches replaced by a reload
+    size_t _retired_cache_misses;
+    std::map<std::string, LocationMetrics*> _locations;            // by label set
+    std::map<const Location*, LocationMetrics*> _location_index;   // of the loaded configurations
+
+    static std::string _escape_label(const std::string& value);
+
+    Metrics(const Metrics&);
+    Metrics& operator=(const Metrics&);
+};
+
+#endif
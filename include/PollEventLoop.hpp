@@ -0,0 +1,35 @@
+#ifndef POLLEVENTLOOP_HPP
+#define POLLEVENTLOOP_HPP
+
+#include <vector>
+#include <poll.h>
+#include "EventLoop.hpp"
+
+// Portable level-triggered backend built on poll(). The pollfd array is kept
+// dense: removal swaps the last entry into the freed slot. A table indexed by
+// descriptor locates an entry's slot, so add, modify and remove are O(1).
+class PollEventLoop : public EventLoop {
+public:
+    PollEventLoop();
+    ~PollEventLoop();
+
+    void add(int fd, int events, EventTarget* target);
+    void modify(int fd, int events, EventTarget* target);
+    void remove(int fd);
+    int wait(std::vector<Event>& ready, int timeout_ms);
+    bool isEdgeTriggered() const;
+    const char* getName() const;
+
+private:
+    std::vector<pollfd> _fds;
+    std::vector<EventTarget*> _targets; // parallel to _fds
+    std::vector<size_t> _index;         // fd -> slot in _fds, NO_SLOT if not watched
+
+    static const size_t NO_SLOT = static_cast<size_t>(-1);
+
+    size_t _find_slot(int fd) const;
+
+    static short _to_poll_events(int events);
+};
+
+#endif
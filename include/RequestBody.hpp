@@ -0,0 +1,35 @@
+#ifndef REQUESTBODY_HPP
+#define REQUESTBODY_HPP
+
+#include <string>
+
+// Destination for the body of the request being read. By default it is kept in
+// memory; uploads instead stream it into a temporary file in the directory they
+// are written to, which is renamed over the destination once the body is
+// complete so that readers never see a partial file. A temporary file that was
+// not committed is removed on reset() or destruction.
+class RequestBody {
+public:
+    RequestBody();
+    ~RequestBody();
+
+    bool openTempFile(const std::string& directory);
+    bool append(const char* data, size_t length);
+    bool commit(const std::string& path);
+    void reset();
+
+    bool isFile() const;
+    size_t size() const;
+    const std::string& getData() const; // empty when the body went to a file
+
+private:
+    int _fd;
+    std::string _temp_path;
+    std::string _data;
+    size_t _size;
+
+    RequestBody(const RequestBody&);
+    RequestBody& operator=(const RequestBody&);
+};
+
+#endif
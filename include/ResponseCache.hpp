@@ -0,0 +1,54 @@
+#ifndef RESPONSECACHE_HPP
+#define RESPONSECACHE_HPP
+
+#include <string>
+#include <map>
+#include <list>
+#include "SharedBuffer.hpp"
+#include "CachedFile.hpp"
+
+// Size-bounded LRU cache of fully rendered responses (status line, headers and
+// body) for small static files. A hit is queued as-is and sent straight from the
+// shared buffer. Each entry remembers the inode, size and mtime of the file it
+// was rendered from and is dropped as soon as the file no longer matches, or
+// once its time-dependent headers would be out of date.
+class ResponseCache {
+public:
+    ResponseCache(size_t max_bytes, size_t max_file_size);
+    ~ResponseCache();
+
+    bool isEnabled() const;
+    bool accepts(off_t body_size) const;
+
+    SharedBuffer* get(const std::string& key, const CachedFile* file);
+    SharedBuffer* put(const std::string& key, const CachedFile* file, const std::string& rendered, time_t valid_until);
+
+    size_t getHits() const;
+    size_t getMisses() const;
+    size_t getBytes() const;
+
+private:
+    struct Entry {
+        SharedBuffer* buffer;
+        ino_t inode;
+        off_t size;
+        time_t mtime;
+        time_t valid_until; // 0 if the rendering does not depend on the current time
+        std::list<const std::string*>::iterator lru_pos;
+    };
+
+    size_t _max_bytes;
+    size_t _max_file_size;
+    size_t _bytes;
+    std::map<std::string, Entry> _entries;
+    std::list<const std::string*> _lru; // most recently used first
+    size_t _hits;
+    size_t _misses;
+
+    void _erase(std::map<std::string, Entry>::iterator it);
+
+    ResponseCache(const ResponseCache&);
+    ResponseCache& operator=(const ResponseCache&);
+};
+
+#endif
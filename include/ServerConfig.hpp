@@ -5,6 +5,7 @@
 #include <vector>
 #include <map>
 #include "Location.hpp"
+#include "LocationTrie.hpp"
 
 class ServerConfig {
 public:
@@ -24,15 +25,35 @@ public:
     void setClientMaxBodySize(size_t size);
     size_t getClientMaxBodySize() const;
 
+    void setKeepAliveTimeout(int seconds);
+    int getKeepAliveTimeout() const;
+
+    void setKeepAliveRequests(size_t max_requests);
+    size_t getKeepAliveRequests() const;
+
+    void setClientHeaderTimeout(int seconds);
+    int getClientHeaderTimeout() const;
+    void setClientBodyTimeout(int seconds);
+    int getClientBodyTimeout() const;
+    void setSendTimeout(int seconds);
+    int getSendTimeout() const;
+
     void addLocation(const Location& location);
     const std::vector<Location>& getLocations() const;
+    const Location* findLocation(const std::string& uri) const; // longest matching path prefix
 
 private:
     int _port;
     std::vector<std::string> _server_names;
     std::map<int, std::string> _error_pages;
     size_t _client_max_body_size;
+    int _keepalive_timeout;
+    size_t _keepalive_requests;
+    int _client_header_timeout;
+    int _client_body_timeout;
+    int _send_timeout;
     std::vector<Location> _locations;
+    LocationTrie _location_index; // location paths -> index into _locations
 };
 
 #endif
@@ -0,0 +1,27 @@
+#ifndef SHAREDBUFFER_HPP
+#define SHAREDBUFFER_HPP
+
+#include <string>
+
+// Immutable, reference counted bytes that several connections can send from at
+// once without copying, such as a pre-rendered response held by ResponseCache.
+class SharedBuffer {
+public:
+    explicit SharedBuffer(const std::string& data);
+
+    void retain();
+    void release();
+
+    const std::string& getData() const;
+    size_t size() const;
+
+private:
+    std::string _data;
+    int _refcount;
+
+    ~SharedBuffer();
+    SharedBuffer(const SharedBuffer&);
+    SharedBuffer& operator=(const SharedBuffer&);
+};
+
+#endif
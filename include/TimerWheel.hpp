@@ -0,0 +1,55 @@
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+
+#include <cstddef>
+#include <vector>
+#include "EventLoop.hpp"
+
+// A pending timeout, embedded in the object it belongs to. Expired timers are
+// reported with their EventTarget, so they are dispatched like readiness events.
+struct Timer {
+    EventTarget* target;
+    unsigned long expires;  // tick at which the timer fires
+    Timer* prev;            // neighbours in the wheel slot, NULL while not scheduled
+    Timer* next;
+};
+
+// Hierarchical timing wheel with millisecond deadlines rounded up to TICK_MS.
+// Level 0 has one slot per tick; each higher level covers SLOTS times the span
+// of the one below, and its timers are cascaded down as the wheel turns.
+// Scheduling, cancelling and expiring a timer are O(1), so thousands of
+// connections can have their deadline moved on every read or write.
+class TimerWheel {
+public:
+    static const unsigned long TICK_MS = 100;
+
+    TimerWheel();
+
+    void schedule(Timer* timer, unsigned long deadline_ms);
+    void cancel(Timer* timer);
+    void advance(unsigned long now_ms, std::vector<Timer*>& expired);
+    int getTimeout(unsigned long now_ms) const;
+    size_t size() const;
+
+    static void initTimer(Timer* timer, EventTarget* target);
+    static bool isScheduled(const Timer* timer);
+    static unsigned long now();
+    static unsigned long nowMicros(); // same clock, for measuring durations
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+
+    Timer _slots[LEVELS][SLOTS];  // list heads; each slot is a circular list
+    unsigned long _current;       // next tick to be processed
+    size_t _count;
+
+    void _insert(Timer* timer);
+    void _cascade(int level, int index);
+
+    TimerWheel(const TimerWheel&);
+    TimerWheel& operator=(const TimerWheel&);
+};
+
+#endif
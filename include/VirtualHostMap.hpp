@@ -0,0 +1,45 @@
+#ifndef VIRTUALHOSTMAP_HPP
+#define VIRTUALHOSTMAP_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include "ServerConfig.hpp"
+
+// Selects the server block for a request from its listening port and Host
+// header. Built once from the parsed configuration: exact server names and
+// wildcard names live in open-addressing hash tables keyed by port and
+// lowercase name, so a lookup costs one probe per label of the host rather
+// than a walk over every server_name. Host matching ignores case, a port
+// suffix and a trailing dot. A host that matches no name gets the first server
+// block listening on the port.
+//
+// Supported names: "example.com", "*.example.com" (any host ending in
+// .example.com, the longest such suffix winning) and ".example.com" (both).
+class VirtualHostMap {
+public:
+    VirtualHostMap();
+    ~VirtualHostMap();
+
+    // The configs must stay in place for as long as the map is used
+    void build(const std::vector<ServerConfig>& configs);
+    const ServerConfig* find(int port, const std::string& host) const;
+
+private:
+    struct Entry {
+        int port;
+        std::string name;            // lowercase; wildcards keep their leading dot
+        const ServerConfig* server;  // NULL for an empty slot
+    };
+
+    std::vector<Entry> _exact;
+    std::vector<Entry> _wildcards;
+    std::map<int, const ServerConfig*> _defaults; // by port
+
+    static void _init_table(std::vector<Entry>& table, size_t count);
+    static void _insert(std::vector<Entry>& table, int port, const std::string& name, const ServerConfig* server);
+    static const ServerConfig* _lookup(const std::vector<Entry>& table, int port, const char* name, size_t length);
+    static size_t _hash(int port, const char* name, size_t length);
+};
+
+#endif
@@ -3,10 +3,20 @@
 
 #include <vector>
 #include <map>
-#include <poll.h>
 #include "ServerConfig.hpp" 
+#include "GlobalConfig.hpp"
 #include "HttpResponse.hpp" // Added this line
 #include "HttpRequest.hpp" // Added this line
+#include "Connection.hpp"
+#include "EventLoop.hpp"
+#include "FileCache.hpp"
+#include "ResponseCache.hpp"
+#include "CgiProcess.hpp"
+#include "FastCgiUpstream.hpp"
+#include "TimerWheel.hpp"
+#include "ConfigGeneration.hpp"
+#include "AccessLog.hpp"
+#include "Metrics.hpp"
 
 class WebServer {
 public:
@@ -16,22 +26,101 @@ public:
     void run();
 
 private:
-    std::vector<ServerConfig> _configs;
-    std::vector<pollfd> _fds;
+    std::string _config_file;
+    ConfigGeneration* _config;     // server blocks new requests are routed with
+    std::vector<ConfigGeneration*> _retired_configs; // replaced by a reload, still used by requests
+    GlobalConfig _global_config;
+    EventLoop* _event_loop;
+    FileCache* _file_cache;
+    ResponseCache* _response_cache;
+    AccessLog* _access_log;   // NULL when access_log is off
     std::map<int, int> _listening_sockets; // port -> fd
+    std::map<int, int> _listener_ports; // fd -> port
+    std::map<int, EventTarget> _listener_targets; // fd -> event loop registration
+    bool _shutting_down;
+    bool _accepting;          // false while listeners are paused at worker_connections
+    std::vector<int> _pending_accepts; // edge-triggered listeners left with a backlog
+    int _spare_fd;            // given up to turn away a client when fds run out
+    std::map<std::string, size_t> _connections_per_ip; // open connections by client address
+    std::vector<Connection*> _connections; // indexed by client fd, NULL for a free slot
+    size_t _connection_count;
+    std::map<pid_t, CgiProcess*> _cgi_processes; // running scripts by pid
+    std::vector<Connection*> _closed_connections; // deleted at the end of a loop iteration
+    std::vector<CgiRequest*> _finished_cgis;      // likewise
+    std::map<std::string, FastCgiUpstream*> _fastcgi_upstreams; // by fastcgi_pass address and parameters
+    int _child_pipe[2]; // written to by the SIGCHLD and shutdown signal handlers
+    EventTarget _child_target;
+    TimerWheel _timers; // one timer per client connection
+    Metrics _metrics;   // served by stub_status and metrics locations
 
     void _setup_listening_sockets();
-    void _handle_new_connection(int listener_fd);
-    void _handle_client_data(int client_fd);
-    const ServerConfig* _get_server_config(int port, const std::string& host) const;
+    static int _open_listener(int port);
+    void _add_listener(int port, int fd);
+    void _remove_listener(int port);
+    void _reload();
+    void _pin_config(Connection& conn);
+    void _unpin_config(Connection& conn);
+    bool _handle_new_connection(int listener_fd);
+    bool _shed_connection(int listener_fd);
+    static void _turn_away(int client_fd);
+    void _pause_accepting();
+    void _resume_accepting();
+    void _handle_client_event(Connection& conn, int events);
+    void _process_pending_requests(Connection& conn);
+    void _start_request_body(Connection& conn);
+    void _reject_request_body(Connection& conn, int status_code, const ServerConfig* server_config);
+    bool _process_request(Connection& conn, HttpResponse& response);
+    static void _queue_response(Connection& conn, HttpResponse& response);
+    void _record_request(Connection& conn, int status);
+    void _serve_status_page(const Location* location, HttpResponse& response) const;
+    static bool _wants_keep_alive(const HttpRequest& request);
+    void _close_idle_connections();
+    void _update_connection_timer(Connection& conn);
+    void _handle_connection_timeout(Connection& conn);
+    void _begin_shutdown();
+    void _set_client_events(Connection& conn, int events);
+    int _backend_wait_events(const Connection& conn) const;
+    void _close_connection(int client_fd);
+    const ServerConfig* _get_server_config(const Connection& conn, const std::string& host) const;
     const Location* _get_location(const ServerConfig* config, const std::string& uri) const;
-    void _serve_static_file(const std::string& file_path, HttpResponse& response) const;
+    void _serve_static_file(const HttpRequest& request, const Location* location, CachedFile* file, HttpResponse& response) const;
+    void _serve_file_representation(const HttpRequest& request, const Location* location, CachedFile* file,
+                                    const std::string& content_type, const std::string& encoding, bool vary,
+                                    HttpResponse& response) const;
+    bool _serve_compressed_file(const HttpRequest& request, const Location* location, CachedFile* file, HttpResponse& response) const;
+    static std::string _make_etag(const CachedFile* file, bool weak);
+    static bool _etag_matches(const std::string& header, const std::string& etag);
+    static bool _is_not_modified(const HttpRequest& request, const CachedFile* file, const std::string& etag);
+    static bool _if_range_matches(const HttpRequest& request, const CachedFile* file, const std::string& etag);
+    static void _serve_byte_ranges(const Location* location, CachedFile* file, const std::string& content_type, const std::string& etag, const std::vector<ByteRange>& ranges, HttpResponse& response);
+    static void _set_cache_headers(const Location* location, const CachedFile* file, const std::string& etag, HttpResponse& response);
+    void _handle_get_request(const HttpRequest& request, const ServerConfig* server_config, const Location* location, HttpResponse& response) const;
     void _generate_autoindex(const std::string& directory_path, const std::string& uri_path, HttpResponse& response) const;
-    void _handle_post_request(const HttpRequest& request, const ServerConfig* server_config, const Location* location, HttpResponse& response) const;
+    void _handle_post_request(const HttpRequest& request, RequestBody& body, const Location* location, HttpResponse& response) const;
     void _handle_delete_request(const HttpRequest& request, const Location* location, HttpResponse& response) const;
-    void _execute_cgi(const HttpRequest& request, const Location* location, HttpResponse& response) const;
+    void _execute_cgi(Connection& conn, const Location* location, bool keep_alive, HttpResponse& response);
+    static std::vector<std::string> _build_cgi_environment(const HttpRequest& request, int port, size_t content_length, const std::string& script_path, const std::string& query);
+    void _handle_cgi_event(CgiProcess& cgi, int fd);
+    void _reap_children();
+    void _finish_cgi(CgiProcess& cgi);
+    void _read_cgi_output(CgiProcess& cgi);
+    void _resume_cgi(CgiRequest& request);
+    void _relay_cgi_output(CgiRequest& cgi);
+    void _send_cgi_head(Connection& conn, CgiRequest& cgi);
+    void _complete_cgi_response(CgiRequest& cgi, int error_status);
+    void _abort_cgi(CgiRequest& request);
+    FastCgiUpstream* _get_fastcgi_upstream(const Location* location);
+    void _pass_to_fastcgi(Connection& conn, const Location* location, bool keep_alive, HttpResponse& response);
+    void _handle_fastcgi_event(FastCgiConnection& backend, int events);
+    void _finish_fastcgi(const std::vector<FastCgiRequest*>& finished);
+    void _setup_child_signal();
+    void _delete_closed();
+    static bool _is_method_allowed(const Location* location, const std::string& method);
+    static bool _is_cgi_request(const Location* location, const std::string& uri);
     void _serve_error_page(int status_code, const ServerConfig* config, HttpResponse& response) const;
-    static std::string _get_status_message_static(int code);
+
+    WebServer(const WebServer&);
+    WebServer& operator=(const WebServer&);
 };
 
 #endif
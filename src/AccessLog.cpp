@@ -0,0 +1,193 @@
+#include "AccessLog.hpp"
+#include "LogBuffer.hpp"
+#include <stdexcept>
+
+// Holds many lines between two flushes of the event loop
+static const size_t ACCESS_LOG_BUFFER_SIZE = 256 * 1024;
+
+const char* const AccessLog::DEFAULT_FORMAT =
+    "$remote_addr [$time_local] \"$request\" $status $bytes_sent $request_time_us $upstream_time_us";
+
+struct FieldName {
+    const char* name;
+    int field;
+};
+
+AccessLog::AccessLog(const std::string& path, const std::string& format)
+    : _buffer(NULL), _cached_time(0) {
+    _compile(format);
+    _buffer = LogBuffer::open(path, ACCESS_LOG_BUFFER_SIZE);
+}
+
+AccessLog::~AccessLog() {
+    delete _buffer;
+}
+
+void AccessLog::_compile(const std::string& format) {
+    /**
+     * @brief Splits the format into literal runs and variables. A variable name is
+     * the longest run of lowercase letters, digits and underscores after a '$'.
+     */
+    static const FieldName fields[] = {
+        { "remote_addr", FIELD_REMOTE_ADDR },
+        { "time_local", FIELD_TIME_LOCAL },
+        { "time_iso8601", FIELD_TIME_ISO8601 },
+        { "request", FIELD_REQUEST },
+        { "request_method", FIELD_REQUEST_METHOD },
+        { "request_uri", FIELD_REQUEST_URI },
+        { "server_protocol", FIELD_SERVER_PROTOCOL },
+        { "host", FIELD_HOST },
+        { "status", FIELD_STATUS },
+        { "bytes_sent", FIELD_BYTES_SENT },
+        { "request_time_us", FIELD_REQUEST_TIME_US },
+        { "upstream_time_us", FIELD_UPSTREAM_TIME_US }
+    };
+    Segment literal;
+    literal.field = FIELD_LITERAL;
+    size_t pos = 0;
+    while (pos < format.size()) {
+        if (format[pos] != '$') {
+            literal.text += format[pos++];
+            continue;
+        }
+        size_t end = pos + 1;
+        while (end < format.size() && ((format[end] >= 'a' && format[end] <= 'z')
+                                       || (format[end] >= '0' && format[end] <= '9') || format[end] == '_')) {
+            ++end;
+        }
+        std::string name = format.substr(pos + 1, end - pos - 1);
+        size_t i = 0;
+        while (i < sizeof(fields) / sizeof(fields[0]) && name != fields[i].name) {
+            ++i;
+        }
+        if (i == sizeof(fields) / sizeof(fields[0])) {
+            throw std::runtime_error("Unknown log_format variable: $" + name);
+        }
+        if (!literal.text.empty()) {
+            _segments.push_back(literal);
+            literal.text.clear();
+        }
+        Segment variable;
+        variable.field = static_cast<Field>(fields[i].field);
+        _segments.push_back(variable);
+        pos = end;
+    }
+    literal.text += '\n';
+    _segments.push_back(literal);
+}
+
+void AccessLog::_update_time() {
+    time_t now = time(NULL);
+    if (now == _cached_time) {
+        return;
+    }
+    struct tm tm;
+    localtime_r(&now, &tm);
+    char buffer[64];
+    strftime(buffer, sizeof(buffer), "%d/%b/%Y:%H:%M:%S %z", &tm);
+    _time_local = buffer;
+    strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S%z", &tm);
+    _time_iso8601 = buffer;
+    if (_time_iso8601.size() >= 5) {
+        _time_iso8601.insert(_time_iso8601.size() - 2, 1, ':');   // +0100 -> +01:00
+    }
+    _cached_time = now;
+}
+
+void AccessLog::_append_number(std::string& out, unsigned long value) {
+    char digits[24];
+    size_t length = 0;
+    do {
+        digits[length++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value);
+    while (length) {
+        out += digits[--length];
+    }
+}
+
+void AccessLog::_append_escaped(std::string& out, const std::string& value) {
+    static const char hex[] = "0123456789ABCDEF";
+    if (value.empty()) {
+        out += '-';
+        return;
+    }
+    for (size_t i = 0; i < value.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(value[i]);
+        if (c < 0x20 || c >= 0x7f || c == '"' || c == '\\') {
+            out += "\\x";
+            out += hex[c >> 4];
+            out += hex[c & 0xf];
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+}
+
+void AccessLog::log(const AccessLogEntry& entry) {
+    const HttpRequest& request = *entry.request;
+    _line.clear();
+    for (size_t i = 0; i < _segments.size(); ++i) {
+        const Segment& segment = _segments[i];
+        switch (segment.field) {
+        case FIELD_LITERAL:
+            _line += segment.text;
+            break;
+        case FIELD_REMOTE_ADDR:
+            _append_escaped(_line, *entry.remote_addr);
+            break;
+        case FIELD_TIME_LOCAL:
+            _update_time();
+            _line += _time_local;
+            break;
+        case FIELD_TIME_ISO8601:
+            _update_time();
+            _line += _time_iso8601;
+            break;
+        case FIELD_REQUEST:
+            if (request.getMethod().empty()) {
+                _line += '-';
+                break;
+            }
+            _append_escaped(_line, request.getMethod());
+            _line += ' ';
+            _append_escaped(_line, request.getUri());
+            _line += ' ';
+            _append_escaped(_line, request.getHttpVersion());
+            break;
+        case FIELD_REQUEST_METHOD:
+            _append_escaped(_line, request.getMethod());
+            break;
+        case FIELD_REQUEST_URI:
+            _append_escaped(_line, request.getUri());
+            break;
+        case FIELD_SERVER_PROTOCOL:
+            _append_escaped(_line, request.getHttpVersion());
+            break;
+        case FIELD_HOST:
+            _append_escaped(_line, request.getHeader(HttpRequest::HEADER_HOST));
+            break;
+        case FIELD_STATUS:
+            _append_number(_line, entry.status);
+            break;
+        case FIELD_BYTES_SENT:
+            _append_number(_line, entry.bytes_sent);
+            break;
+        case FIELD_REQUEST_TIME_US:
+            _append_number(_line, entry.request_time_us);
+            break;
+        case FIELD_UPSTREAM_TIME_US:
+            if (entry.upstream_time_us < 0) {
+                _line += '-';
+            } else {
+                _append_number(_line, entry.upstream_time_us);
+            }
+            break;
+        }
+    }
+    _buffer->append(_line);
+}
+
+void AccessLog::flush() {
+    _buffer->flush();
+}
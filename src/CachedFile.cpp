@@ -0,0 +1,79 @@
+#include "CachedFile.hpp"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+CachedFile::CachedFile(const std::string& path)
+    : _path(path), _fd(-1), _refcount(1), _error(0), _is_directory(false), _size(0), _mtime(0), _inode(0) {}
+
+CachedFile::~CachedFile() {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+CachedFile* CachedFile::open(const std::string& path) {
+    /**
+     * @brief Opens a path and records its metadata.
+     * Regular files keep their descriptor open; directories only keep their stat data.
+     * A missing or unreadable path still yields an object, with exists() returning false.
+     * @param path The filesystem path.
+     * @return A new CachedFile holding one reference for the caller.
+     */
+    CachedFile* file = new CachedFile(path);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    struct stat s;
+    if (fd < 0 || fstat(fd, &s) != 0) {
+        file->_error = errno ? errno : ENOENT;
+        if (fd >= 0) close(fd);
+        return file;
+    }
+    file->_size = s.st_size;
+    file->_mtime = s.st_mtime;
+    file->_inode = s.st_ino;
+    if (S_ISREG(s.st_mode)) {
+        file->_fd = fd;
+        file->_content_type = detectContentType(path);
+    } else {
+        close(fd);
+        file->_is_directory = S_ISDIR(s.st_mode);
+    }
+    return file;
+}
+
+void CachedFile::retain() { _refcount++; }
+
+void CachedFile::release() {
+    if (--_refcount == 0) {
+        delete this;
+    }
+}
+
+const std::string& CachedFile::getPath() const { return _path; }
+int CachedFile::getFd() const { return _fd; }
+bool CachedFile::exists() const { return _error == 0; }
+bool CachedFile::isDirectory() const { return _is_directory; }
+bool CachedFile::isRegularFile() const { return _fd >= 0; }
+off_t CachedFile::getSize() const { return _size; }
+time_t CachedFile::getMtime() const { return _mtime; }
+ino_t CachedFile::getInode() const { return _inode; }
+const std::string& CachedFile::getContentType() const { return _content_type; }
+
+bool CachedFile::matches(const struct stat& s) const {
+    return exists() && s.st_ino == _inode && s.st_size == _size && s.st_mtime == _mtime;
+}
+
+std::string CachedFile::detectContentType(const std::string& path) {
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos || path.find('/', dot) != std::string::npos) {
+        return "application/octet-stream";
+    }
+    std::string ext = path.substr(dot);
+    if (ext == ".html" || ext == ".htm") return "text/html";
+    if (ext == ".css") return "text/css";
+    if (ext == ".js") return "application/javascript";
+    if (ext == ".jpg" || ext == ".jpeg") return "image/jpeg";
+    if (ext == ".png") return "image/png";
+    return "application/octet-stream";
+}
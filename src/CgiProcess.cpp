@@ -0,0 +1,173 @@
+#include "CgiProcess.hpp"
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdio> // For perror
+#include <cstdlib> // For _exit
+
+static bool makePipe(int fds[2]) {
+    // Both ends are close-on-exec so that other CGI children do not inherit them
+    if (pipe(fds) < 0) {
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+CgiProcess::CgiProcess(Connection* connection, bool keep_alive, int timeout)
+    : CgiRequest(PROCESS, connection, keep_alive, timeout), _pid(-1), _stdin_fd(-1), _stdout_fd(-1),
+      _input_offset(0), _exited(false), _exit_status(0) {
+    _stdin_target.type = EventTarget::CGI;
+    _stdin_target.fd = -1;
+    _stdin_target.owner = this;
+    _stdout_target.type = EventTarget::CGI;
+    _stdout_target.fd = -1;
+    _stdout_target.owner = this;
+}
+
+CgiProcess::~CgiProcess() {
+    closeStdin();
+    closeStdout();
+}
+
+bool CgiProcess::start(const std::string& interpreter, const std::string& script,
+                       const std::vector<std::string>& environment, const std::string& input) {
+    /**
+     * @brief Forks and executes the interpreter with the script as its argument.
+     * The parent's ends of both pipes are made non-blocking; the caller registers
+     * them with the event loop.
+     * @param interpreter Path of the CGI program, from cgi_path.
+     * @param script Full path of the requested script.
+     * @param environment CGI meta-variables as NAME=value strings.
+     * @param input The request body, fed to the script's stdin.
+     * @return false if the pipes could not be created or fork() failed.
+     */
+    int pipe_in[2];
+    int pipe_out[2];
+    if (!makePipe(pipe_in)) {
+        return false;
+    }
+    if (!makePipe(pipe_out)) {
+        close(pipe_in[0]);
+        close(pipe_in[1]);
+        return false;
+    }
+
+    // Everything the child needs is prepared before fork()
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(interpreter.c_str()));
+    argv.push_back(const_cast<char*>(script.c_str()));
+    argv.push_back(NULL);
+    std::vector<char*> envp;
+    for (size_t i = 0; i < environment.size(); ++i) {
+        envp.push_back(const_cast<char*>(environment[i].c_str()));
+    }
+    envp.push_back(NULL);
+
+    _pid = fork();
+    if (_pid < 0) {
+        close(pipe_in[0]);
+        close(pipe_in[1]);
+        close(pipe_out[0]);
+        close(pipe_out[1]);
+        return false;
+    }
+    if (_pid == 0) {
+        dup2(pipe_in[0], STDIN_FILENO);
+        dup2(pipe_out[1], STDOUT_FILENO);
+        // The server ignores SIGPIPE; scripts expect the default behaviour
+        signal(SIGPIPE, SIG_DFL);
+        execve(interpreter.c_str(), &argv[0], &envp[0]);
+        perror("execve failed");
+        _exit(1);
+    }
+
+    close(pipe_in[0]);
+    close(pipe_out[1]);
+    _stdin_fd = pipe_in[1];
+    _stdout_fd = pipe_out[0];
+    fcntl(_stdin_fd, F_SETFL, O_NONBLOCK);
+    fcntl(_stdout_fd, F_SETFL, O_NONBLOCK);
+    _stdin_target.fd = _stdin_fd;
+    _stdout_target.fd = _stdout_fd;
+    _input = input;
+    _touch();
+    return true;
+}
+
+void CgiProcess::kill() {
+    if (_pid > 0 && !_exited) {
+        ::kill(_pid, SIGKILL);
+    }
+}
+
+CgiProcess::IoStatus CgiProcess::writeInput() {
+    /**
+     * @brief Feeds as much of the request body to the script as its stdin accepts.
+     * @return IO_DONE once everything was written or the script stopped reading.
+     */
+    while (_input_offset < _input.length()) {
+        ssize_t written = write(_stdin_fd, _input.data() + _input_offset, _input.length() - _input_offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? IO_AGAIN : IO_DONE;
+        }
+        _input_offset += written;
+        _touch();
+    }
+    return IO_DONE;
+}
+
+CgiProcess::IoStatus CgiProcess::readOutput() {
+    /**
+     * @brief Performs one read() from the script's stdout and keeps the bytes.
+     * @return IO_OK if data was read, IO_AGAIN if none was available, IO_DONE at
+     * end-of-file or on error.
+     */
+    char buffer[16384];
+    ssize_t bytes_read = read(_stdout_fd, buffer, sizeof(buffer));
+    if (bytes_read > 0) {
+        _output.append(buffer, bytes_read);
+        _touch();
+        return IO_OK;
+    }
+    if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return IO_AGAIN;
+    }
+    return IO_DONE;
+}
+
+void CgiProcess::closeStdin() {
+    if (_stdin_fd >= 0) {
+        close(_stdin_fd);
+        _stdin_fd = -1;
+        _stdin_target.fd = -1;
+    }
+    std::string().swap(_input);
+}
+
+void CgiProcess::closeStdout() {
+    if (_stdout_fd >= 0) {
+        close(_stdout_fd);
+        _stdout_fd = -1;
+        _stdout_target.fd = -1;
+    }
+}
+
+void CgiProcess::setExitStatus(int status) {
+    _exited = true;
+    _exit_status = status;
+}
+
+pid_t CgiProcess::getPid() const { return _pid; }
+int CgiProcess::getStdinFd() const { return _stdin_fd; }
+int CgiProcess::getStdoutFd() const { return _stdout_fd; }
+EventTarget* CgiProcess::getStdinTarget() { return &_stdin_target; }
+EventTarget* CgiProcess::getStdoutTarget() { return &_stdout_target; }
+bool CgiProcess::hasExited() const { return _exited; }
+int CgiProcess::getExitStatus() const { return _exit_status; }
+bool CgiProcess::isFinished() const { return _exited && _stdout_fd < 0; }
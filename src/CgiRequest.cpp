@@ -0,0 +1,153 @@
+#include "CgiRequest.hpp"
+#include "Connection.hpp"
+#include "TimerWheel.hpp"
+#include <cstdlib> // For atoi
+#include <cctype> // For tolower
+#include <sstream>
+
+// Longest CGI header block accepted, like the limit on request heads
+static const size_t MAX_CGI_HEADER_SIZE = 32768;
+// Output is paused while the client has this much queued
+static const size_t MAX_BUFFERED_OUTPUT = 256 * 1024;
+
+CgiRequest::CgiRequest(Type type, Connection* connection, bool keep_alive, int timeout)
+    : _type(type), _connection(connection), _keep_alive(keep_alive), _timeout(timeout), _last_activity(TimerWheel::now()),
+      _paused(false), _header_status(HEADERS_INCOMPLETE), _header_scan(0), _status_code(0), _has_location(false),
+      _body_started(false), _framing(FRAMING_CHUNKED), _body_remaining(0) {}
+
+CgiRequest::~CgiRequest() {}
+
+CgiRequest::Type CgiRequest::getType() const { return _type; }
+Connection* CgiRequest::getConnection() const { return _connection; }
+void CgiRequest::detach() { _connection = NULL; }
+bool CgiRequest::getKeepAlive() const { return _keep_alive; }
+void CgiRequest::setKeepAlive(bool keep_alive) { _keep_alive = keep_alive; }
+const std::string& CgiRequest::getOutput() const { return _output; }
+
+unsigned long CgiRequest::getDeadline() const {
+    // The backend must make progress at least every _timeout seconds; a pause
+    // waiting on a slow client does not count against it
+    return _timeout > 0 && !_paused ? _last_activity + _timeout * 1000UL : 0;
+}
+
+void CgiRequest::_touch() {
+    _last_activity = TimerWheel::now();
+}
+
+bool CgiRequest::isThrottled() const {
+    return _connection && _connection->getPendingOutputSize() + _output.length() >= MAX_BUFFERED_OUTPUT;
+}
+
+void CgiRequest::setPaused(bool paused) {
+    _paused = paused;
+    _touch();
+}
+
+bool CgiRequest::isPaused() const { return _paused; }
+
+CgiRequest::HeaderStatus CgiRequest::_invalid_headers() {
+    _header_status = HEADERS_INVALID;
+    std::string().swap(_output);
+    return _header_status;
+}
+
+CgiRequest::HeaderStatus CgiRequest::parseHeaders() {
+    /**
+     * @brief Parses as much of the CGI header block as has arrived.
+     * Lines may end in CRLF or a bare LF. The Status header sets the response status;
+     * a Location without one makes it a 302 redirect. Once the blank line is found
+     * the header block is removed from the output, leaving only body bytes.
+     */
+    while (_header_status == HEADERS_INCOMPLETE) {
+        size_t eol = _output.find('\n', _header_scan);
+        if (eol == std::string::npos) {
+            return _output.length() > MAX_CGI_HEADER_SIZE ? _invalid_headers() : HEADERS_INCOMPLETE;
+        }
+        if (eol >= MAX_CGI_HEADER_SIZE) {
+            return _invalid_headers();
+        }
+        size_t end = eol;
+        if (end > _header_scan && _output[end - 1] == '\r') {
+            --end;
+        }
+        if (end == _header_scan) {
+            _output.erase(0, eol + 1);
+            _header_scan = 0;
+            if (_status_code == 0) {
+                _status_code = _has_location ? 302 : 200;
+            }
+            _header_status = HEADERS_COMPLETE;
+            break;
+        }
+        std::string line = _output.substr(_header_scan, end - _header_scan);
+        _header_scan = eol + 1;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos || colon == 0) {
+            return _invalid_headers();
+        }
+        std::string name = line.substr(0, colon);
+        size_t first = line.find_first_not_of(" \t", colon + 1);
+        size_t last = line.find_last_not_of(" \t");
+        std::string value = first == std::string::npos ? "" : line.substr(first, last - first + 1);
+        std::string lower = name;
+        for (size_t i = 0; i < lower.length(); ++i) {
+            lower[i] = static_cast<char>(tolower(static_cast<unsigned char>(lower[i])));
+        }
+        if (lower == "status") {
+            _status_code = std::atoi(value.c_str());
+            if (_status_code < 100 || _status_code > 599) {
+                return _invalid_headers();
+            }
+            continue;
+        }
+        if (lower == "location") {
+            _has_location = true;
+        }
+        _headers.push_back(std::make_pair(name, value));
+    }
+    return _header_status;
+}
+
+int CgiRequest::getStatusCode() const { return _status_code; }
+const std::vector<std::pair<std::string, std::string> >& CgiRequest::getHeaders() const { return _headers; }
+
+void CgiRequest::startBody(Framing framing, size_t content_length) {
+    _body_started = true;
+    _framing = framing;
+    _body_remaining = content_length;
+}
+
+bool CgiRequest::hasStartedBody() const { return _body_started; }
+CgiRequest::Framing CgiRequest::getFraming() const { return _framing; }
+
+bool CgiRequest::takeBody(std::string& wire) {
+    /**
+     * @brief Moves the body bytes received so far into wire, framed for the client.
+     * @return false if there was nothing to send.
+     */
+    if (_output.empty()) {
+        return false;
+    }
+    if (_framing == FRAMING_LENGTH) {
+        if (_output.length() > _body_remaining) {
+            _output.resize(_body_remaining);
+        }
+        _body_remaining -= _output.length();
+    } else if (_framing == FRAMING_CHUNKED) {
+        std::ostringstream size_line;
+        size_line << std::hex << _output.length() << "\r\n";
+        _output.insert(0, size_line.str());
+        _output += "\r\n";
+    }
+    wire.swap(_output);
+    _output.clear();
+    return !wire.empty();
+}
+
+void CgiRequest::discardOutput() {
+    _output.clear();
+}
+
+bool CgiRequest::isBodyComplete() const {
+    return _framing != FRAMING_LENGTH || _body_remaining == 0;
+}
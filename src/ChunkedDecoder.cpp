@@ -0,0 +1,178 @@
+#include "ChunkedDecoder.hpp"
+
+// Longest chunk-size line (size plus extensions) and total trailer section accepted
+static const size_t MAX_CHUNK_LINE = 4096;
+static const size_t MAX_TRAILER_SIZE = 8192;
+// Fifteen hex digits keep the size well inside size_t
+static const size_t MAX_SIZE_DIGITS = 15;
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+ChunkedDecoder::ChunkedDecoder() {
+    reset(0);
+}
+
+void ChunkedDecoder::reset(size_t limit) {
+    _state = STATE_SIZE;
+    _chunk_size = 0;
+    _size_digits = 0;
+    _remaining = 0;
+    _line_length = 0;
+    _trailer_bytes = 0;
+    _decoded = 0;
+    _limit = limit;
+    _error_status = 0;
+}
+
+int ChunkedDecoder::getErrorStatus() const { return _error_status; }
+size_t ChunkedDecoder::getDecodedSize() const { return _decoded; }
+
+ChunkedDecoder::Status ChunkedDecoder::_fail(int status) {
+    _state = STATE_ERROR;
+    _error_status = status;
+    return DECODE_ERROR;
+}
+
+ChunkedDecoder::Status ChunkedDecoder::decode(const char* data, size_t length, size_t& consumed, RequestBody& body) {
+    /**
+     * @brief Consumes the next piece of the encoded body.
+     * Chunk extensions are skipped and trailer fields discarded. Line breaks may be
+     * CRLF or a bare LF. The decoded size is checked against the limit as soon as a
+     * chunk header announces it, before any of that chunk's data is accepted.
+     * @param data Encoded bytes.
+     * @param length Number of encoded bytes available.
+     * @param consumed Set to how many bytes were used; after DECODE_DONE the rest
+     * belongs to the next request.
+     * @param body Receives the decoded data.
+     */
+    size_t pos = 0;
+    while (pos < length && _state != STATE_DONE && _state != STATE_ERROR) {
+        char c = data[pos];
+        switch (_state) {
+        case STATE_SIZE: {
+            int digit = hexValue(c);
+            if (digit >= 0) {
+                if (++_size_digits > MAX_SIZE_DIGITS) {
+                    consumed = pos;
+                    return _fail(400);
+                }
+                _chunk_size = _chunk_size * 16 + digit;
+                pos++;
+                break;
+            }
+            if (_size_digits == 0) {
+                consumed = pos;
+                return _fail(400);
+            }
+            if (c == ';' || c == ' ' || c == '\t') {
+                _state = STATE_EXTENSION;
+            } else if (c == '\r') {
+                _state = STATE_SIZE_LF;
+            } else if (c != '\n') {
+                consumed = pos;
+                return _fail(400);
+            } else {
+                _state = STATE_SIZE_LF;
+                continue; // Handle the bare LF in STATE_SIZE_LF
+            }
+            _line_length = _size_digits + 1;
+            pos++;
+            break;
+        }
+        case STATE_EXTENSION:
+            if (c == '\r' || c == '\n') {
+                _state = STATE_SIZE_LF;
+                if (c == '\n') continue;
+            } else if (++_line_length > MAX_CHUNK_LINE) {
+                consumed = pos;
+                return _fail(400);
+            }
+            pos++;
+            break;
+        case STATE_SIZE_LF:
+            if (c != '\n') {
+                consumed = pos;
+                return _fail(400);
+            }
+            pos++;
+            if (_chunk_size == 0) {
+                _state = STATE_TRAILER;
+                _line_length = 0;
+            } else if (_chunk_size > _limit - _decoded) {
+                consumed = pos;
+                return _fail(413);
+            } else {
+                _remaining = _chunk_size;
+                _state = STATE_DATA;
+            }
+            break;
+        case STATE_DATA: {
+            size_t take = length - pos < _remaining ? length - pos : _remaining;
+            if (!body.append(data + pos, take)) {
+                consumed = pos;
+                return _fail(500);
+            }
+            _decoded += take;
+            _remaining -= take;
+            pos += take;
+            if (_remaining == 0) {
+                _state = STATE_DATA_CR;
+            }
+            break;
+        }
+        case STATE_DATA_CR:
+            _state = STATE_DATA_LF;
+            if (c == '\r') {
+                pos++;
+            }
+            break;
+        case STATE_DATA_LF:
+            if (c != '\n') {
+                consumed = pos;
+                return _fail(400);
+            }
+            pos++;
+            _state = STATE_SIZE;
+            _chunk_size = 0;
+            _size_digits = 0;
+            break;
+        case STATE_TRAILER:
+            // Each trailer line is dropped; an empty line ends the body
+            if (c == '\r') {
+                _state = STATE_TRAILER_LF;
+            } else if (c == '\n') {
+                _state = _line_length == 0 ? STATE_DONE : STATE_TRAILER;
+                _line_length = 0;
+            } else {
+                _line_length++;
+            }
+            if (++_trailer_bytes > MAX_TRAILER_SIZE) {
+                consumed = pos;
+                return _fail(400);
+            }
+            pos++;
+            break;
+        case STATE_TRAILER_LF:
+            if (c != '\n') {
+                consumed = pos;
+                return _fail(400);
+            }
+            _state = _line_length == 0 ? STATE_DONE : STATE_TRAILER;
+            _line_length = 0;
+            pos++;
+            break;
+        default:
+            break;
+        }
+    }
+    consumed = pos;
+    if (_state == STATE_ERROR) {
+        return DECODE_ERROR;
+    }
+    return _state == STATE_DONE ? DECODE_DONE : DECODE_MORE;
+}
@@ -1,6 +1,9 @@
 #include "ConfigParser.hpp"
 #include <fstream>
 #include <stdexcept>
+#include <cstdlib>
+#include <unistd.h> // For sysconf
+#include "FastCgiUpstream.hpp"
 
 ConfigParser::ConfigParser(const std::string& filename) : _filename(filename), _pos(0) {
     std::ifstream file(_filename.c_str());
@@ -20,6 +23,100 @@ std::vector<ServerConfig> ConfigParser::parse() {
         std::string token = _next_token();
         if (token == "server") {
             _parse_server_block(configs);
+        } else if (token == "event_backend") {
+            std::string backend = _next_token();
+            if (backend != "auto" && backend != "epoll" && backend != "poll") {
+                throw std::runtime_error("Invalid event_backend: " + backend);
+            }
+            _global_config.setEventBackend(backend);
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after event_backend");
+        } else if (token == "worker_processes") {
+            std::string count_str = _next_token();
+            int count;
+            if (count_str == "auto") {
+                count = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+            } else {
+                count = atoi(count_str.c_str());
+            }
+            if (count < 1) {
+                throw std::runtime_error("Invalid worker_processes: " + count_str);
+            }
+            _global_config.setWorkerProcesses(count);
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after worker_processes");
+        } else if (token == "open_file_cache") {
+            // open_file_cache off; | open_file_cache max=<entries> [valid=<seconds>];
+            size_t max_entries = 0;
+            int valid_seconds = _global_config.getOpenFileCacheValid();
+            while (true) {
+                std::string arg = _next_token();
+                if (arg == ";") break;
+                if (arg.empty()) throw std::runtime_error("Expected ';' after open_file_cache");
+                if (arg == "off") {
+                    max_entries = 0;
+                } else if (arg.compare(0, 4, "max=") == 0) {
+                    max_entries = atoi(arg.substr(4).c_str());
+                } else if (arg.compare(0, 6, "valid=") == 0) {
+                    valid_seconds = atoi(arg.substr(6).c_str());
+                } else {
+                    throw std::runtime_error("Invalid open_file_cache parameter: " + arg);
+                }
+            }
+            _global_config.setOpenFileCache(max_entries, valid_seconds);
+        } else if (token == "static_cache_size") {
+            _global_config.setStaticCacheSize(_parse_size(_next_token()));
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after static_cache_size");
+        } else if (token == "static_cache_max_file_size") {
+            _global_config.setStaticCacheMaxFileSize(_parse_size(_next_token()));
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after static_cache_max_file_size");
+        } else if (token == "cgi_max_processes") {
+            // Upper bound on CGI children running at once in each worker
+            int count = atoi(_next_token().c_str());
+            if (count < 1) throw std::runtime_error("cgi_max_processes must be at least 1");
+            _global_config.setCgiMaxProcesses(count);
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after cgi_max_processes");
+        } else if (token == "worker_connections") {
+            int count = atoi(_next_token().c_str());
+            if (count < 1) throw std::runtime_error("worker_connections must be at least 1");
+            _global_config.setWorkerConnections(count);
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after worker_connections");
+        } else if (token == "accept_batch") {
+            int count = atoi(_next_token().c_str());
+            if (count < 1) throw std::runtime_error("accept_batch must be at least 1");
+            _global_config.setAcceptBatch(count);
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after accept_batch");
+        } else if (token == "limit_conn_per_ip") {
+            // limit_conn_per_ip off; | limit_conn_per_ip <count>;
+            std::string value = _next_token();
+            int count = value == "off" ? 0 : atoi(value.c_str());
+            if (value != "off" && count < 1) throw std::runtime_error("Invalid limit_conn_per_ip: " + value);
+            _global_config.setLimitConnPerIp(count);
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after limit_conn_per_ip");
+        } else if (token == "error_log") {
+            // error_log <path>|stderr [debug|info|notice|warn|error|crit];
+            std::string path = _next_token();
+            if (path.empty() || path == ";") throw std::runtime_error("Expected a path after error_log");
+            std::string level_name = _next_token();
+            Logger::Level level = Logger::LEVEL_ERROR;
+            if (level_name != ";") {
+                if (!Logger::parseLevel(level_name, level)) throw std::runtime_error("Invalid error_log level: " + level_name);
+                if (_next_token() != ";") throw std::runtime_error("Expected ';' after error_log");
+            }
+            _global_config.setErrorLog(path, level);
+        } else if (token == "access_log") {
+            // access_log <path>|off;
+            std::string path = _next_token();
+            if (path.empty() || path == ";") throw std::runtime_error("Expected a path after access_log");
+            _global_config.setAccessLog(path == "off" ? "" : path);
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after access_log");
+        } else if (token == "log_format") {
+            // log_format <text with $variables>; runs of whitespace become one space
+            std::string format;
+            for (std::string part = _next_token(); part != ";"; part = _next_token()) {
+                if (part.empty()) throw std::runtime_error("Expected ';' after log_format");
+                if (!format.empty()) format += ' ';
+                format += part;
+            }
+            _global_config.setLogFormat(format);
         } else {
             throw std::runtime_error("Unexpected token in config file: " + token);
         }
@@ -27,6 +124,8 @@ std::vector<ServerConfig> ConfigParser::parse() {
     return configs;
 }
 
+const GlobalConfig& ConfigParser::getGlobalConfig() const { return _global_config; }
+
 void ConfigParser::_eat_whitespace() {
     while (_pos < _content.length() && isspace(_content[_pos])) {
         _pos++;
@@ -50,6 +149,45 @@ std::string ConfigParser::_next_token() {
     return _content.substr(start, _pos - start);
 }
 
+size_t ConfigParser::_parse_size(const std::string& size_str) {
+    /**
+     * @brief Parses a size with an optional 'k' or 'm' suffix (case-insensitive).
+     * @param size_str The token, e.g. "512", "64k" or "10m".
+     * @return The size in bytes.
+     */
+    if (size_str.empty()) {
+        throw std::runtime_error("Expected a size value");
+    }
+    size_t size;
+    char unit = tolower(size_str[size_str.length() - 1]);
+    if (unit == 'm' || unit == 'k') {
+        size = atoi(size_str.substr(0, size_str.length() - 1).c_str());
+        if (unit == 'm') size *= (1024 * 1024);
+        else if (unit == 'k') size *= 1024;
+    } else {
+        size = atoi(size_str.c_str());
+    }
+    return size;
+}
+
+int ConfigParser::_parse_duration(const std::string& duration_str) {
+    /**
+     * @brief Parses a duration with an optional 's', 'm', 'h' or 'd' suffix.
+     * @param duration_str The token, e.g. "30", "30s", "10m" or "7d".
+     * @return The duration in seconds.
+     */
+    if (duration_str.empty()) {
+        throw std::runtime_error("Expected a duration value");
+    }
+    int value = atoi(duration_str.c_str());
+    switch (duration_str[duration_str.length() - 1]) {
+        case 'm': return value * 60;
+        case 'h': return value * 3600;
+        case 'd': return value * 86400;
+        default: return value;
+    }
+}
+
 void ConfigParser::_parse_server_block(std::vector<ServerConfig>& configs) {
     ServerConfig config;
     _eat_whitespace();
@@ -85,18 +223,26 @@ void ConfigParser::_parse_server_block(std::vector<ServerConfig>& configs) {
                 if (_next_token() != ";") throw std::runtime_error("Expected ';' after error_page path");
             }
         } else if (token == "client_max_body_size") {
-            std::string size_str = _next_token();
-            size_t size;
-            char unit = size_str[size_str.length() - 1];
-            if (unit == 'm' || unit == 'k') {
-                size = atoi(size_str.substr(0, size_str.length() - 1).c_str());
-                if (unit == 'm') size *= (1024 * 1024);
-                else if (unit == 'k') size *= 1024;
+            config.setClientMaxBodySize(_parse_size(_next_token()));
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after client_max_body_size");
+        } else if (token == "keepalive_timeout") {
+            // A duration (seconds by default); 0 disables persistent connections
+            config.setKeepAliveTimeout(_parse_duration(_next_token()));
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after keepalive_timeout");
+        } else if (token == "client_header_timeout" || token == "client_body_timeout" || token == "send_timeout") {
+            int seconds = _parse_duration(_next_token());
+            if (seconds <= 0) throw std::runtime_error(token + " must be positive");
+            if (token == "client_header_timeout") {
+                config.setClientHeaderTimeout(seconds);
+            } else if (token == "client_body_timeout") {
+                config.setClientBodyTimeout(seconds);
             } else {
-                size = atoi(size_str.c_str());
+                config.setSendTimeout(seconds);
             }
-            config.setClientMaxBodySize(size);
-            if (_next_token() != ";") throw std::runtime_error("Expected ';' after client_max_body_size");
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after " + token);
+        } else if (token == "keepalive_requests") {
+            config.setKeepAliveRequests(atoi(_next_token().c_str()));
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after keepalive_requests");
         } else if (token == "location") {
             Location location;
             location.setPath(_next_token());
@@ -154,6 +300,77 @@ void ConfigParser::_parse_location_block(Location& location) {
             if (_content[_pos-1] != ';') {
                 if (_next_token() != ";") throw std::runtime_error("Expected ';' after cgi_path");
             }
+        } else if (token == "expires") {
+            // expires off; | expires <time>; with an optional s/m/h/d unit
+            std::string value = _next_token();
+            if (value == "off") {
+                location.setExpires(-1);
+            } else {
+                location.setExpires(_parse_duration(value));
+            }
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after expires");
+        } else if (token == "cgi_timeout") {
+            location.setCgiTimeout(_parse_duration(_next_token()));
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after cgi_timeout");
+        } else if (token == "fastcgi_pass") {
+            // fastcgi_pass unix:/path.sock | host:port [max_conns=N] [multiplex=N];
+            std::string address = _next_token();
+            sockaddr_storage addr;
+            socklen_t addr_len;
+            if (!FastCgiUpstream::resolveAddress(address, addr, addr_len)) {
+                throw std::runtime_error("Invalid fastcgi_pass address: " + address);
+            }
+            size_t max_connections = 16;
+            size_t multiplex = 1;
+            while (true) {
+                std::string param = _next_token();
+                if (param == ";") break;
+                if (param.compare(0, 10, "max_conns=") == 0 && std::atoi(param.c_str() + 10) > 0) {
+                    max_connections = std::atoi(param.c_str() + 10);
+                } else if (param.compare(0, 10, "multiplex=") == 0 && std::atoi(param.c_str() + 10) > 0
+                           && std::atoi(param.c_str() + 10) < 65536) {
+                    multiplex = std::atoi(param.c_str() + 10);
+                } else {
+                    throw std::runtime_error("Invalid fastcgi_pass parameter: " + param);
+                }
+            }
+            location.setFastCgiPass(address, max_connections, multiplex);
+        } else if (token == "stub_status" || token == "metrics") {
+            location.setStatusPage(token == "metrics" ? Location::STATUS_METRICS : Location::STATUS_STUB);
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after " + token);
+        } else if (token == "cache_control") {
+            std::string value;
+            while (true) {
+                std::string part = _next_token();
+                if (part == ";") break;
+                if (part.empty()) throw std::runtime_error("Expected ';' after cache_control");
+                value += (value.empty() ? "" : " ") + part;
+            }
+            location.setCacheControl(value);
+        } else if (token == "gzip") {
+            location.setGzip(_next_token() == "on");
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after gzip");
+        } else if (token == "gzip_static") {
+            location.setGzipStatic(_next_token() == "on");
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after gzip_static");
+        } else if (token == "gzip_min_length") {
+            location.setGzipMinLength(_parse_size(_next_token()));
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after gzip_min_length");
+        } else if (token == "gzip_comp_level") {
+            int level = std::atoi(_next_token().c_str());
+            if (level < 1 || level > 9) throw std::runtime_error("gzip_comp_level must be between 1 and 9");
+            location.setGzipCompLevel(level);
+            if (_next_token() != ";") throw std::runtime_error("Expected ';' after gzip_comp_level");
+        } else if (token == "gzip_types") {
+            // gzip_types <media type>...; replaces the default list, "*" matches any type
+            std::vector<std::string> types;
+            while (true) {
+                std::string type = _next_token();
+                if (type == ";") break;
+                if (type.empty()) throw std::runtime_error("Expected ';' after gzip_types");
+                types.push_back(type);
+            }
+            location.setGzipTypes(types);
         } else {
             throw std::runtime_error("Unknown directive in location block: " + token);
         }
@@ -0,0 +1,582 @@
+#include "Connection.hpp"
+#include "HttpResponse.hpp"
+#include "CgiRequest.hpp"
+#include <sys/socket.h>
+#include <sys/uio.h> // For writev
+#include <unistd.h>
+#include <cerrno>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+// How long a rejected upload is drained before the connection is closed anyway
+static const int LINGERING_TIMEOUT = 5;
+
+Connection::Connection(int fd, int port, const std::string& remote_address)
+    : _fd(fd), _port(port), _remote_address(remote_address), _state(READING_HEADERS),
+      _header_length(0), _request_length(0), _body_remaining(0), _body_limit(0),
+      _error_status(0), _requests_served(0), _request_start(TimerWheel::nowMicros()), _head_complete(0),
+      _handler_start(0), _upstream_start(0), _response_bytes(0), _location_metrics(NULL), _bytes_received(0), _bytes_sent(0),
+      _pending_output(0), _close_after_write(false),
+      _keepalive_timeout(0), _header_timeout(60), _body_timeout(60), _send_timeout(60), _last_activity(TimerWheel::now()),
+      _head_start(_last_activity), _config(NULL), _cgi(NULL), _closed(false), _linger_on_close(false), _lingering(false), _linger_start(0) {
+    _event_target.type = EventTarget::CLIENT;
+    _event_target.fd = fd;
+    _event_target.owner = this;
+    TimerWheel::initTimer(&_timer, &_event_target);
+}
+
+Connection::~Connection() {
+    for (size_t i = 0; i < _output.size(); ++i) {
+        _release_chunk(_output[i]);
+    }
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+int Connection::getFd() const { return _fd; }
+int Connection::getPort() const { return _port; }
+const std::string& Connection::getRemoteAddress() const { return _remote_address; }
+EventTarget* Connection::getEventTarget() { return &_event_target; }
+Connection::State Connection::getState() const { return _state; }
+const std::string& Connection::getReadBuffer() const { return _read_buffer; }
+size_t Connection::getRequestLength() const { return _request_length; }
+const HttpRequest& Connection::getRequest() const { return _request; }
+RequestBody& Connection::getBody() { return _body; }
+int Connection::getErrorStatus() const { return _error_status; }
+unsigned long Connection::getRequestStart() const { return _request_start; }
+unsigned long Connection::getHeadComplete() const { return _head_complete; }
+void Connection::setHandlerStart(unsigned long start) { _handler_start = start; }
+unsigned long Connection::getHandlerStart() const { return _handler_start; }
+void Connection::setUpstreamStart(unsigned long start) { _upstream_start = start; }
+unsigned long Connection::getUpstreamStart() const { return _upstream_start; }
+
+unsigned long Connection::takeResponseBytes() {
+    unsigned long bytes = _response_bytes;
+    _response_bytes = 0;
+    return bytes;
+}
+
+void Connection::setLocationMetrics(LocationMetrics* metrics) { _location_metrics = metrics; }
+LocationMetrics* Connection::getLocationMetrics() const { return _location_metrics; }
+unsigned long Connection::getBytesReceived() const { return _bytes_received; }
+unsigned long Connection::getBytesSent() const { return _bytes_sent; }
+
+void Connection::setConfig(ConfigGeneration* config) { _config = config; }
+ConfigGeneration* Connection::getConfig() const { return _config; }
+void Connection::setCgi(CgiRequest* cgi) { _cgi = cgi; }
+CgiRequest* Connection::getCgi() const { return _cgi; }
+void Connection::markClosed() { _closed = true; }
+bool Connection::isClosed() const { return _closed; }
+void Connection::setLingerOnClose(bool linger) { _linger_on_close = linger; }
+bool Connection::getLingerOnClose() const { return _linger_on_close; }
+bool Connection::isLingering() const { return _lingering; }
+size_t Connection::getRequestsServed() const { return _requests_served; }
+void Connection::setCloseAfterWrite(bool close_after_write) { _close_after_write = close_after_write; }
+bool Connection::getCloseAfterWrite() const { return _close_after_write; }
+void Connection::setKeepAliveTimeout(int seconds) { _keepalive_timeout = seconds; }
+int Connection::getKeepAliveTimeout() const { return _keepalive_timeout; }
+Timer* Connection::getTimer() { return &_timer; }
+
+void Connection::setTimeouts(int header_timeout, int body_timeout, int send_timeout) {
+    _header_timeout = header_timeout;
+    _body_timeout = body_timeout;
+    _send_timeout = send_timeout;
+}
+
+unsigned long Connection::getDeadline() const {
+    /**
+     * @brief Computes when the connection times out in its current phase.
+     * A request head must arrive completely within client_header_timeout of its
+     * first byte (or of the connection being accepted), which defeats clients that
+     * trickle headers to hold connections open. A body may pause for at most
+     * client_body_timeout between reads, a response for send_timeout between writes,
+     * and an idle persistent connection is kept for keepalive_timeout. A CGI script
+     * or FastCGI request producing the response adds its own deadline.
+     * @return A TimerWheel::now() time, or 0 if no timeout applies.
+     */
+    if (_lingering) {
+        return _linger_start + LINGERING_TIMEOUT * 1000UL;
+    }
+    unsigned long deadline = 0;
+    if (hasPendingOutput()) {
+        deadline = _last_activity + _send_timeout * 1000UL;
+    } else if (_cgi) {
+        deadline = 0;
+    } else if (_state != READING_HEADERS) {
+        deadline = _last_activity + _body_timeout * 1000UL;
+    } else if (_read_buffer.empty() && _requests_served > 0) {
+        deadline = _last_activity + _keepalive_timeout * 1000UL;
+    } else {
+        deadline = _head_start + _header_timeout * 1000UL;
+    }
+    if (_cgi && _cgi->getDeadline() != 0 && (deadline == 0 || _cgi->getDeadline() < deadline)) {
+        deadline = _cgi->getDeadline();
+    }
+    return deadline;
+}
+
+Connection::IoStatus Connection::readFromSocket() {
+    /**
+     * @brief Performs a single recv() on the client socket and appends the data to the read buffer.
+     * Only one read is done per readiness notification so that a fast sender cannot
+     * monopolize the event loop; any remaining data is picked up on the next POLLIN.
+     * @return IO_OK if data was read, IO_AGAIN if nothing was available, IO_EOF on
+     * orderly shutdown by the peer, IO_ERROR otherwise.
+     */
+    char buffer[16384];
+    ssize_t bytes_read = recv(_fd, buffer, sizeof(buffer), 0);
+    if (bytes_read > 0) {
+        _bytes_received += bytes_read;
+        _last_activity = TimerWheel::now();
+        if (_read_buffer.empty() && _state == READING_HEADERS) {
+            _head_start = _last_activity;
+            _request_start = TimerWheel::nowMicros();
+        }
+        _read_buffer.append(buffer, bytes_read);
+        return IO_OK;
+    }
+    if (bytes_read == 0) {
+        return IO_EOF;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        return IO_AGAIN;
+    }
+    return IO_ERROR;
+}
+
+bool Connection::readRequestHead() {
+    /**
+     * @brief Parses as much of the request head as has arrived.
+     * Parsing resumes where the previous call stopped, so each byte of a slowly
+     * arriving head is only examined once. A malformed head also counts as read;
+     * getErrorStatus() then tells which error to answer with.
+     * @return true once the head is complete and startBody() may be called.
+     */
+    if (_state != READING_HEADERS) {
+        return true;
+    }
+    HttpRequest::ParseStatus status = _request.parse(_read_buffer);
+    if (status == HttpRequest::PARSE_INCOMPLETE) {
+        return false;
+    }
+    _state = HEAD_COMPLETE;
+    _head_complete = TimerWheel::nowMicros();
+    if (status == HttpRequest::PARSE_ERROR) {
+        // The connection is closed after the error response, so drop everything
+        _error_status = _request.getErrorStatus();
+        _request_length = _read_buffer.length();
+        return true;
+    }
+    _header_length = _request.getHeaderLength();
+    return true;
+}
+
+void Connection::startBody(size_t limit) {
+    /**
+     * @brief Starts moving the body into getBody(), which the caller has prepared.
+     * @param limit Largest body accepted; more makes the request fail with 413.
+     */
+    _state = READING_BODY;
+    _body_limit = limit;
+    _body_remaining = _request.getContentLength();
+    _chunked_decoder.reset(limit);
+}
+
+bool Connection::hasCompleteRequest() {
+    /**
+     * @brief Moves newly arrived body bytes to the body sink and checks for the end.
+     * Body bytes are taken out of the read buffer as they arrive (and decoded first
+     * if chunked), so only the head and any pipelined data stay buffered no matter
+     * how large the body or its chunks are.
+     * @return true once the whole body has been received, or the request failed.
+     */
+    if (_error_status != 0 || _request_length != 0) {
+        return true;
+    }
+    if (_state != READING_BODY) {
+        return false;
+    }
+    if (_request.isChunked()) {
+        return _decode_chunked_body();
+    }
+    size_t available = _read_buffer.length() - _header_length;
+    size_t take = available < _body_remaining ? available : _body_remaining;
+    if (take > 0) {
+        if (!_store_body(_read_buffer.data() + _header_length, take)) {
+            return true;
+        }
+        _read_buffer.erase(_header_length, take);
+        _body_remaining -= take;
+    }
+    if (_body_remaining == 0) {
+        _request_length = _header_length;
+        return true;
+    }
+    return false;
+}
+
+bool Connection::_store_body(const char* data, size_t length) {
+    if (length > _body_limit - _body.size()) {
+        _fail_body(413);
+        return false;
+    }
+    if (!_body.append(data, length)) {
+        _fail_body(500);
+        return false;
+    }
+    return true;
+}
+
+void Connection::_fail_body(int status) {
+    _error_status = status;
+    _request_length = _read_buffer.length();
+    _linger_on_close = true; // The rest of the body may still be on its way
+}
+
+bool Connection::_decode_chunked_body() {
+    size_t consumed = 0;
+    ChunkedDecoder::Status status = _chunked_decoder.decode(_read_buffer.data() + _header_length,
+                                                            _read_buffer.length() - _header_length, consumed, _body);
+    _read_buffer.erase(_header_length, consumed);
+    if (status == ChunkedDecoder::DECODE_ERROR) {
+        _fail_body(_chunked_decoder.getErrorStatus());
+        return true;
+    }
+    if (status == ChunkedDecoder::DECODE_DONE) {
+        _request_length = _header_length;
+        return true;
+    }
+    return false;
+}
+
+void Connection::consumeRequest() {
+    /**
+     * @brief Drops the current request from the read buffer and resets the framing state.
+     * Any bytes that follow it (a pipelined request) stay buffered for the next call
+     * to readRequestHead().
+     */
+    _read_buffer.erase(0, _request_length);
+    _request.reset();
+    _body.reset();
+    _state = READING_HEADERS;
+    _header_length = 0;
+    _request_length = 0;
+    _body_remaining = 0;
+    _requests_served++;
+    _head_start = TimerWheel::now(); // A pipelined request is timed from here
+    _request_start = TimerWheel::nowMicros();
+    _head_complete = 0;
+    _handler_start = 0;
+    _upstream_start = 0;
+    _location_metrics = NULL;
+}
+
+// Small queued data is appended to the previous in-memory chunk rather than queued
+// on its own, as long as that chunk stays within this size or its allocation
+static const size_t COALESCE_LIMIT = 16384;
+// A sent chunk's storage is kept for reuse only if it is no larger than this
+static const size_t SPARE_BUFFER_LIMIT = 65536;
+// iovecs gathered per writev() call
+static const int MAX_IOVECS = 64;
+
+std::string& Connection::_append_buffer(size_t length) {
+    /**
+     * @brief Returns the owned buffer that length more bytes of output should be appended to.
+     * That is the last queued chunk when it is in memory and the bytes fit without
+     * growing it much, or else a new chunk built on the spare storage of a sent one.
+     */
+    if (!_output.empty() && !_output.back().file && !_output.back().shared) {
+        std::string& last = _output.back().data;
+        if (last.length() + length <= COALESCE_LIMIT || last.length() + length <= last.capacity()) {
+            return last;
+        }
+    }
+    OutputChunk chunk;
+    chunk.shared = NULL;
+    chunk.data_offset = 0;
+    chunk.shared_end = 0;
+    chunk.file = NULL;
+    chunk.file_offset = 0;
+    chunk.file_remaining = 0;
+    _output.push_back(chunk);
+    _output.back().data.swap(_spare_buffer);
+    return _output.back().data;
+}
+
+void Connection::queueResponse(const std::string& data) {
+    if (data.empty()) {
+        return;
+    }
+    _append_buffer(data.length()).append(data);
+    _add_pending(data.length());
+}
+
+void Connection::queueHeaders(const HttpResponse& response) {
+    /**
+     * @brief Serializes a response's status line and headers, with the current Date,
+     * straight into the output queue. The body, if any, is queued separately.
+     */
+    std::string& buffer = _append_buffer(512);
+    size_t before = buffer.length();
+    response.appendHeaders(buffer, true);
+    _add_pending(buffer.length() - before);
+}
+
+void Connection::queueBody(std::string& body) {
+    /**
+     * @brief Queues an in-memory body as a chunk of its own, taking its storage over
+     * instead of copying it. Small bodies are appended to the preceding headers.
+     * @param body The body; left empty.
+     */
+    if (body.empty()) {
+        return;
+    }
+    _add_pending(body.length());
+    if (body.length() <= COALESCE_LIMIT / 4) {
+        _append_buffer(body.length()).append(body);
+        body.clear();
+        return;
+    }
+    OutputChunk chunk;
+    chunk.shared = NULL;
+    chunk.data_offset = 0;
+    chunk.shared_end = 0;
+    chunk.file = NULL;
+    chunk.file_offset = 0;
+    chunk.file_remaining = 0;
+    _output.push_back(chunk);
+    _output.back().data.swap(body);
+}
+
+void Connection::queueRendered(SharedBuffer* rendered) {
+    /**
+     * @brief Queues a pre-rendered response, such as one from the ResponseCache, without
+     * copying it. Renderings carry no Date header, so the current Date line is sent
+     * between their status line and the rest, as a third shared piece.
+     * @param rendered The rendering; the connection takes over one reference.
+     */
+    const std::string& data = rendered->getData();
+    size_t status_end = data.find('\n');
+    status_end = status_end == std::string::npos ? data.length() : status_end + 1;
+    SharedBuffer* date_line = HttpResponse::getDateLine();
+    date_line->retain();
+    rendered->retain();
+    _queue_shared(rendered, 0, status_end);
+    _queue_shared(date_line, 0, date_line->size());
+    _queue_shared(rendered, status_end, data.length());
+}
+
+void Connection::_queue_shared(SharedBuffer* buffer, size_t begin, size_t end) {
+    /**
+     * @brief Queues part of a shared buffer; the connection takes over one reference.
+     */
+    OutputChunk chunk;
+    chunk.shared = buffer;
+    chunk.data_offset = begin;
+    chunk.shared_end = end;
+    chunk.file = NULL;
+    chunk.file_offset = 0;
+    chunk.file_remaining = 0;
+    if (begin >= end) {
+        _release_chunk(chunk);
+        return;
+    }
+    _output.push_back(chunk);
+    _add_pending(end - begin);
+}
+
+void Connection::queueFile(CachedFile* file, off_t offset, size_t length) {
+    /**
+     * @brief Queues a region of an open file to be sent after the data already queued.
+     * The bytes never pass through user space: they are streamed with sendfile() as
+     * the socket becomes writable, resuming at the saved offset each time.
+     * @param file The open file; the connection takes over one reference.
+     * @param offset Where in the file to start.
+     * @param length How many bytes to send.
+     */
+    OutputChunk chunk;
+    chunk.shared = NULL;
+    chunk.data_offset = 0;
+    chunk.shared_end = 0;
+    chunk.file = file;
+    chunk.file_offset = offset;
+    chunk.file_remaining = length;
+    if (length == 0) {
+        _release_chunk(chunk);
+        return;
+    }
+    _output.push_back(chunk);
+    _add_pending(length);
+}
+
+void Connection::_release_chunk(OutputChunk& chunk) {
+    if (chunk.shared) {
+        chunk.shared->release();
+        chunk.shared = NULL;
+    }
+    if (chunk.file) {
+        chunk.file->release();
+        chunk.file = NULL;
+    }
+}
+
+void Connection::_add_pending(size_t length) {
+    // send_timeout counts from when the output started waiting, not from the last request
+    if (_pending_output == 0) {
+        _last_activity = TimerWheel::now();
+    }
+    _pending_output += length;
+    _response_bytes += length;
+}
+
+bool Connection::hasPendingOutput() const {
+    return _pending_output > 0;
+}
+
+size_t Connection::getPendingOutputSize() const {
+    return _pending_output;
+}
+
+bool Connection::isIdle() const {
+    return _state == READING_HEADERS && _read_buffer.empty() && !hasPendingOutput();
+}
+
+void Connection::startLingeringClose() {
+    /**
+     * @brief Half-closes the connection once the final response has been sent.
+     * The client sees end-of-stream after the response, while whatever it is still
+     * sending is read and dropped by discardInput() until it closes its side.
+     */
+    shutdown(_fd, SHUT_WR);
+    _lingering = true;
+    _linger_start = TimerWheel::now();
+    _read_buffer.clear();
+}
+
+Connection::IoStatus Connection::discardInput() {
+    char buffer[16384];
+    ssize_t bytes_read = recv(_fd, buffer, sizeof(buffer), 0);
+    if (bytes_read > 0) {
+        _bytes_received += bytes_read;
+        return IO_OK;
+    }
+    if (bytes_read == 0) {
+        return IO_EOF;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        return IO_AGAIN;
+    }
+    return IO_ERROR;
+}
+
+Connection::IoStatus Connection::writeToSocket() {
+    /**
+     * @brief Sends as much of the queued output as the socket accepts.
+     * Runs of in-memory chunks go out with one writev() each, file regions with
+     * sendfile(). Chunk offsets are kept so that a partial write resumes on the next POLLOUT.
+     * @return IO_OK when everything has been sent, IO_AGAIN if data remains,
+     * IO_ERROR if the peer went away or a file could not be read.
+     */
+    while (!_output.empty()) {
+        IoStatus status = _output.front().file ? _write_file(_output.front()) : _write_memory();
+        if (status != IO_OK) {
+            return status;
+        }
+    }
+    return IO_OK;
+}
+
+Connection::IoStatus Connection::_write_memory() {
+    /**
+     * @brief Sends the in-memory chunks at the front of the queue with a single writev()
+     * and drops those that were sent completely.
+     * @return IO_OK if anything was sent, IO_AGAIN or IO_ERROR otherwise.
+     */
+    struct iovec iov[MAX_IOVECS];
+    int count = 0;
+    for (std::deque<OutputChunk>::iterator it = _output.begin(); it != _output.end() && !it->file && count < MAX_IOVECS; ++it) {
+        const char* bytes = it->shared ? it->shared->getData().data() : it->data.data();
+        size_t end = it->shared ? it->shared_end : it->data.length();
+        iov[count].iov_base = const_cast<char*>(bytes + it->data_offset);
+        iov[count].iov_len = end - it->data_offset;
+        ++count;
+    }
+    ssize_t sent = writev(_fd, iov, count);
+    if (sent < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return IO_AGAIN;
+        }
+        return IO_ERROR;
+    }
+    _pending_output -= sent;
+    _bytes_sent += sent;
+    _last_activity = TimerWheel::now();
+    size_t remaining = static_cast<size_t>(sent);
+    for (int i = 0; i < count; ++i) {
+        if (remaining < iov[i].iov_len) {
+            _output.front().data_offset += remaining;
+            return IO_OK;
+        }
+        remaining -= iov[i].iov_len;
+        _pop_chunk();
+    }
+    return IO_OK;
+}
+
+Connection::IoStatus Connection::_write_file(OutputChunk& chunk) {
+    /**
+     * @brief Streams a queued file region to the socket until it is done or the socket is full.
+     */
+    while (chunk.file_remaining > 0) {
+        ssize_t sent;
+        int file_fd = chunk.file->getFd();
+#ifdef __linux__
+        sent = sendfile(_fd, file_fd, &chunk.file_offset, chunk.file_remaining);
+#elif defined(__APPLE__)
+        off_t len = chunk.file_remaining;
+        int rc = sendfile(file_fd, _fd, chunk.file_offset, &len, NULL, 0);
+        // A partial transfer reports EAGAIN but still sets len to what was sent
+        sent = (rc == 0 || len > 0) ? static_cast<ssize_t>(len) : -1;
+        if (sent > 0) chunk.file_offset += sent;
+#else
+        char buffer[65536];
+        size_t to_read = chunk.file_remaining < sizeof(buffer) ? chunk.file_remaining : sizeof(buffer);
+        sent = pread(file_fd, buffer, to_read, chunk.file_offset);
+        if (sent > 0) {
+            sent = send(_fd, buffer, sent, 0);
+            if (sent > 0) chunk.file_offset += sent;
+        }
+#endif
+        if (sent == 0) {
+            return IO_ERROR; // The file shrank underneath us
+        }
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return IO_AGAIN;
+            }
+            return IO_ERROR;
+        }
+        chunk.file_remaining -= sent;
+        _pending_output -= sent;
+        _bytes_sent += sent;
+        _last_activity = TimerWheel::now();
+    }
+    _pop_chunk();
+    return IO_OK;
+}
+
+void Connection::_pop_chunk() {
+    /**
+     * @brief Drops the sent front chunk, keeping a moderately sized owned buffer for reuse.
+     */
+    OutputChunk& chunk = _output.front();
+    if (!chunk.shared && !chunk.file && chunk.data.capacity() <= SPARE_BUFFER_LIMIT
+        && chunk.data.capacity() > _spare_buffer.capacity()) {
+        chunk.data.clear();
+        chunk.data.swap(_spare_buffer);
+    }
+    _release_chunk(chunk);
+    _output.pop_front();
+}
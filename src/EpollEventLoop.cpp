@@ -0,0 +1,74 @@
+#include "EpollEventLoop.hpp"
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <cerrno>
+#include <stdexcept>
+
+EpollEventLoop::EpollEventLoop() : _epoll_fd(epoll_create1(EPOLL_CLOEXEC)), _events(1024) {
+    if (_epoll_fd < 0) {
+        throw std::runtime_error("epoll_create1() failed");
+    }
+}
+
+EpollEventLoop::~EpollEventLoop() {
+    close(_epoll_fd);
+}
+
+void EpollEventLoop::add(int fd, int events, EventTarget* target) {
+    /**
+     * @brief Registers a descriptor for edge-triggered read and write readiness.
+     * The requested interest is ignored: both directions are always watched so that
+     * later changes of interest need no epoll_ctl() call. Handlers simply ignore a
+     * notification for a direction they have nothing to do in.
+     */
+    (void)events;
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = target;
+    if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        throw std::runtime_error("epoll_ctl(ADD) failed");
+    }
+}
+
+void EpollEventLoop::modify(int fd, int events, EventTarget* target) {
+    (void)fd;
+    (void)events;
+    (void)target;
+}
+
+void EpollEventLoop::remove(int fd) {
+    epoll_event ev; // Ignored, but required by kernels before 2.6.9
+    ev.events = 0;
+    ev.data.ptr = NULL;
+    epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+int EpollEventLoop::wait(std::vector<Event>& ready, int timeout_ms) {
+    ready.clear();
+    int ret = epoll_wait(_epoll_fd, &_events[0], _events.size(), timeout_ms);
+    if (ret < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    for (int i = 0; i < ret; ++i) {
+        Event event;
+        event.target = static_cast<EventTarget*>(_events[i].data.ptr);
+        event.events = 0;
+        if (_events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) event.events |= EVENT_READ;
+        if (_events[i].events & EPOLLOUT) event.events |= EVENT_WRITE;
+        if (_events[i].events & EPOLLERR) event.events |= EVENT_ERROR;
+        if (_events[i].events & EPOLLHUP) event.events |= EVENT_HANGUP;
+        if (_events[i].events & EPOLLRDHUP) event.events |= EVENT_PEER_SHUTDOWN;
+        ready.push_back(event);
+    }
+    if (static_cast<size_t>(ret) == _events.size()) {
+        _events.resize(_events.size() * 2); // Busy: fetch more per call next time
+    }
+    return ret;
+}
+
+bool EpollEventLoop::isEdgeTriggered() const { return true; }
+const char* EpollEventLoop::getName() const { return "epoll"; }
+
+#endif
@@ -0,0 +1,31 @@
+#include "EventLoop.hpp"
+#include "PollEventLoop.hpp"
+#include "EpollEventLoop.hpp"
+#include <stdexcept>
+
+EventLoop::~EventLoop() {}
+
+EventLoop* EventLoop::create(const std::string& backend) {
+    /**
+     * @brief Instantiates the requested event notification backend.
+     * @param backend "epoll", "poll" or "auto" (epoll where available, poll otherwise).
+     * @return A heap-allocated EventLoop owned by the caller.
+     * @throws std::runtime_error if the backend is unknown or unavailable on this platform.
+     */
+    if (backend == "poll") {
+        return new PollEventLoop();
+    }
+#ifdef __linux__
+    if (backend == "epoll" || backend == "auto") {
+        return new EpollEventLoop();
+    }
+#else
+    if (backend == "auto") {
+        return new PollEventLoop();
+    }
+    if (backend == "epoll") {
+        throw std::runtime_error("epoll is not available on this platform");
+    }
+#endif
+    throw std::runtime_error("Unknown event backend: " + backend);
+}
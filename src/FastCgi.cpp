@@ -0,0 +1,104 @@
+#include "FastCgi.hpp"
+
+// Roles and flags of FCGI_BEGIN_REQUEST
+static const unsigned char ROLE_RESPONDER = 1;
+static const unsigned char FLAG_KEEP_CONN = 1;
+static const unsigned char VERSION_1 = 1;
+
+void FastCgi::_append_record(std::string& out, unsigned char type, unsigned short request_id,
+                             const char* data, size_t length) {
+    /**
+     * @brief Appends one record; length must not exceed MAX_CONTENT_LENGTH.
+     * Content is padded to a multiple of eight bytes as the specification recommends.
+     */
+    unsigned char padding = static_cast<unsigned char>((8 - length % 8) % 8);
+    char header[HEADER_LENGTH];
+    header[0] = VERSION_1;
+    header[1] = type;
+    header[2] = static_cast<char>((request_id >> 8) & 0xff);
+    header[3] = static_cast<char>(request_id & 0xff);
+    header[4] = static_cast<char>((length >> 8) & 0xff);
+    header[5] = static_cast<char>(length & 0xff);
+    header[6] = padding;
+    header[7] = 0;
+    out.append(header, HEADER_LENGTH);
+    out.append(data, length);
+    out.append(padding, '\0');
+}
+
+void FastCgi::appendBeginRequest(std::string& out, unsigned short request_id, bool keep_conn) {
+    char body[8] = {0, ROLE_RESPONDER, 0, 0, 0, 0, 0, 0};
+    if (keep_conn) {
+        body[2] = FLAG_KEEP_CONN;
+    }
+    _append_record(out, BEGIN_REQUEST, request_id, body, sizeof(body));
+}
+
+void FastCgi::appendAbortRequest(std::string& out, unsigned short request_id) {
+    _append_record(out, ABORT_REQUEST, request_id, NULL, 0);
+}
+
+void FastCgi::appendStream(std::string& out, unsigned char type, unsigned short request_id,
+                           const char* data, size_t length) {
+    /**
+     * @brief Appends stream data split into as many records as needed.
+     * An empty stream record, which ends the stream, is written when length is 0.
+     */
+    do {
+        size_t part = length < MAX_CONTENT_LENGTH ? length : MAX_CONTENT_LENGTH;
+        _append_record(out, type, request_id, data, part);
+        data += part;
+        length -= part;
+    } while (length > 0);
+}
+
+void FastCgi::_append_length(std::string& out, size_t length) {
+    // Lengths below 128 take one byte, longer ones four with the high bit set
+    if (length < 128) {
+        out += static_cast<char>(length);
+        return;
+    }
+    out += static_cast<char>(((length >> 24) & 0x7f) | 0x80);
+    out += static_cast<char>((length >> 16) & 0xff);
+    out += static_cast<char>((length >> 8) & 0xff);
+    out += static_cast<char>(length & 0xff);
+}
+
+void FastCgi::appendNameValue(std::string& out, const std::string& name, const std::string& value) {
+    _append_length(out, name.length());
+    _append_length(out, value.length());
+    out += name;
+    out += value;
+}
+
+bool FastCgi::parseRecord(const std::string& buffer, size_t& offset, FastCgiRecord& record) {
+    /**
+     * @brief Extracts the record starting at offset if it has fully arrived.
+     * @param offset Advanced past the record (including padding) on success.
+     * @return false if more input is needed.
+     */
+    if (buffer.length() - offset < HEADER_LENGTH) {
+        return false;
+    }
+    const unsigned char* header = reinterpret_cast<const unsigned char*>(buffer.data() + offset);
+    size_t content_length = (static_cast<size_t>(header[4]) << 8) | header[5];
+    size_t total = HEADER_LENGTH + content_length + header[6];
+    if (buffer.length() - offset < total) {
+        return false;
+    }
+    record.type = header[1];
+    record.request_id = static_cast<unsigned short>((header[2] << 8) | header[3]);
+    record.content.assign(buffer, offset + HEADER_LENGTH, content_length);
+    offset += total;
+    return true;
+}
+
+bool FastCgi::parseEndRequest(const std::string& content, unsigned int& app_status, unsigned char& protocol_status) {
+    if (content.length() < 8) {
+        return false;
+    }
+    const unsigned char* body = reinterpret_cast<const unsigned char*>(content.data());
+    app_status = (static_cast<unsigned int>(body[0]) << 24) | (body[1] << 16) | (body[2] << 8) | body[3];
+    protocol_status = body[4];
+    return true;
+}
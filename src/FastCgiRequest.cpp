@@ -0,0 +1,63 @@
+#include "FastCgiRequest.hpp"
+#include "FastCgi.hpp"
+
+FastCgiRequest::FastCgiRequest(Connection* connection, bool keep_alive, int timeout, FastCgiUpstream* upstream,
+                               const std::vector<std::string>& environment, const std::string& input)
+    : CgiRequest(FASTCGI, connection, keep_alive, timeout), _upstream(upstream), _input(input), _request_id(0),
+      _reused_connection(false), _retried(false), _failed(false), _protocol_status(FastCgi::REQUEST_COMPLETE) {
+    for (size_t i = 0; i < environment.size(); ++i) {
+        size_t equals = environment[i].find('=');
+        FastCgi::appendNameValue(_params, environment[i].substr(0, equals), environment[i].substr(equals + 1));
+    }
+}
+
+FastCgiRequest::~FastCgiRequest() {}
+
+FastCgiUpstream* FastCgiRequest::getUpstream() const { return _upstream; }
+
+void FastCgiRequest::encode(std::string& out, unsigned short request_id, bool reused_connection) {
+    /**
+     * @brief Appends the complete request (BEGIN_REQUEST, PARAMS and STDIN streams)
+     * to a backend connection's output. The parameters are kept in case the request
+     * has to be retried on another connection.
+     */
+    _request_id = request_id;
+    _reused_connection = reused_connection;
+    FastCgi::appendBeginRequest(out, request_id, true);
+    if (!_params.empty()) {
+        FastCgi::appendStream(out, FastCgi::PARAMS, request_id, _params.data(), _params.length());
+    }
+    FastCgi::appendStream(out, FastCgi::PARAMS, request_id, NULL, 0);
+    if (!_input.empty()) {
+        FastCgi::appendStream(out, FastCgi::STDIN, request_id, _input.data(), _input.length());
+    }
+    FastCgi::appendStream(out, FastCgi::STDIN, request_id, NULL, 0);
+    _touch();
+}
+
+unsigned short FastCgiRequest::getRequestId() const { return _request_id; }
+bool FastCgiRequest::isOnReusedConnection() const { return _reused_connection; }
+void FastCgiRequest::setRetried() { _retried = true; }
+bool FastCgiRequest::wasRetried() const { return _retried; }
+
+void FastCgiRequest::appendOutput(const std::string& data) {
+    if (getConnection()) {
+        _output += data;
+    }
+    _touch();
+}
+
+void FastCgiRequest::complete(unsigned int app_status, unsigned char protocol_status) {
+    // Like other servers, the application's exit status is not reflected in the response
+    (void)app_status;
+    _protocol_status = protocol_status;
+    std::string().swap(_params);
+    std::string().swap(_input);
+}
+
+void FastCgiRequest::fail() {
+    _failed = true;
+}
+
+bool FastCgiRequest::hasFailed() const { return _failed; }
+unsigned char FastCgiRequest::getProtocolStatus() const { return _protocol_status; }
@@ -0,0 +1,419 @@
+#include "FastCgiUpstream.hpp"
+#include "Logger.hpp"
+#include <cstring> // For memset, strncpy
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/un.h>
+
+FastCgiUpstream::FastCgiUpstream(const std::string& address, size_t max_connections, size_t multiplex,
+                                 EventLoop* event_loop)
+    : _address(address), _addr_len(0), _resolved(false), _max_connections(max_connections),
+      _multiplex(multiplex), _event_loop(event_loop) {
+    memset(&_addr, 0, sizeof(_addr));
+    _resolved = resolveAddress(address, _addr, _addr_len);
+}
+
+FastCgiUpstream::~FastCgiUpstream() {
+    for (size_t i = 0; i < _connections.size(); ++i) {
+        FastCgiConnection* conn = _connections[i];
+        for (std::map<unsigned short, FastCgiRequest*>::iterator it = conn->requests.begin(); it != conn->requests.end(); ++it) {
+            delete it->second;
+        }
+        _event_loop->remove(conn->fd);
+        close(conn->fd);
+        delete conn;
+    }
+    for (size_t i = 0; i < _waiting.size(); ++i) {
+        delete _waiting[i];
+    }
+    deleteClosed();
+}
+
+bool FastCgiUpstream::resolveAddress(const std::string& address, sockaddr_storage& addr, socklen_t& addr_len) {
+    /**
+     * @brief Resolves a fastcgi_pass address: "unix:/path/to.sock" or "host:port".
+     * @return false if the address is malformed or the host cannot be resolved.
+     */
+    memset(&addr, 0, sizeof(addr));
+    if (address.compare(0, 5, "unix:") == 0) {
+        std::string path = address.substr(5);
+        sockaddr_un* un = reinterpret_cast<sockaddr_un*>(&addr);
+        if (path.empty() || path.length() >= sizeof(un->sun_path)) {
+            return false;
+        }
+        un->sun_family = AF_UNIX;
+        strncpy(un->sun_path, path.c_str(), sizeof(un->sun_path) - 1);
+        addr_len = sizeof(sockaddr_un);
+        return true;
+    }
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == address.length()
+        || address.find_first_not_of("0123456789", colon + 1) != std::string::npos) {
+        return false;
+    }
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = NULL;
+    if (getaddrinfo(address.substr(0, colon).c_str(), address.substr(colon + 1).c_str(), &hints, &result) != 0) {
+        return false;
+    }
+    memcpy(&addr, result->ai_addr, result->ai_addrlen);
+    addr_len = result->ai_addrlen;
+    freeaddrinfo(result);
+    return true;
+}
+
+bool FastCgiUpstream::submit(FastCgiRequest* request, std::vector<FastCgiRequest*>& finished) {
+    /**
+     * @brief Sends a request on a free connection, or queues it until one is free.
+     * The upstream owns the request until it is returned through finished.
+     * @return false if the application cannot be reached at all; the request is
+     * then still owned by the caller.
+     */
+    FastCgiConnection* conn = _pick_connection();
+    if (conn) {
+        _dispatch(*conn, request, finished);
+        return true;
+    }
+    if (_connections.empty()) {
+        return false;
+    }
+    _waiting.push_back(request);
+    return true;
+}
+
+FastCgiConnection* FastCgiUpstream::_pick_connection() {
+    for (size_t i = 0; i < _connections.size(); ++i) {
+        if (!_connections[i]->paused && _connections[i]->requests.size() < _connections[i]->capacity) {
+            return _connections[i];
+        }
+    }
+    if (_connections.size() < _max_connections) {
+        return _connect();
+    }
+    return NULL;
+}
+
+FastCgiConnection* FastCgiUpstream::_connect() {
+    if (!_resolved) {
+        return NULL;
+    }
+    int fd = socket(_addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        LOG(Logger::LEVEL_ERROR, "Cannot create socket for FastCGI " << _address << ": " << strerror(errno));
+        return NULL;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    bool connecting = false;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&_addr), _addr_len) < 0) {
+        if (errno != EINPROGRESS) {
+            LOG(Logger::LEVEL_ERROR, "Cannot connect to FastCGI " << _address << ": " << strerror(errno));
+            close(fd);
+            return NULL;
+        }
+        connecting = true;
+    }
+
+    FastCgiConnection* conn = new FastCgiConnection;
+    conn->upstream = this;
+    conn->fd = fd;
+    conn->target.type = EventTarget::FASTCGI;
+    conn->target.fd = fd;
+    conn->target.owner = conn;
+    conn->connecting = connecting;
+    conn->reused = false;
+    conn->paused = false;
+    conn->capacity = _multiplex;
+    conn->write_offset = 0;
+    _event_loop->add(fd, EventLoop::EVENT_READ | EventLoop::EVENT_WRITE, &conn->target);
+    _connections.push_back(conn);
+    return conn;
+}
+
+void FastCgiUpstream::_dispatch(FastCgiConnection& conn, FastCgiRequest* request, std::vector<FastCgiRequest*>& finished) {
+    // The lowest free id; ids only need to be unique among the connection's active requests
+    unsigned short id = 1;
+    while (conn.requests.count(id)) {
+        ++id;
+    }
+    conn.requests[id] = request;
+    request->encode(conn.write_buffer, id, conn.reused);
+    if (conn.connecting) {
+        return; // Sent once the connection is established
+    }
+    if (!_flush(conn)) {
+        _close(conn, finished);
+        return;
+    }
+    _update_events(conn);
+}
+
+void FastCgiUpstream::_dispatch_waiting(std::vector<FastCgiRequest*>& finished) {
+    while (!_waiting.empty()) {
+        FastCgiConnection* conn = _pick_connection();
+        if (!conn) {
+            if (_connections.empty()) {
+                // The application went away; nothing will pick these up
+                while (!_waiting.empty()) {
+                    _waiting.front()->fail();
+                    finished.push_back(_waiting.front());
+                    _waiting.pop_front();
+                }
+            }
+            return;
+        }
+        FastCgiRequest* request = _waiting.front();
+        _waiting.pop_front();
+        _dispatch(*conn, request, finished);
+    }
+}
+
+void FastCgiUpstream::handleEvent(FastCgiConnection& conn, int events, std::vector<FastCgiRequest*>& finished) {
+    /**
+     * @brief Drives a backend connection after a readiness notification: completes
+     * a pending connect(), reads and dispatches records until EAGAIN and sends
+     * queued requests.
+     */
+    if (conn.fd < 0) {
+        return; // Closed earlier in this loop iteration
+    }
+    if (conn.connecting) {
+        if (!(events & (EventLoop::EVENT_WRITE | EventLoop::EVENT_ERROR))) {
+            return;
+        }
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+            LOG(Logger::LEVEL_ERROR, "Cannot connect to FastCGI " << _address << ": " << strerror(error));
+            _close(conn, finished);
+            return;
+        }
+        conn.connecting = false;
+    }
+    if (!_read(conn, finished)) {
+        return;
+    }
+    if (!_flush(conn)) {
+        _close(conn, finished);
+        return;
+    }
+    _update_events(conn);
+    _dispatch_waiting(finished);
+}
+
+bool FastCgiUpstream::_flush(FastCgiConnection& conn) {
+    while (conn.write_offset < conn.write_buffer.length()) {
+        ssize_t sent = send(conn.fd, conn.write_buffer.data() + conn.write_offset,
+                            conn.write_buffer.length() - conn.write_offset, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        conn.write_offset += sent;
+    }
+    conn.write_buffer.clear();
+    conn.write_offset = 0;
+    return true;
+}
+
+bool FastCgiUpstream::_read(FastCgiConnection& conn, std::vector<FastCgiRequest*>& finished) {
+    /**
+     * @brief Reads until EAGAIN and handles every complete record.
+     * Reading stops early, and the connection is no longer watched, while one of
+     * its requests holds more output than its client has taken; the application
+     * then blocks on the full socket until resume().
+     * @return false if the connection was closed.
+     */
+    char buffer[16384];
+    while (true) {
+        bool throttled = false;
+        for (std::map<unsigned short, FastCgiRequest*>::iterator it = conn.requests.begin(); it != conn.requests.end(); ++it) {
+            if (it->second->isThrottled()) {
+                it->second->setPaused(true);
+                throttled = true;
+            }
+        }
+        if (throttled) {
+            _event_loop->remove(conn.fd);
+            conn.paused = true;
+            return true;
+        }
+        ssize_t bytes_read = recv(conn.fd, buffer, sizeof(buffer), 0);
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (bytes_read <= 0) {
+            _close(conn, finished);
+            return false;
+        }
+        conn.read_buffer.append(buffer, bytes_read);
+        size_t offset = 0;
+        FastCgiRecord record;
+        while (FastCgi::parseRecord(conn.read_buffer, offset, record)) {
+            _handle_record(conn, record, finished);
+        }
+        conn.read_buffer.erase(0, offset);
+    }
+}
+
+void FastCgiUpstream::_handle_record(FastCgiConnection& conn, const FastCgiRecord& record,
+                                     std::vector<FastCgiRequest*>& finished) {
+    std::map<unsigned short, FastCgiRequest*>::iterator it = conn.requests.find(record.request_id);
+    if (it == conn.requests.end()) {
+        return; // Management records and leftovers of aborted requests
+    }
+    FastCgiRequest* request = it->second;
+    if (record.type == FastCgi::STDOUT) {
+        request->appendOutput(record.content);
+    } else if (record.type == FastCgi::STDERR) {
+        if (!record.content.empty()) {
+            LOG(Logger::LEVEL_ERROR, "FastCGI " << _address << " stderr: " << record.content);
+        }
+    } else if (record.type == FastCgi::END_REQUEST) {
+        unsigned int app_status = 0;
+        unsigned char protocol_status = FastCgi::REQUEST_COMPLETE;
+        FastCgi::parseEndRequest(record.content, app_status, protocol_status);
+        conn.requests.erase(it);
+        conn.reused = true;
+        if (protocol_status == FastCgi::CANT_MPX_CONN) {
+            // The application handles one request per connection after all
+            LOG(Logger::LEVEL_WARN, "FastCGI " << _address << " cannot multiplex connections");
+            conn.capacity = 1;
+            _multiplex = 1;
+            if (!request->wasRetried()) {
+                request->setRetried();
+                _waiting.push_front(request);
+                return;
+            }
+        }
+        request->complete(app_status, protocol_status);
+        finished.push_back(request);
+    }
+}
+
+void FastCgiUpstream::_update_events(FastCgiConnection& conn) {
+    if (conn.paused) {
+        return;
+    }
+    // Write interest only while there is something to send, for level-triggered backends
+    int events = EventLoop::EVENT_READ;
+    if (conn.connecting || !conn.write_buffer.empty()) {
+        events |= EventLoop::EVENT_WRITE;
+    }
+    _event_loop->modify(conn.fd, events, &conn.target);
+}
+
+void FastCgiUpstream::_close(FastCgiConnection& conn, std::vector<FastCgiRequest*>& finished) {
+    /**
+     * @brief Closes a backend connection and fails the requests it was carrying.
+     * A request sent on a reused connection that produced no output yet is retried
+     * once, since the application may have closed the idle connection just as the
+     * request was written.
+     */
+    _event_loop->remove(conn.fd);
+    close(conn.fd);
+    conn.fd = -1;
+    conn.target.fd = -1;
+    for (size_t i = 0; i < _connections.size(); ++i) {
+        if (_connections[i] == &conn) {
+            _connections.erase(_connections.begin() + i);
+            break;
+        }
+    }
+    _closed.push_back(&conn);
+
+    for (std::map<unsigned short, FastCgiRequest*>::iterator it = conn.requests.begin(); it != conn.requests.end(); ++it) {
+        FastCgiRequest* request = it->second;
+        if (request->getConnection() && request->isOnReusedConnection() && !request->wasRetried()
+            && request->getOutput().empty()) {
+            request->setRetried();
+            _waiting.push_back(request);
+        } else {
+            request->fail();
+            finished.push_back(request);
+        }
+    }
+    conn.requests.clear();
+    _dispatch_waiting(finished);
+}
+
+void FastCgiUpstream::abort(FastCgiRequest* request, std::vector<FastCgiRequest*>& finished) {
+    /**
+     * @brief Withdraws a request whose client is gone or which timed out.
+     * A waiting request is returned right away. One already sent is detached and
+     * returned once the application ends it: a connection carrying only this
+     * request is closed, otherwise FCGI_ABORT_REQUEST is sent.
+     */
+    request->detach();
+    request->setPaused(false);
+    for (std::deque<FastCgiRequest*>::iterator it = _waiting.begin(); it != _waiting.end(); ++it) {
+        if (*it == request) {
+            _waiting.erase(it);
+            finished.push_back(request);
+            return;
+        }
+    }
+    FastCgiConnection* found = _find_connection(request);
+    if (found) {
+        FastCgiConnection& conn = *found;
+        if (conn.requests.size() == 1) {
+            _close(conn, finished);
+            return;
+        }
+        FastCgi::appendAbortRequest(conn.write_buffer, request->getRequestId());
+        if (!conn.connecting && !_flush(conn)) {
+            _close(conn, finished);
+            return;
+        }
+        if (conn.paused) {
+            resume(request); // It may have been the one holding the connection back
+        } else {
+            _update_events(conn);
+        }
+    }
+}
+
+void FastCgiUpstream::resume(FastCgiRequest* request) {
+    /**
+     * @brief Watches a paused connection again once none of its requests is throttled.
+     */
+    FastCgiConnection* conn = _find_connection(request);
+    if (!conn || !conn->paused) {
+        return;
+    }
+    for (std::map<unsigned short, FastCgiRequest*>::iterator it = conn->requests.begin(); it != conn->requests.end(); ++it) {
+        if (it->second->isPaused()) {
+            return;
+        }
+    }
+    conn->paused = false;
+    _event_loop->add(conn->fd, EventLoop::EVENT_READ | EventLoop::EVENT_WRITE, &conn->target);
+    _update_events(*conn);
+}
+
+FastCgiConnection* FastCgiUpstream::_find_connection(const FastCgiRequest* request) const {
+    for (size_t i = 0; i < _connections.size(); ++i) {
+        std::map<unsigned short, FastCgiRequest*>::const_iterator it = _connections[i]->requests.find(request->getRequestId());
+        if (it != _connections[i]->requests.end() && it->second == request) {
+            return _connections[i];
+        }
+    }
+    return NULL;
+}
+
+void FastCgiUpstream::deleteClosed() {
+    for (size_t i = 0; i < _closed.size(); ++i) {
+        delete _closed[i];
+    }
+    _closed.clear();
+}
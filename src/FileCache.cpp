@@ -0,0 +1,75 @@
+#include "FileCache.hpp"
+#include <sys/stat.h>
+
+FileCache::FileCache(size_t max_entries, int valid_seconds)
+    : _max_entries(max_entries), _valid_seconds(valid_seconds), _hits(0), _misses(0) {}
+
+FileCache::~FileCache() {
+    while (!_entries.empty()) {
+        _erase(_entries.begin());
+    }
+}
+
+CachedFile* FileCache::get(const std::string& path) {
+    /**
+     * @brief Returns the open file and metadata for a path, from the cache when possible.
+     * Entries past their validity period are revalidated with a single stat() and
+     * kept if inode, size and mtime are unchanged.
+     * @param path The resolved filesystem path.
+     * @return A CachedFile with one reference owned by the caller, who must release() it.
+     */
+    time_t now = time(NULL);
+    std::map<std::string, Entry>::iterator it = _entries.find(path);
+    if (it != _entries.end()) {
+        Entry& entry = it->second;
+        bool valid = now - entry.validated < _valid_seconds;
+        if (!valid) {
+            struct stat s;
+            bool found = stat(path.c_str(), &s) == 0;
+            valid = found ? entry.file->matches(s) : !entry.file->exists();
+            if (valid) {
+                entry.validated = now;
+            }
+        }
+        if (valid) {
+            _hits++;
+            _lru.splice(_lru.begin(), _lru, entry.lru_pos);
+            entry.file->retain();
+            return entry.file;
+        }
+        _erase(it);
+    }
+
+    _misses++;
+    CachedFile* file = CachedFile::open(path);
+    if (_max_entries == 0) {
+        return file;
+    }
+    if (_entries.size() >= _max_entries) {
+        _erase(_entries.find(*_lru.back()));
+    }
+    it = _entries.insert(std::make_pair(path, Entry())).first;
+    it->second.file = file;
+    it->second.validated = now;
+    _lru.push_front(&it->first);
+    it->second.lru_pos = _lru.begin();
+    file->retain(); // One reference for the cache, one for the caller
+    return file;
+}
+
+void FileCache::invalidate(const std::string& path) {
+    std::map<std::string, Entry>::iterator it = _entries.find(path);
+    if (it != _entries.end()) {
+        _erase(it);
+    }
+}
+
+void FileCache::_erase(std::map<std::string, Entry>::iterator it) {
+    _lru.erase(it->second.lru_pos);
+    it->second.file->release(); // Responses still streaming keep their own reference
+    _entries.erase(it);
+}
+
+size_t FileCache::getHits() const { return _hits; }
+size_t FileCache::getMisses() const { return _misses; }
+size_t FileCache::size() const { return _entries.size(); }
@@ -0,0 +1,53 @@
+#include "GlobalConfig.hpp"
+#include "AccessLog.hpp"
+
+GlobalConfig::GlobalConfig() : _event_backend("auto"), _worker_processes(1),
+    _open_file_cache_max(0), _open_file_cache_valid(60),
+    _static_cache_size(0), _static_cache_max_file_size(64 * 1024), _cgi_max_processes(64),
+    _worker_connections(1024), _accept_batch(64), _limit_conn_per_ip(0),
+    _error_log_path("stderr"), _error_log_level(Logger::LEVEL_NOTICE), _log_format(AccessLog::DEFAULT_FORMAT) {}
+
+GlobalConfig::~GlobalConfig() {}
+
+void GlobalConfig::setEventBackend(const std::string& backend) { _event_backend = backend; }
+const std::string& GlobalConfig::getEventBackend() const { return _event_backend; }
+
+void GlobalConfig::setWorkerProcesses(int count) { _worker_processes = count; }
+int GlobalConfig::getWorkerProcesses() const { return _worker_processes; }
+
+void GlobalConfig::setOpenFileCache(size_t max_entries, int valid_seconds) {
+    _open_file_cache_max = max_entries;
+    _open_file_cache_valid = valid_seconds;
+}
+size_t GlobalConfig::getOpenFileCacheMax() const { return _open_file_cache_max; }
+int GlobalConfig::getOpenFileCacheValid() const { return _open_file_cache_valid; }
+
+void GlobalConfig::setStaticCacheSize(size_t bytes) { _static_cache_size = bytes; }
+size_t GlobalConfig::getStaticCacheSize() const { return _static_cache_size; }
+
+void GlobalConfig::setStaticCacheMaxFileSize(size_t bytes) { _static_cache_max_file_size = bytes; }
+size_t GlobalConfig::getStaticCacheMaxFileSize() const { return _static_cache_max_file_size; }
+
+void GlobalConfig::setCgiMaxProcesses(size_t count) { _cgi_max_processes = count; }
+size_t GlobalConfig::getCgiMaxProcesses() const { return _cgi_max_processes; }
+
+void GlobalConfig::setWorkerConnections(size_t count) { _worker_connections = count; }
+size_t GlobalConfig::getWorkerConnections() const { return _worker_connections; }
+
+void GlobalConfig::setAcceptBatch(size_t count) { _accept_batch = count; }
+size_t GlobalConfig::getAcceptBatch() const { return _accept_batch; }
+
+void GlobalConfig::setLimitConnPerIp(size_t count) { _limit_conn_per_ip = count; }
+size_t GlobalConfig::getLimitConnPerIp() const { return _limit_conn_per_ip; }
+
+void GlobalConfig::setErrorLog(const std::string& path, Logger::Level level) {
+    _error_log_path = path;
+    _error_log_level = level;
+}
+const std::string& GlobalConfig::getErrorLogPath() const { return _error_log_path; }
+Logger::Level GlobalConfig::getErrorLogLevel() const { return _error_log_level; }
+
+void GlobalConfig::setAccessLog(const std::string& path) { _access_log = path; }
+const std::string& GlobalConfig::getAccessLog() const { return _access_log; }
+void GlobalConfig::setLogFormat(const std::string& format) { _log_format = format; }
+const std::string& GlobalConfig::getLogFormat() const { return _log_format; }
@@ -0,0 +1,38 @@
+#include "Gzip.hpp"
+#include <zlib.h>
+
+// windowBits above 15 makes deflate write a gzip header and trailer instead of zlib's
+static const int GZIP_WINDOW_BITS = 15 + 16;
+static const int MEMORY_LEVEL = 8;
+
+bool Gzip::compress(const char* data, size_t length, int level, std::string& out) {
+    /**
+     * @brief Compresses a buffer into a complete gzip member.
+     * @param level zlib compression level, 1 (fastest) to 9 (smallest).
+     * @param out Receives the compressed bytes; its previous contents are replaced.
+     * @return false if zlib failed, in which case out is left empty.
+     */
+    out.clear();
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    if (deflateInit2(&stream, level, Z_DEFLATED, GZIP_WINDOW_BITS, MEMORY_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    // deflateBound() is enough for the whole output, so one Z_FINISH call completes it
+    out.resize(deflateBound(&stream, static_cast<uLong>(length)));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = static_cast<uInt>(length);
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+    int status = deflate(&stream, Z_FINISH);
+    size_t produced = out.size() - stream.avail_out;
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        out.clear();
+        return false;
+    }
+    out.resize(produced);
+    return true;
+}
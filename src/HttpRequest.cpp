@@ -1,114 +1,429 @@
 #include "HttpRequest.hpp"
-#include <sstream>
-#include <stdexcept>
-#include <algorithm> // for std::transform
+#include <cstring> // for memchr, memset
 
-HttpRequest::HttpRequest() {}
+// A request head larger than this is rejected instead of buffered further
+static const size_t MAX_HEADER_SIZE = 32768;
+static const size_t MAX_HEADER_COUNT = 100;
 
-HttpRequest::~HttpRequest() {}
+struct KnownHeader {
+    const char* name;
+    size_t length;
+    HttpRequest::HeaderId id;
+};
 
-void HttpRequest::parse(const std::string& raw_request) {
-    std::istringstream iss(raw_request);
-    std::string line;
+// Lower-case names of the headers that get their own slot, see HttpRequest::HeaderId
+static const KnownHeader KNOWN_HEADERS[] = {
+    { "host", 4, HttpRequest::HEADER_HOST },
+    { "connection", 10, HttpRequest::HEADER_CONNECTION },
+    { "content-length", 14, HttpRequest::HEADER_CONTENT_LENGTH },
+    { "transfer-encoding", 17, HttpRequest::HEADER_TRANSFER_ENCODING },
+    { "content-type", 12, HttpRequest::HEADER_CONTENT_TYPE },
+    { "expect", 6, HttpRequest::HEADER_EXPECT },
+    { "if-none-match", 13, HttpRequest::HEADER_IF_NONE_MATCH },
+    { "if-modified-since", 17, HttpRequest::HEADER_IF_MODIFIED_SINCE },
+    { "if-range", 8, HttpRequest::HEADER_IF_RANGE },
+    { "range", 5, HttpRequest::HEADER_RANGE },
+    { "accept-encoding", 15, HttpRequest::HEADER_ACCEPT_ENCODING }
+};
 
-    // Parse request line
-    if (std::getline(iss, line) && !line.empty()) {
-        _parse_request_line(line);
-    } else {
-        throw std::runtime_error("Malformed request: missing request line");
+static char lowerAscii(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+static bool equalsIgnoreCase(const char* a, const char* b, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        if (lowerAscii(a[i]) != lowerAscii(b[i])) {
+            return false;
+        }
     }
+    return true;
+}
 
-    // Parse headers
-    while (std::getline(iss, line) && line != "\r") {
-        if (line.empty() || line == "\r") break; // End of headers
-        _parse_header_line(line);
+static bool isTokenChar(unsigned char c) {
+    // RFC 9110 tchar
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+        return true;
     }
+    return c != 0 && std::strchr("!#$%&'*+-.^_`|~", c) != NULL;
+}
+
+HttpRequest::HttpRequest() {
+    _fields.reserve(32);
+    reset();
+}
 
-    // Parse body (if any)
-    std::string transfer_encoding = getHeader("transfer-encoding");
-    std::string content_length_str = getHeader("content-length");
+HttpRequest::~HttpRequest() {}
+
+void HttpRequest::reset() {
+    /**
+     * @brief Prepares the object for the next request on the same connection.
+     * Strings and vectors are cleared rather than released so their storage is reused.
+     */
+    _buffer = NULL;
+    _stage = STAGE_REQUEST_LINE;
+    _parse_pos = 0;
+    _line_start = 0;
+    _error_status = 0;
+    _method.clear();
+    _uri.clear();
+    _http_version.clear();
+    _fields.clear();
+    for (int i = 0; i < HEADER_COUNT; ++i) {
+        _known_fields[i] = -1;
+        _known_values[i].clear();
+    }
+    _chunked = false;
+    _content_length = 0;
+}
+
+HttpRequest::ParseStatus HttpRequest::parse(const std::string& buffer) {
+    /**
+     * @brief Parses the request line and headers from the start of buffer.
+     * Each byte is examined once: a call after more data was appended continues at
+     * the first unscanned byte. Lines may end in CRLF or a bare LF.
+     * @param buffer The connection's read buffer; the request must start at offset 0.
+     * @return PARSE_COMPLETE once the headers are complete, PARSE_INCOMPLETE if more
+     * data is needed, PARSE_ERROR if the request is malformed (see getErrorStatus()).
+     */
+    _buffer = &buffer;
+    if (_stage == STAGE_DONE) {
+        return _error_status ? PARSE_ERROR : PARSE_COMPLETE;
+    }
+    const char* data = buffer.data();
+    while (true) {
+        const char* newline = static_cast<const char*>(memchr(data + _parse_pos, '\n', buffer.length() - _parse_pos));
+        if (!newline) {
+            _parse_pos = buffer.length();
+            if (_parse_pos > MAX_HEADER_SIZE) {
+                return _fail(_stage == STAGE_REQUEST_LINE ? 414 : 431);
+            }
+            return PARSE_INCOMPLETE;
+        }
+        size_t line_start = _line_start;
+        size_t line_end = newline - data;
+        _parse_pos = line_end + 1;
+        _line_start = _parse_pos;
+        if (_parse_pos > MAX_HEADER_SIZE) {
+            return _fail(431);
+        }
+        if (line_end > line_start && data[line_end - 1] == '\r') {
+            line_end--;
+        }
+        size_t length = line_end - line_start;
 
-    if (transfer_encoding == "chunked") {
-        // Handle chunked body
-        std::string chunk_size_str;
-        while (std::getline(iss, chunk_size_str) && !chunk_size_str.empty()) {
-            std::stringstream ss(chunk_size_str);
-            size_t chunk_size;
-            ss >> std::hex >> chunk_size;
-            if (chunk_size == 0) {
-                std::getline(iss, line); // Read the final CRLF
-                break;
+        if (_stage == STAGE_REQUEST_LINE) {
+            if (length == 0) {
+                continue; // Empty lines before the request line are ignored
             }
-            char* chunk_buffer = new char[chunk_size + 1];
-            iss.read(chunk_buffer, chunk_size);
-            chunk_buffer[chunk_size] = '\0';
-            _body += chunk_buffer;
-            delete[] chunk_buffer;
-            std::getline(iss, line); // Read the CRLF after the chunk data
-        }
-    } else if (!content_length_str.empty()) {
-        // Handle non-chunked body with Content-Length
-        size_t content_length = static_cast<size_t>(std::atol(content_length_str.c_str()));
-        if (content_length > 0) {
-            std::string body_buffer(content_length, '\0');
-            iss.read(&body_buffer[0], content_length);
-            _body = body_buffer;
+            if (!_parse_request_line(data + line_start, length)) {
+                return PARSE_ERROR;
+            }
+            _stage = STAGE_HEADERS;
+        } else if (length == 0) {
+            _stage = STAGE_DONE;
+            return _finish_headers() ? PARSE_COMPLETE : PARSE_ERROR;
+        } else if (!_parse_header_line(line_start, length)) {
+            return PARSE_ERROR;
+        }
+    }
+}
+
+HttpRequest::ParseStatus HttpRequest::_fail(int status) {
+    _error_status = status;
+    _stage = STAGE_DONE;
+    return PARSE_ERROR;
+}
+
+bool HttpRequest::_parse_request_line(const char* line, size_t length) {
+    /**
+     * @brief Splits "METHOD SP request-target SP HTTP-version" and validates each part.
+     */
+    const char* end = line + length;
+    const char* method_end = static_cast<const char*>(memchr(line, ' ', length));
+    if (!method_end || method_end == line) {
+        _fail(400);
+        return false;
+    }
+    for (const char* p = line; p < method_end; ++p) {
+        if (!isTokenChar(*p)) {
+            _fail(400);
+            return false;
+        }
+    }
+    const char* uri_start = method_end + 1;
+    const char* uri_end = static_cast<const char*>(memchr(uri_start, ' ', end - uri_start));
+    if (!uri_end || uri_end == uri_start) {
+        _fail(400);
+        return false;
+    }
+    for (const char* p = uri_start; p < uri_end; ++p) {
+        if (static_cast<unsigned char>(*p) <= 0x20 || *p == 0x7f) {
+            _fail(400);
+            return false;
+        }
+    }
+    const char* version = uri_end + 1;
+    size_t version_length = end - version;
+    if (version_length != 8 || std::strncmp(version, "HTTP/1.", 7) != 0 || (version[7] != '0' && version[7] != '1')) {
+        _fail(version_length > 5 && std::strncmp(version, "HTTP/", 5) == 0 ? 505 : 400);
+        return false;
+    }
+    _method.assign(line, method_end - line);
+    _uri.assign(uri_start, uri_end - uri_start);
+    _http_version.assign(version, version_length);
+    return true;
+}
+
+bool HttpRequest::_parse_header_line(size_t offset, size_t length) {
+    /**
+     * @brief Records one "name: value" line as a view into the buffer.
+     * Known headers are also copied into their slot. Repeated list headers are joined
+     * with ", "; a repeated Host, or Content-Length with a different value, is an error.
+     * @param offset Where the line starts in the buffer.
+     * @param length Line length without the line break.
+     */
+    const char* line = _buffer->data() + offset;
+    const char* colon = static_cast<const char*>(memchr(line, ':', length));
+    if (!colon || colon == line) {
+        _fail(400); // Also rejects obsolete line folding, which starts with whitespace
+        return false;
+    }
+    for (const char* p = line; p < colon; ++p) {
+        if (!isTokenChar(*p)) {
+            _fail(400);
+            return false;
+        }
+    }
+    if (_fields.size() >= MAX_HEADER_COUNT) {
+        _fail(431);
+        return false;
+    }
+
+    size_t value_start = colon - line + 1;
+    size_t value_end = length;
+    while (value_start < value_end && (line[value_start] == ' ' || line[value_start] == '\t')) value_start++;
+    while (value_end > value_start && (line[value_end - 1] == ' ' || line[value_end - 1] == '\t')) value_end--;
+
+    HeaderField field;
+    field.name_offset = offset;
+    field.name_length = colon - line;
+    field.value_offset = offset + value_start;
+    field.value_length = value_end - value_start;
+    _fields.push_back(field);
+
+    int id = _lookup_known_header(line, field.name_length);
+    if (id < 0) {
+        return true;
+    }
+    const char* value = line + value_start;
+    if (_known_fields[id] < 0) {
+        _known_fields[id] = static_cast<int>(_fields.size() - 1);
+        _known_values[id].assign(value, field.value_length);
+    } else if (id == HEADER_HOST || id == HEADER_CONTENT_LENGTH) {
+        if (_known_values[id].compare(0, std::string::npos, value, field.value_length) != 0) {
+            _fail(400);
+            return false;
         }
     } else {
-        // No Content-Length or Transfer-Encoding, body is empty
-        _body = "";
+        _known_values[id].append(", ");
+        _known_values[id].append(value, field.value_length);
     }
+    return true;
 }
 
+bool HttpRequest::_finish_headers() {
+    /**
+     * @brief Validates the message framing once all headers are known.
+     * Transfer-Encoding must be exactly "chunked" and may not be combined with
+     * Content-Length, which would make the body length ambiguous.
+     */
+    if (_http_version == "HTTP/1.1" && _known_fields[HEADER_HOST] < 0) {
+        _fail(400);
+        return false;
+    }
+    const std::string& transfer_encoding = _known_values[HEADER_TRANSFER_ENCODING];
+    const std::string& content_length = _known_values[HEADER_CONTENT_LENGTH];
+    if (_known_fields[HEADER_TRANSFER_ENCODING] >= 0) {
+        if (_known_fields[HEADER_CONTENT_LENGTH] >= 0) {
+            _fail(400);
+            return false;
+        }
+        if (transfer_encoding.length() != 7 || !equalsIgnoreCase(transfer_encoding.data(), "chunked", 7)) {
+            _fail(501);
+            return false;
+        }
+        _chunked = true;
+    } else if (_known_fields[HEADER_CONTENT_LENGTH] >= 0) {
+        if (content_length.empty() || content_length.length() > 18
+            || content_length.find_first_not_of("0123456789") != std::string::npos) {
+            _fail(400);
+            return false;
+        }
+        for (size_t i = 0; i < content_length.length(); ++i) {
+            _content_length = _content_length * 10 + (content_length[i] - '0');
+        }
+    }
+    return true;
+}
+
+int HttpRequest::_lookup_known_header(const char* name, size_t length) {
+    for (size_t i = 0; i < sizeof(KNOWN_HEADERS) / sizeof(KNOWN_HEADERS[0]); ++i) {
+        if (KNOWN_HEADERS[i].length == length && equalsIgnoreCase(name, KNOWN_HEADERS[i].name, length)) {
+            return KNOWN_HEADERS[i].id;
+        }
+    }
+    return -1;
+}
+
+int HttpRequest::getErrorStatus() const { return _error_status; }
+size_t HttpRequest::getHeaderLength() const { return _stage == STAGE_DONE ? _parse_pos : 0; }
 const std::string& HttpRequest::getMethod() const { return _method; }
 const std::string& HttpRequest::getUri() const { return _uri; }
 const std::string& HttpRequest::getHttpVersion() const { return _http_version; }
+const std::string& HttpRequest::getHeader(HeaderId id) const { return _known_values[id]; }
+size_t HttpRequest::getHeaderCount() const { return _fields.size(); }
+bool HttpRequest::isChunked() const { return _chunked; }
+size_t HttpRequest::getContentLength() const { return _content_length; }
 
-const std::string& HttpRequest::getHeader(const std::string& name) const {
-    std::string lower_name = name;
-    std::transform(lower_name.begin(), lower_name.end(), lower_name.begin(), ::tolower);
-    std::map<std::string, std::string>::const_iterator it = _headers.find(lower_name);
-    if (it != _headers.end()) {
-        return it->second;
-    }
-    static const std::string empty_string = "";
-    return empty_string;
+std::string HttpRequest::getHeaderName(size_t index) const {
+    return _buffer->substr(_fields[index].name_offset, _fields[index].name_length);
 }
 
-const std::string& HttpRequest::getBody() const { return _body; }
+std::string HttpRequest::getHeaderValue(size_t index) const {
+    return _buffer->substr(_fields[index].value_offset, _fields[index].value_length);
+}
 
-void HttpRequest::_parse_request_line(const std::string& line) {
-    std::istringstream iss(line);
-    iss >> _method >> _uri >> _http_version;
-    if (_method.empty() || _uri.empty() || _http_version.empty()) {
-        throw std::runtime_error("Malformed request line");
+time_t HttpRequest::parseHttpDate(const std::string& value) {
+    /**
+     * @brief Parses an IMF-fixdate such as the value of If-Modified-Since.
+     * @param value The header value.
+     * @return The timestamp, or -1 if the value is not a valid date.
+     */
+    struct tm tm_utc;
+    memset(&tm_utc, 0, sizeof(tm_utc));
+    const char* end = strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm_utc);
+    if (!end || *end != '\0') {
+        return -1;
+    }
+    return timegm(&tm_utc);
+}
+
+static off_t parseOffset(const std::string& digits) {
+    // getByteRanges() rejects positions longer than 18 digits, so this cannot overflow
+    off_t value = 0;
+    for (size_t i = 0; i < digits.length(); ++i) {
+        value = value * 10 + (digits[i] - '0');
     }
+    return value;
 }
 
-void HttpRequest::_parse_header_line(const std::string& line) {
+bool HttpRequest::getByteRanges(off_t entity_size, std::vector<ByteRange>& ranges) const {
     /**
-     * @brief Parses a single HTTP header line.
-     * Extracts header name and value, and stores them in a map.
-     * Header names are converted to lowercase for case-insensitive lookup.
-     * @param line The header line string.
-     * @throws std::runtime_error if the header line is malformed.
+     * @brief Resolves the Range header against an entity of the given size.
+     * Ranges that start past the end are dropped; an empty result with a true return
+     * value means that nothing is satisfiable (416). Suffix ranges ("-500") and open
+     * ranges ("9500-") are clamped to the entity.
+     * @param entity_size Size of the selected representation in bytes.
+     * @param ranges Receives the satisfiable ranges in request order.
+     * @return false if there is no Range header or it is not a well-formed bytes range
+     * with at least one range-spec, in which case the header must be ignored and the
+     * full entity sent.
      */
-    size_t colon_pos = line.find(':');
-    if (colon_pos == std::string::npos) {
-        throw std::runtime_error("Malformed header line: " + line);
-    }
-    std::string name = line.substr(0, colon_pos);
-    std::string value = line.substr(colon_pos + 1);
-
-    // Trim whitespace from value
-    size_t first_char = value.find_first_not_of(" \t\r\n");
-    size_t last_char = value.find_last_not_of(" \t\r\n");
-    if (std::string::npos == first_char) {
-        value = "";
-    } else {
-        value = value.substr(first_char, (last_char - first_char + 1));
+    ranges.clear();
+    const std::string& header = getHeader(HEADER_RANGE);
+    if (header.compare(0, 6, "bytes=") != 0) {
+        return false;
+    }
+    size_t pos = 6;
+    bool has_spec = false;
+    while (pos <= header.length()) {
+        size_t end = header.find(',', pos);
+        if (end == std::string::npos) end = header.length();
+        size_t first_char = header.find_first_not_of(" \t", pos);
+        if (first_char == std::string::npos || first_char >= end) {
+            pos = end + 1; // Empty list elements are allowed
+            continue;
+        }
+        has_spec = true;
+        size_t last_char = header.find_last_not_of(" \t", end - 1);
+        std::string spec = header.substr(first_char, last_char - first_char + 1);
+        size_t dash = spec.find('-');
+        if (dash == std::string::npos || spec.find_first_not_of("0123456789-") != std::string::npos
+            || spec.find('-', dash + 1) != std::string::npos || dash > 18 || spec.length() - dash - 1 > 18) {
+            ranges.clear();
+            return false;
+        }
+        std::string first_str = spec.substr(0, dash);
+        std::string last_str = spec.substr(dash + 1);
+        ByteRange range;
+        if (first_str.empty()) {
+            // Suffix range: the final N bytes
+            if (last_str.empty()) {
+                ranges.clear();
+                return false;
+            }
+            off_t suffix = parseOffset(last_str);
+            if (suffix > 0 && entity_size > 0) {
+                range.first = suffix < entity_size ? entity_size - suffix : 0;
+                range.last = entity_size - 1;
+                ranges.push_back(range);
+            }
+        } else {
+            range.first = parseOffset(first_str);
+            range.last = last_str.empty() ? entity_size - 1 : parseOffset(last_str);
+            if (!last_str.empty() && range.last < range.first) {
+                ranges.clear();
+                return false;
+            }
+            if (range.first < entity_size) {
+                if (range.last >= entity_size) range.last = entity_size - 1;
+                ranges.push_back(range);
+            }
+        }
+        pos = end + 1;
     }
+    return has_spec; // "bytes=" alone, or only commas, names no range at all
+}
+
+bool HttpRequest::acceptsEncoding(const std::string& coding) const {
+    /**
+     * @brief Evaluates Accept-Encoding for a content coding such as "gzip".
+     * A listed coding is acceptable unless its quality is zero; otherwise a "*"
+     * entry decides. "x-gzip" is treated as an alias of gzip.
+     * @param coding The coding in lower case.
+     * @return true if the client accepts a response in that coding.
+     */
+    const std::string& header = getHeader(HEADER_ACCEPT_ENCODING);
+    int wildcard = -1; // -1 without a "*" entry, else 0 or 1 for its acceptance
+    size_t pos = 0;
+    while (pos < header.length()) {
+        size_t end = header.find(',', pos);
+        if (end == std::string::npos) end = header.length();
+        std::string element = header.substr(pos, end - pos);
+        pos = end + 1;
 
-    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
-    _headers[name] = value;
+        size_t semicolon = element.find(';');
+        std::string name = element.substr(0, semicolon);
+        size_t first = name.find_first_not_of(" \t");
+        if (first == std::string::npos) continue;
+        name = name.substr(first, name.find_last_not_of(" \t") - first + 1);
+        for (size_t i = 0; i < name.length(); ++i) {
+            name[i] = lowerAscii(name[i]);
+        }
+        if (name == "x-gzip") name = "gzip";
+
+        // Only q=0 (with any number of zero decimals) refuses a coding
+        bool accepted = true;
+        if (semicolon != std::string::npos) {
+            size_t q = element.find_first_not_of(" \t", semicolon + 1);
+            if (q != std::string::npos && lowerAscii(element[q]) == 'q' && element.compare(q + 1, 1, "=") == 0) {
+                std::string value = element.substr(q + 2);
+                value = value.substr(0, value.find_first_of(" \t"));
+                accepted = value.find_first_not_of("0.") != std::string::npos;
+            }
+        }
+        if (name == coding) return accepted;
+        if (name == "*") wildcard = accepted ? 1 : 0;
+    }
+    return wildcard == 1;
 }
@@ -1,61 +1,270 @@
 #include "HttpResponse.hpp"
-#include <sstream>
 
-HttpResponse::HttpResponse() : _status_code(200) {}
+HttpResponse::HttpResponse() : _status_code(200), _body_file(NULL), _body_length(0), _rendered(NULL),
+      _close_delimited(false) {}
 
-HttpResponse::~HttpResponse() {}
+HttpResponse::~HttpResponse() {
+    _close_body_file();
+    _drop_rendered();
+}
 
 void HttpResponse::setStatusCode(int code) { _status_code = code; }
+int HttpResponse::getStatusCode() const { return _status_code; }
 void HttpResponse::setHeader(const std::string& name, const std::string& value) { _headers[name] = value; }
-void HttpResponse::setBody(const std::string& body) { _body = body; }
 
-std::string HttpResponse::toString() const {
+const std::string& HttpResponse::getHeader(const std::string& name) const {
+    std::map<std::string, std::string>::const_iterator it = _headers.find(name);
+    if (it != _headers.end()) {
+        return it->second;
+    }
+    static const std::string empty_string = "";
+    return empty_string;
+}
+
+void HttpResponse::setBody(const std::string& body) {
+    _close_body_file();
+    _drop_rendered();
+    _body = body;
+}
+
+void HttpResponse::setRendered(SharedBuffer* rendered) {
+    _close_body_file();
+    _drop_rendered();
+    _body.clear();
+    _rendered = rendered;
+}
+
+bool HttpResponse::hasRendered() const { return _rendered != NULL; }
+
+SharedBuffer* HttpResponse::releaseRendered() {
+    SharedBuffer* rendered = _rendered;
+    _rendered = NULL;
+    return rendered;
+}
+
+void HttpResponse::_drop_rendered() {
+    if (_rendered) {
+        _rendered->release();
+        _rendered = NULL;
+    }
+}
+
+void HttpResponse::setBodyFile(CachedFile* file, off_t offset, size_t length) {
     /**
-     * @brief Converts the HttpResponse object into a raw HTTP response string.
-     * Includes status line, headers, and body (handling chunked transfer encoding if specified).
-     * @return The complete raw HTTP response string.
+     * @brief Makes a file the body of the response. With a non-zero length the region
+     * starting at offset becomes the first range; more can follow via addBodyFileRange().
      */
-    std::stringstream ss;
-    ss << "HTTP/1.1 " << _status_code << " ";
-    switch (_status_code) {
-        case 200: ss << "OK"; break;
-        case 201: ss << "Created"; break;
-        case 204: ss << "No Content"; break;
-        case 400: ss << "Bad Request"; break;
-        case 403: ss << "Forbidden"; break;
-        case 404: ss << "Not Found"; break;
-        case 405: ss << "Method Not Allowed"; break;
-        case 413: ss << "Payload Too Large"; break;
-        case 500: ss << "Internal Server Error"; break;
-        case 501: ss << "Not Implemented"; break;
-        default: ss << ""; break;
+    _close_body_file();
+    _body.clear();
+    _body_file = file;
+    _body_ranges.clear();
+    _body_epilogue.clear();
+    _body_length = 0;
+    if (length > 0) {
+        addBodyFileRange("", offset, length);
     }
-    ss << "\r\n";
+}
 
+void HttpResponse::addBodyFileRange(const std::string& preamble, off_t offset, size_t length) {
+    BodyFileRange range;
+    range.preamble = preamble;
+    range.offset = offset;
+    range.length = length;
+    _body_ranges.push_back(range);
+    _body_length += preamble.length() + length;
+}
 
-    // Add Content-Length if not already set and body exists
-    if (_headers.find("Content-Length") == _headers.end() && !_body.empty() && _headers.find("Transfer-Encoding") == _headers.end()) {
-        ss << "Content-Length: " << _body.length() << "\r\n";
-    }
+void HttpResponse::setBodyEpilogue(const std::string& epilogue) {
+    _body_length = _body_length - _body_epilogue.length() + epilogue.length();
+    _body_epilogue = epilogue;
+}
 
-    for (std::map<std::string, std::string>::const_iterator it = _headers.begin(); it != _headers.end(); ++it) {
-        ss << it->first << ": " << it->second << "\r\n";
+bool HttpResponse::hasBodyFile() const { return _body_file != NULL; }
+const std::vector<BodyFileRange>& HttpResponse::getBodyFileRanges() const { return _body_ranges; }
+const std::string& HttpResponse::getBodyEpilogue() const { return _body_epilogue; }
+
+CachedFile* HttpResponse::releaseBodyFile() {
+    CachedFile* file = _body_file;
+    _body_file = NULL;
+    return file;
+}
+
+void HttpResponse::_close_body_file() {
+    if (_body_file) {
+        _body_file->release();
+        _body_file = NULL;
     }
-    ss << "\r\n"; // End of headers
+}
+
+void HttpResponse::setCloseDelimited(bool close_delimited) { _close_delimited = close_delimited; }
+
+// Complete status lines, so serializing one is a single append
+struct StatusLine {
+    int code;
+    const char* line;
+    size_t length;
+};
 
-    if (_headers.find("Transfer-Encoding") != _headers.end() && _headers.at("Transfer-Encoding") == "chunked") {
-        // Send body in chunks
-        size_t chunk_size = 1024; // Example chunk size
-        for (size_t i = 0; i < _body.length(); i += chunk_size) {
-            size_t current_chunk_size = std::min(chunk_size, _body.length() - i);
-            ss << std::hex << current_chunk_size << "\r\n";
-            ss << _body.substr(i, current_chunk_size) << "\r\n";
+#define STATUS_LINE(code, text) { code, "HTTP/1.1 " #code " " text "\r\n", sizeof("HTTP/1.1 " #code " " text "\r\n") - 1 }
+static const StatusLine STATUS_LINES[] = {
+    STATUS_LINE(200, "OK"),
+    STATUS_LINE(201, "Created"),
+    STATUS_LINE(204, "No Content"),
+    STATUS_LINE(206, "Partial Content"),
+    STATUS_LINE(301, "Moved Permanently"),
+    STATUS_LINE(302, "Found"),
+    STATUS_LINE(303, "See Other"),
+    STATUS_LINE(304, "Not Modified"),
+    STATUS_LINE(307, "Temporary Redirect"),
+    STATUS_LINE(308, "Permanent Redirect"),
+    STATUS_LINE(400, "Bad Request"),
+    STATUS_LINE(403, "Forbidden"),
+    STATUS_LINE(404, "Not Found"),
+    STATUS_LINE(405, "Method Not Allowed"),
+    STATUS_LINE(413, "Payload Too Large"),
+    STATUS_LINE(414, "URI Too Long"),
+    STATUS_LINE(416, "Range Not Satisfiable"),
+    STATUS_LINE(431, "Request Header Fields Too Large"),
+    STATUS_LINE(500, "Internal Server Error"),
+    STATUS_LINE(501, "Not Implemented"),
+    STATUS_LINE(502, "Bad Gateway"),
+    STATUS_LINE(503, "Service Unavailable"),
+    STATUS_LINE(504, "Gateway Timeout"),
+    STATUS_LINE(505, "HTTP Version Not Supported")
+};
+#undef STATUS_LINE
+// "HTTP/1.1 200 " before the reason phrase, "\r\n" after it
+static const size_t REASON_OFFSET = 13;
+
+static const StatusLine* findStatusLine(int code) {
+    const size_t count = sizeof(STATUS_LINES) / sizeof(STATUS_LINES[0]);
+    for (size_t i = 0; i < count; ++i) {
+        if (STATUS_LINES[i].code == code) {
+            return &STATUS_LINES[i];
         }
-        ss << "0\r\n\r\n"; // End of chunks
+    }
+    return NULL;
+}
+
+std::string HttpResponse::getReasonPhrase(int code) {
+    /**
+     * @return The reason phrase of a status line the server sends, or an empty string.
+     */
+    const StatusLine* status = findStatusLine(code);
+    if (!status) {
+        return "";
+    }
+    return std::string(status->line + REASON_OFFSET, status->length - REASON_OFFSET - 2);
+}
+
+static void appendDecimal(std::string& out, size_t value) {
+    char digits[24];
+    size_t pos = sizeof(digits);
+    do {
+        digits[--pos] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    out.append(digits + pos, sizeof(digits) - pos);
+}
+
+void HttpResponse::releaseBody(std::string& body) {
+    /**
+     * @brief Hands the in-memory body over without copying it; the response is left without one.
+     */
+    body.swap(_body);
+    _body.clear();
+}
+
+size_t HttpResponse::getBodyLength() const {
+    return hasBodyFile() ? _body_length : _body.length();
+}
+
+void HttpResponse::appendHeaders(std::string& out, bool with_date) const {
+    /**
+     * @brief Serializes the status line and header block, including the blank line that
+     * ends it, onto out. Nothing is formatted through streams, so appending to a buffer
+     * that already has the capacity does not allocate.
+     * @param out The buffer to append to, typically reused across responses.
+     * @param with_date Whether to add the current Date line after the status line.
+     * Renderings kept for later reuse leave it out and get it inserted when queued.
+     */
+    const StatusLine* status = findStatusLine(_status_code);
+    if (status) {
+        out.append(status->line, status->length);
     } else {
-        ss << _body;
+        out.append("HTTP/1.1 ", 9);
+        appendDecimal(out, static_cast<size_t>(_status_code));
+        out.append(" \r\n", 3);
+    }
+
+    bool has_length = false;
+    bool has_date = false;
+    for (std::map<std::string, std::string>::const_iterator it = _headers.begin(); it != _headers.end(); ++it) {
+        if (it->first == "Content-Length" || it->first == "Transfer-Encoding") {
+            has_length = true;
+        } else if (it->first == "Date") {
+            has_date = true; // passed on from a CGI script
+        }
     }
-    return ss.str();
+    if (with_date && !has_date) {
+        out.append(getDateLine()->getData());
+    }
+
+    // Always frame the body so persistent connections know where the next response starts
+    // (204 and 304 responses never have one, and a close-delimited body needs no length)
+    bool has_body = _status_code != 204 && _status_code != 304 && !_close_delimited;
+    if (has_body && !has_length) {
+        out.append("Content-Length: ", 16);
+        appendDecimal(out, getBodyLength());
+        out.append("\r\n", 2);
+    }
+
+    for (std::map<std::string, std::string>::const_iterator it = _headers.begin(); it != _headers.end(); ++it) {
+        out.append(it->first);
+        out.append(": ", 2);
+        out.append(it->second);
+        out.append("\r\n", 2);
+    }
+    out.append("\r\n", 2); // End of headers
+}
+
+std::string HttpResponse::headersToString() const {
+    /**
+     * @brief Renders the header block without a Date line, for renderings that are
+     * stored in the ResponseCache and queued with Connection::queueRendered().
+     */
+    std::string out;
+    appendHeaders(out, false);
+    return out;
 }
 
+SharedBuffer* HttpResponse::getDateLine() {
+    /**
+     * @brief Returns the "Date: ...\r\n" header line for the current second.
+     * It is formatted at most once per second; connections that still send an older
+     * line keep their own reference to it.
+     * @return The shared line; callers that queue it take their own reference.
+     */
+    static SharedBuffer* date_line = NULL;
+    static time_t date_time = 0;
+    time_t now = time(NULL);
+    if (!date_line || now != date_time) {
+        if (date_line) {
+            date_line->release();
+        }
+        date_line = new SharedBuffer("Date: " + formatHttpDate(now) + "\r\n");
+        date_time = now;
+    }
+    return date_line;
+}
 
+std::string HttpResponse::formatHttpDate(time_t t) {
+    /**
+     * @brief Formats a timestamp as an IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+     */
+    struct tm tm_utc;
+    gmtime_r(&t, &tm_utc);
+    char buffer[64];
+    strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm_utc);
+    return buffer;
+}
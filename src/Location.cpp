@@ -1,6 +1,13 @@
 #include "Location.hpp"
 
-Location::Location() : _autoindex(false) {}
+Location::Location() : _autoindex(false), _cgi_timeout(60), _fastcgi_max_connections(0), _fastcgi_multiplex(1),
+      _status_page(STATUS_OFF), _expires(-1), _gzip(false), _gzip_static(false), _gzip_min_length(256), _gzip_comp_level(6) {
+    static const char* default_gzip_types[] = {
+        "text/html", "text/css", "text/plain", "text/xml", "application/javascript",
+        "application/json", "application/xml", "image/svg+xml"
+    };
+    _gzip_types.assign(default_gzip_types, default_gzip_types + sizeof(default_gzip_types) / sizeof(default_gzip_types[0]));
+}
 
 Location::~Location() {}
 
@@ -32,3 +39,51 @@ const std::string* Location::getCgiPath(const std::string& extension) const {
     }
     return NULL;
 }
+
+void Location::setCgiTimeout(int seconds) { _cgi_timeout = seconds; }
+int Location::getCgiTimeout() const { return _cgi_timeout; }
+
+void Location::setFastCgiPass(const std::string& address, size_t max_connections, size_t multiplex) {
+    _fastcgi_pass = address;
+    _fastcgi_max_connections = max_connections;
+    _fastcgi_multiplex = multiplex;
+}
+const std::string& Location::getFastCgiPass() const { return _fastcgi_pass; }
+size_t Location::getFastCgiMaxConnections() const { return _fastcgi_max_connections; }
+size_t Location::getFastCgiMultiplex() const { return _fastcgi_multiplex; }
+
+void Location::setStatusPage(StatusPage page) { _status_page = page; }
+Location::StatusPage Location::getStatusPage() const { return _status_page; }
+
+void Location::setExpires(int seconds) { _expires = seconds; }
+int Location::getExpires() const { return _expires; }
+
+void Location::setCacheControl(const std::string& value) { _cache_control = value; }
+const std::string& Location::getCacheControl() const { return _cache_control; }
+
+void Location::setGzip(bool gzip) { _gzip = gzip; }
+bool Location::getGzip() const { return _gzip; }
+
+void Location::setGzipStatic(bool gzip_static) { _gzip_static = gzip_static; }
+bool Location::getGzipStatic() const { return _gzip_static; }
+
+void Location::setGzipMinLength(size_t length) { _gzip_min_length = length; }
+size_t Location::getGzipMinLength() const { return _gzip_min_length; }
+
+void Location::setGzipCompLevel(int level) { _gzip_comp_level = level; }
+int Location::getGzipCompLevel() const { return _gzip_comp_level; }
+
+void Location::setGzipTypes(const std::vector<std::string>& types) { _gzip_types = types; }
+bool Location::isGzipType(const std::string& content_type) const {
+    /**
+     * @brief Checks whether responses of a media type are worth compressing on the fly.
+     * @param content_type A Content-Type value; parameters such as a charset are ignored.
+     */
+    std::string media_type = content_type.substr(0, content_type.find(';'));
+    for (size_t i = 0; i < _gzip_types.size(); ++i) {
+        if (_gzip_types[i] == "*" || _gzip_types[i] == media_type) {
+            return true;
+        }
+    }
+    return false;
+}
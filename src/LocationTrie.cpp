@@ -0,0 +1,98 @@
+#include "LocationTrie.hpp"
+
+const size_t LocationTrie::NONE;
+
+LocationTrie::LocationTrie() {
+    Node root;
+    root.value = NONE;
+    _nodes.push_back(root);
+}
+
+LocationTrie::~LocationTrie() {}
+
+size_t LocationTrie::_find_child(size_t node, char first) const {
+    const std::vector<size_t>& children = _nodes[node].children;
+    for (size_t i = 0; i < children.size(); ++i) {
+        if (_nodes[children[i]].label[0] == first) {
+            return children[i];
+        }
+    }
+    return NONE;
+}
+
+void LocationTrie::insert(const std::string& path, size_t value) {
+    /**
+     * @brief Adds a path, splitting an edge where the path leaves it midway.
+     */
+    size_t node = 0;
+    size_t pos = 0;
+    while (pos < path.size()) {
+        size_t child = _find_child(node, path[pos]);
+        if (child == NONE) {
+            Node leaf;
+            leaf.label = path.substr(pos);
+            leaf.value = value;
+            _nodes.push_back(leaf);
+            _nodes[node].children.push_back(_nodes.size() - 1);
+            return;
+        }
+        const std::string& label = _nodes[child].label;
+        size_t common = 0;
+        while (common < label.size() && pos + common < path.size() && label[common] == path[pos + common]) {
+            ++common;
+        }
+        if (common < label.size()) {
+            // The path ends or diverges inside the edge: give the shared part its own node
+            Node middle;
+            middle.label = label.substr(0, common);
+            middle.value = NONE;
+            middle.children.push_back(child);
+            _nodes[child].label.erase(0, common);
+            _nodes.push_back(middle);
+            size_t middle_index = _nodes.size() - 1;
+            std::vector<size_t>& siblings = _nodes[node].children;
+            for (size_t i = 0; i < siblings.size(); ++i) {
+                if (siblings[i] == child) {
+                    siblings[i] = middle_index;
+                }
+            }
+            child = middle_index;
+        }
+        pos += common;
+        node = child;
+    }
+    if (_nodes[node].value == NONE) {
+        _nodes[node].value = value;
+    }
+}
+
+bool LocationTrie::findLongestPrefix(const std::string& uri, size_t& value) const {
+    /**
+     * @brief Finds the longest inserted path that is a prefix of the URI.
+     * @param value Set to the value of the path found.
+     * @return false if no inserted path is a prefix of the URI.
+     */
+    size_t best = _nodes[0].value;
+    size_t node = 0;
+    size_t pos = 0;
+    while (pos < uri.size()) {
+        size_t child = _find_child(node, uri[pos]);
+        if (child == NONE) {
+            break;
+        }
+        const std::string& label = _nodes[child].label;
+        if (uri.compare(pos, label.size(), label) != 0) {
+            break;
+        }
+        pos += label.size();
+        node = child;
+        if (_nodes[node].value != NONE) {
+            best = _nodes[node].value;
+        }
+    }
+    if (best == NONE) {
+        return false;
+    }
+    value = best;
+    return true;
+}
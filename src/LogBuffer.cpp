@@ -0,0 +1,87 @@
+#include "LogBuffer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+LogBuffer::LogBuffer(int fd, bool owns_fd, size_t capacity)
+    : _fd(fd), _owns_fd(owns_fd), _ring(capacity), _head(0), _size(0), _dropped(0) {}
+
+LogBuffer::~LogBuffer() {
+    flush();
+    if (_owns_fd) {
+        close(_fd);
+    }
+}
+
+LogBuffer* LogBuffer::open(const std::string& path, size_t capacity) {
+    if (path == "stderr") {
+        return new LogBuffer(STDERR_FILENO, false, capacity);
+    }
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open log file " + path + ": " + strerror(errno));
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return new LogBuffer(fd, true, capacity);
+}
+
+void LogBuffer::append(const std::string& line) {
+    append(line.data(), line.size());
+}
+
+void LogBuffer::append(const char* data, size_t length) {
+    /**
+     * @brief Queues one complete line. Lines are never split between batches, so
+     * with O_APPEND several processes can share a log file without interleaving.
+     */
+    if (length > _ring.size() - _size) {
+        flush();
+        if (length > _ring.size() - _size) {
+            ++_dropped;
+            return;
+        }
+    }
+    size_t tail = (_head + _size) % _ring.size();
+    size_t first = std::min(length, _ring.size() - tail);
+    memcpy(&_ring[tail], data, first);
+    memcpy(&_ring[0], data + first, length - first);
+    _size += length;
+}
+
+bool LogBuffer::flush() {
+    /**
+     * @brief Writes out everything queued, both parts of the ring in one writev().
+     * @return false if output is left over because the descriptor would block or
+     * failed; on failure the queued output is discarded.
+     */
+    while (_size > 0) {
+        struct iovec iov[2];
+        size_t first = std::min(_size, _ring.size() - _head);
+        iov[0].iov_base = &_ring[_head];
+        iov[0].iov_len = first;
+        iov[1].iov_base = &_ring[0];
+        iov[1].iov_len = _size - first;
+        ssize_t written = writev(_fd, iov, iov[1].iov_len ? 2 : 1);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                _head = 0;
+                _size = 0;
+            }
+            return false;
+        }
+        _head = (_head + written) % _ring.size();
+        _size -= written;
+    }
+    _head = 0;
+    return true;
+}
+
+bool LogBuffer::hasPending() const { return _size > 0; }
+size_t LogBuffer::getDropped() const { return _dropped; }
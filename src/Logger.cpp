@@ -0,0 +1,80 @@
+#include "Logger.hpp"
+#include "LogBuffer.hpp"
+#include <ctime>
+#include <cstdio>
+#include <unistd.h>
+
+// Room for bursts of messages between two flushes of the event loop
+static const size_t ERROR_LOG_BUFFER_SIZE = 64 * 1024;
+
+static const char* const LEVEL_NAMES[] = { "debug", "info", "notice", "warn", "error", "crit" };
+
+LogBuffer* Logger::_buffer = NULL;
+Logger::Level Logger::_level = Logger::LEVEL_NOTICE;
+bool Logger::_batching = false;
+
+void Logger::configure(const std::string& path, Level level) {
+    /**
+     * @brief Opens the log before closing the previous one, so that a reload with an
+     * unusable path keeps logging where it did.
+     */
+    LogBuffer* buffer = LogBuffer::open(path, ERROR_LOG_BUFFER_SIZE);
+    delete _buffer; // Flushes what the old log still held
+    _buffer = buffer;
+    _level = level;
+}
+
+bool Logger::isEnabled(Level level) { return level >= _level; }
+
+void Logger::write(Level level, const std::string& message) {
+    /**
+     * @brief Logs one message as "2026/01/31 12:00:00 [error] <pid>: <message>".
+     * The timestamp is formatted at most once per second.
+     */
+    static time_t cached_time = 0;
+    static char timestamp[32] = "";
+    time_t now = time(NULL);
+    if (now != cached_time) {
+        struct tm tm;
+        localtime_r(&now, &tm);
+        strftime(timestamp, sizeof(timestamp), "%Y/%m/%d %H:%M:%S", &tm);
+        cached_time = now;
+    }
+    char prefix[96];
+    int length = snprintf(prefix, sizeof(prefix), "%s [%s] %ld: ", timestamp, LEVEL_NAMES[level], static_cast<long>(getpid()));
+    std::string line;
+    line.reserve(length + message.size() + 1);
+    line.append(prefix, length);
+    line += message;
+    line += '\n';
+    if (!_buffer) {
+        _buffer = LogBuffer::open("stderr", ERROR_LOG_BUFFER_SIZE);
+    }
+    _buffer->append(line);
+    if (!_batching) {
+        _buffer->flush();
+    }
+}
+
+void Logger::setBatching(bool batching) {
+    _batching = batching;
+    if (!batching) {
+        flush();
+    }
+}
+
+void Logger::flush() {
+    if (_buffer) {
+        _buffer->flush();
+    }
+}
+
+bool Logger::parseLevel(const std::string& name, Level& level) {
+    for (size_t i = 0; i < sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0]); ++i) {
+        if (name == LEVEL_NAMES[i]) {
+            level = static_cast<Level>(i);
+            return true;
+        }
+    }
+    return false;
+}
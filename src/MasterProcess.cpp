@@ -0,0 +1,143 @@
+#include "MasterProcess.hpp"
+#include "WebServer.hpp"
+#include "ConfigParser.hpp"
+#include "Logger.hpp"
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern volatile sig_atomic_t g_running;
+extern volatile sig_atomic_t g_reload;
+
+MasterProcess::MasterProcess(const std::string& config_file, int worker_count)
+    : _config_file(config_file), _worker_count(worker_count) {}
+
+MasterProcess::~MasterProcess() {}
+
+int MasterProcess::run() {
+    /**
+     * @brief Starts the workers and supervises them until a shutdown signal arrives.
+     * A worker that exits while the server is running is replaced; if it died right
+     * after being started (for example because it could not bind), the restart is
+     * delayed by a second to avoid a tight fork loop.
+     * @return 0 after a clean shutdown, 1 if no worker could be started.
+     */
+    for (int i = 0; i < _worker_count; ++i) {
+        if (!_spawn_worker()) {
+            _signal_workers(SIGTERM);
+            _wait_for_workers();
+            return 1;
+        }
+    }
+    LOG(Logger::LEVEL_NOTICE, "Master process " << getpid() << " started " << _worker_count << " workers");
+
+    while (g_running) {
+        if (g_reload) {
+            g_reload = 0;
+            _reload_workers();
+        }
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue; // Signal received, g_running and g_reload are re-checked
+            }
+            break;
+        }
+        std::map<pid_t, time_t>::iterator it = _workers.find(pid);
+        if (it == _workers.end()) {
+            continue;
+        }
+        time_t started = it->second;
+        _workers.erase(it);
+        if (!g_running) {
+            break;
+        }
+
+        if (WIFSIGNALED(status)) {
+            LOG(Logger::LEVEL_ERROR, "Worker " << pid << " killed by signal " << WTERMSIG(status) << ", restarting");
+        } else {
+            LOG(Logger::LEVEL_ERROR, "Worker " << pid << " exited with code " << WEXITSTATUS(status) << ", restarting");
+        }
+        if (time(NULL) - started < 1) {
+            sleep(1);
+        }
+        if (g_running) {
+            _spawn_worker();
+        }
+    }
+
+    _signal_workers(SIGTERM);
+    _wait_for_workers();
+    LOG(Logger::LEVEL_NOTICE, "Master process shutting down");
+    return 0;
+}
+
+bool MasterProcess::_spawn_worker() {
+    pid_t pid = fork();
+    if (pid < 0) {
+        LOG(Logger::LEVEL_CRIT, "fork() failed for worker process: " << strerror(errno));
+        return false;
+    }
+    if (pid == 0) {
+        std::exit(_run_worker());
+    }
+    _workers[pid] = time(NULL);
+    return true;
+}
+
+int MasterProcess::_run_worker() {
+    try {
+        WebServer server(_config_file);
+        server.run();
+    } catch (const std::exception& e) {
+        LOG(Logger::LEVEL_CRIT, "Worker " << getpid() << " error: " << e.what());
+        return 1;
+    }
+    return 0;
+}
+
+void MasterProcess::_signal_workers(int signum) {
+    for (std::map<pid_t, time_t>::iterator it = _workers.begin(); it != _workers.end(); ++it) {
+        kill(it->first, signum);
+    }
+}
+
+void MasterProcess::_reload_workers() {
+    /**
+     * @brief Tells the workers to reload after checking that the configuration file
+     * parses, so a broken file is reported once here. Workers started later read the
+     * new file as well.
+     */
+    try {
+        ConfigParser parser(_config_file);
+        parser.parse();
+        const GlobalConfig& global = parser.getGlobalConfig();
+        if (global.getWorkerProcesses() != _worker_count) {
+            LOG(Logger::LEVEL_WARN, "worker_processes changes need a restart");
+        }
+        Logger::configure(global.getErrorLogPath(), global.getErrorLogLevel());
+    } catch (const std::exception& e) {
+        LOG(Logger::LEVEL_ERROR, "Reload failed, keeping the current configuration: " << e.what());
+        return;
+    }
+    LOG(Logger::LEVEL_NOTICE, "Reloading " << _workers.size() << " workers");
+    _signal_workers(SIGHUP);
+}
+
+void MasterProcess::_wait_for_workers() {
+    while (!_workers.empty()) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        _workers.erase(pid);
+    }
+}
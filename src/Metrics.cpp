@@ -0,0 +1,290 @@
+#include "Metrics.hpp"
+#include "ServerConfig.hpp"
+#include "Location.hpp"
+#include <sstream>
+#include <iomanip>
+
+static const char* const METHOD_NAMES[] = { "GET", "POST", "DELETE", "other" };
+static const char* const BACKEND_NAMES[] = { "cgi", "fastcgi" };
+
+static void writeSeconds(std::ostream& out, unsigned long micros) {
+    /**
+     * @brief Writes a duration in microseconds as seconds without trailing zeros.
+     */
+    out << micros / 1000000;
+    unsigned long fraction = micros % 1000000;
+    if (fraction == 0) {
+        return;
+    }
+    int digits = 6;
+    while (fraction % 10 == 0) {
+        fraction /= 10;
+        --digits;
+    }
+    out << '.' << std::setw(digits) << std::setfill('0') << fraction << std::setfill(' ');
+}
+
+LatencyHistogram::LatencyHistogram() : _count(0), _sum(0) {
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        _buckets[i] = 0;
+    }
+}
+
+unsigned long LatencyHistogram::getCount() const { return _count; }
+
+int LatencyHistogram::_bucket_index(unsigned long micros) {
+    /**
+     * @brief Maps a value to its bucket: the position of its highest set bit picks
+     * the power of two, the SUB_BUCKET_BITS bits below it the bucket within it.
+     * webserv-bench's LatencyRecorder uses the same layout and must stay in step.
+     * @return The bucket, or BUCKET_COUNT for a value beyond the last one.
+     */
+    const unsigned long sub_buckets = 1UL << SUB_BUCKET_BITS;
+    if (micros < 2 * sub_buckets) {
+        return static_cast<int>(micros);
+    }
+    int magnitude = 0;
+    for (unsigned long rest = micros; rest > 1; rest >>= 1) {
+        ++magnitude;
+    }
+    int shift = magnitude - SUB_BUCKET_BITS;
+    int index = shift * static_cast<int>(sub_buckets) + static_cast<int>(micros >> shift);
+    return index < BUCKET_COUNT ? index : BUCKET_COUNT;
+}
+
+unsigned long LatencyHistogram::_bucket_start(int index) {
+    /**
+     * @brief The smallest value that falls into a bucket, the inverse of _bucket_index().
+     */
+    const int sub_buckets = 1 << SUB_BUCKET_BITS;
+    if (index < 2 * sub_buckets) {
+        return static_cast<unsigned long>(index);
+    }
+    int shift = index / sub_buckets - 1;
+    return static_cast<unsigned long>(index % sub_buckets + sub_buckets) << shift;
+}
+
+void LatencyHistogram::record(unsigned long micros) {
+    int index = _bucket_index(micros);
+    if (index < BUCKET_COUNT) {
+        ++_buckets[index];
+    }
+    ++_count;
+    _sum += micros;
+}
+
+void LatencyHistogram::write(std::ostream& out, const std::string& name, const std::string& labels) const {
+    /**
+     * @brief Writes the cumulative buckets, sum and count of one label set. Values
+     * are whole microseconds, so a bucket's inclusive "le" bound is one below
+     * where the next bucket starts.
+     */
+    unsigned long cumulative = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        cumulative += _buckets[i];
+        out << name << "_bucket{" << labels << ",le=\"";
+        writeSeconds(out, _bucket_start(i + 1) - 1);
+        out << "\"} " << cumulative << '\n';
+    }
+    out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << _count << '\n';
+    out << name << "_sum{" << labels << "} ";
+    writeSeconds(out, _sum);
+    out << '\n';
+    out << name << "_count{" << labels << "} " << _count << '\n';
+}
+
+Metrics::Metrics()
+    : _accepted(0), _handled(0), _closed(0), _requests(0), _bytes_received(0), _bytes_sent(0),
+      _retired_cache_hits(0), _retired_cache_misses(0) {
+    for (int method = 0; method < METHOD_COUNT; ++method) {
+        for (int status = 0; status < STATUS_CLASS_COUNT; ++status) {
+            _requests_by[method][status] = 0;
+        }
+    }
+    for (int backend = 0; backend < BACKEND_COUNT; ++backend) {
+        _backend_started[backend] = 0;
+        _backend_failed[backend] = 0;
+    }
+}
+
+Metrics::~Metrics() {
+    for (std::map<std::string, LocationMetrics*>::iterator it = _locations.begin(); it != _locations.end(); ++it) {
+        delete it->second;
+    }
+}
+
+void Metrics::connectionAccepted() {
+    ++_accepted;
+    ++_handled;
+}
+
+void Metrics::connectionRefused() {
+    ++_accepted;
+}
+
+void Metrics::connectionClosed(unsigned long bytes_received, unsigned long bytes_sent) {
+    ++_closed;
+    _bytes_received += bytes_received;
+    _bytes_sent += bytes_sent;
+}
+
+void Metrics::requestCompleted(const std::string& method, int status) {
+    int method_index = METHOD_OTHER;
+    if (method == "GET") {
+        method_index = METHOD_GET;
+    } else if (method == "POST") {
+        method_index = METHOD_POST;
+    } else if (method == "DELETE") {
+        method_index = METHOD_DELETE;
+    }
+    int status_class = status / 100 - 1;
+    if (status_class < 0 || status_class >= STATUS_CLASS_COUNT) {
+        status_class = STATUS_CLASS_COUNT - 1;
+    }
+    ++_requests;
+    ++_requests_by[method_index][status_class];
+}
+
+void Metrics::backendStarted(Backend backend) { ++_backend_started[backend]; }
+void Metrics::backendFailed(Backend backend) { ++_backend_failed[backend]; }
+
+void Metrics::retireResponseCache(size_t hits, size_t misses) {
+    _retired_cache_hits += hits;
+    _retired_cache_misses += misses;
+}
+
+LocationMetrics* Metrics::getLocation(const ServerConfig& server, const Location& location) {
+    /**
+     * @brief Finds the histograms of a location. Locations are looked up by address,
+     * which is cheap; only the first request to a newly loaded location builds its
+     * label set. A reloaded location with the same server and path keeps its data.
+     */
+    std::map<const Location*, LocationMetrics*>::iterator cached = _location_index.find(&location);
+    if (cached != _location_index.end()) {
+        return cached->second;
+    }
+    std::ostringstream labels;
+    labels << "server=\"" << _escape_label(server.getServerNames().empty() ? "_" : server.getServerNames()[0])
+           << ':' << server.getPort() << "\",location=\"" << _escape_label(location.getPath()) << '"';
+    LocationMetrics*& metrics = _locations[labels.str()];
+    if (!metrics) {
+        metrics = new LocationMetrics();
+        metrics->labels = labels.str();
+    }
+    _location_index[&location] = metrics;
+    return metrics;
+}
+
+void Metrics::forgetLocations() {
+    _location_index.clear();
+}
+
+std::string Metrics::_escape_label(const std::string& value) {
+    std::string escaped;
+    for (size_t i = 0; i < value.length(); ++i) {
+        if (value[i] == '\\' || value[i] == '"') {
+            escaped += '\\';
+            escaped += value[i];
+        } else if (value[i] == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += value[i];
+        }
+    }
+    return escaped;
+}
+
+void Metrics::writeStubStatus(std::ostream& out, const MetricsSnapshot& snapshot) const {
+    /**
+     * @brief Writes the connection summary in the layout of nginx's stub_status.
+     */
+    out << "Active connections: " << snapshot.active_connections << " \n"
+        << "server accepts handled requests\n"
+        << " " << _accepted << " " << _handled << " " << _requests << " \n"
+        << "Reading: " << snapshot.reading_connections << " Writing: " << snapshot.writing_connections
+        << " Waiting: " << snapshot.waiting_connections << " \n";
+}
+
+void Metrics::writePrometheus(std::ostream& out, const MetricsSnapshot& snapshot) const {
+    /**
+     * @brief Writes every counter, gauge and histogram in the Prometheus text
+     * exposition format (version 0.0.4). Label sets that were never used are left out.
+     */
+    out << "# HELP webserv_connections_accepted_total Client connections accepted.\n"
+        << "# TYPE webserv_connections_accepted_total counter\n"
+        << "webserv_connections_accepted_total " << _accepted << '\n'
+        << "# HELP webserv_connections_handled_total Accepted connections that were served rather than turned away.\n"
+        << "# TYPE webserv_connections_handled_total counter\n"
+        << "webserv_connections_handled_total " << _handled << '\n'
+        << "# HELP webserv_connections_closed_total Served connections that have been closed.\n"
+        << "# TYPE webserv_connections_closed_total counter\n"
+        << "webserv_connections_closed_total " << _closed << '\n'
+        << "# HELP webserv_connections_active Open client connections.\n"
+        << "# TYPE webserv_connections_active gauge\n"
+        << "webserv_connections_active " << snapshot.active_connections << '\n'
+        << "# HELP webserv_connections Open client connections by state.\n"
+        << "# TYPE webserv_connections gauge\n"
+        << "webserv_connections{state=\"reading\"} " << snapshot.reading_connections << '\n'
+        << "webserv_connections{state=\"writing\"} " << snapshot.writing_connections << '\n'
+        << "webserv_connections{state=\"waiting\"} " << snapshot.waiting_connections << '\n';
+
+    out << "# HELP webserv_requests_total Answered requests by method and status class.\n"
+        << "# TYPE webserv_requests_total counter\n";
+    for (int method = 0; method < METHOD_COUNT; ++method) {
+        for (int status = 0; status < STATUS_CLASS_COUNT; ++status) {
+            if (_requests_by[method][status] != 0) {
+                out << "webserv_requests_total{method=\"" << METHOD_NAMES[method] << "\",code=\"" << status + 1
+                    << "xx\"} " << _requests_by[method][status] << '\n';
+            }
+        }
+    }
+
+    out << "# HELP webserv_received_bytes_total Bytes read from clients.\n"
+        << "# TYPE webserv_received_bytes_total counter\n"
+        << "webserv_received_bytes_total " << _bytes_received + snapshot.open_bytes_received << '\n'
+        << "# HELP webserv_sent_bytes_total Bytes written to clients.\n"
+        << "# TYPE webserv_sent_bytes_total counter\n"
+        << "webserv_sent_bytes_total " << _bytes_sent + snapshot.open_bytes_sent << '\n';
+
+    out << "# HELP webserv_backend_requests_total Requests handed to CGI scripts and FastCGI applications.\n"
+        << "# TYPE webserv_backend_requests_total counter\n";
+    for (int backend = 0; backend < BACKEND_COUNT; ++backend) {
+        out << "webserv_backend_requests_total{backend=\"" << BACKEND_NAMES[backend] << "\"} "
+            << _backend_started[backend] << '\n';
+    }
+    out << "# HELP webserv_backend_failures_total Backend requests that could not be started or ended in an error.\n"
+        << "# TYPE webserv_backend_failures_total counter\n";
+    for (int backend = 0; backend < BACKEND_COUNT; ++backend) {
+        out << "webserv_backend_failures_total{backend=\"" << BACKEND_NAMES[backend] << "\"} "
+            << _backend_failed[backend] << '\n';
+    }
+    out << "# HELP webserv_cgi_processes Running CGI scripts.\n"
+        << "# TYPE webserv_cgi_processes gauge\n"
+        << "webserv_cgi_processes " << snapshot.cgi_processes << '\n';
+
+    out << "# HELP webserv_cache_hits_total Lookups answered from the open file cache or the static response cache.\n"
+        << "# TYPE webserv_cache_hits_total counter\n"
+        << "webserv_cache_hits_total{cache=\"file\"} " << snapshot.file_cache_hits << '\n'
+        << "webserv_cache_hits_total{cache=\"response\"} " << _retired_cache_hits + snapshot.response_cache_hits << '\n'
+        << "# HELP webserv_cache_misses_total Lookups the open file cache or the static response cache could not answer.\n"
+        << "# TYPE webserv_cache_misses_total counter\n"
+        << "webserv_cache_misses_total{cache=\"file\"} " << snapshot.file_cache_misses << '\n'
+        << "webserv_cache_misses_total{cache=\"response\"} " << _retired_cache_misses + snapshot.response_cache_misses << '\n';
+
+    static const char* const names[] = {
+        "webserv_request_parse_seconds", "Time from the first byte of a request to its complete head.",
+        "webserv_request_handler_seconds", "Time from a complete request to its queued response.",
+        "webserv_request_duration_seconds", "Time from the first byte of a request to its queued response."
+    };
+    for (int phase = 0; phase < 3; ++phase) {
+        out << "# HELP " << names[2 * phase] << ' ' << names[2 * phase + 1] << '\n'
+            << "# TYPE " << names[2 * phase] << " histogram\n";
+        for (std::map<std::string, LocationMetrics*>::const_iterator it = _locations.begin(); it != _locations.end(); ++it) {
+            const LocationMetrics* metrics = it->second;
+            const LatencyHistogram& histogram = phase == 0 ? metrics->parse : phase == 1 ? metrics->handler : metrics->total;
+            if (histogram.getCount() != 0) {
+                histogram.write(out, names[2 * phase], metrics->labels);
+            }
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#include "PollEventLoop.hpp"
+#include <cerrno>
+#include <stdexcept>
+
+const size_t PollEventLoop::NO_SLOT;
+
+PollEventLoop::PollEventLoop() {}
+
+PollEventLoop::~PollEventLoop() {}
+
+short PollEventLoop::_to_poll_events(int events) {
+    short poll_events = 0;
+    if (events & EVENT_READ) poll_events |= POLLIN;
+    if (events & EVENT_WRITE) poll_events |= POLLOUT;
+#ifdef POLLRDHUP
+    if (events & EVENT_PEER_SHUTDOWN) poll_events |= POLLRDHUP;
+#endif
+    return poll_events;
+}
+
+size_t PollEventLoop::_find_slot(int fd) const {
+    if (fd < 0 || static_cast<size_t>(fd) >= _index.size()) {
+        return NO_SLOT;
+    }
+    return _index[fd];
+}
+
+void PollEventLoop::add(int fd, int events, EventTarget* target) {
+    if (static_cast<size_t>(fd) >= _index.size()) {
+        _index.resize(fd + 1, NO_SLOT);
+    }
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = _to_poll_events(events);
+    pfd.revents = 0;
+    _index[fd] = _fds.size();
+    _fds.push_back(pfd);
+    _targets.push_back(target);
+}
+
+void PollEventLoop::modify(int fd, int events, EventTarget* target) {
+    size_t slot = _find_slot(fd);
+    if (slot == NO_SLOT) {
+        return;
+    }
+    _fds[slot].events = _to_poll_events(events);
+    _targets[slot] = target;
+}
+
+void PollEventLoop::remove(int fd) {
+    size_t slot = _find_slot(fd);
+    if (slot == NO_SLOT) {
+        return;
+    }
+    size_t last = _fds.size() - 1;
+    if (slot != last) {
+        _fds[slot] = _fds[last];
+        _targets[slot] = _targets[last];
+        _index[_fds[slot].fd] = slot;
+    }
+    _fds.pop_back();
+    _targets.pop_back();
+    _index[fd] = NO_SLOT;
+}
+
+int PollEventLoop::wait(std::vector<Event>& ready, int timeout_ms) {
+    /**
+     * @brief Waits for readiness with poll() and collects the ready descriptors.
+     * The results are copied out before returning, so callers may add or remove
+     * descriptors while dispatching them.
+     * @return The number of ready events, or -1 on error (0 if interrupted by a signal).
+     */
+    ready.clear();
+    int ret = poll(_fds.empty() ? NULL : &_fds[0], _fds.size(), timeout_ms);
+    if (ret < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    for (size_t i = 0; i < _fds.size() && static_cast<int>(ready.size()) < ret; ++i) {
+        short revents = _fds[i].revents;
+        if (!revents) {
+            continue;
+        }
+        Event event;
+        event.target = _targets[i];
+        event.events = 0;
+        if (revents & (POLLIN | POLLHUP)) event.events |= EVENT_READ;
+        if (revents & POLLOUT) event.events |= EVENT_WRITE;
+        if (revents & (POLLERR | POLLNVAL)) event.events |= EVENT_ERROR;
+        if (revents & POLLHUP) event.events |= EVENT_HANGUP;
+#ifdef POLLRDHUP
+        if (revents & POLLRDHUP) event.events |= EVENT_PEER_SHUTDOWN;
+#endif
+        ready.push_back(event);
+    }
+    return static_cast<int>(ready.size());
+}
+
+bool PollEventLoop::isEdgeTriggered() const { return false; }
+const char* PollEventLoop::getName() const { return "poll"; }
@@ -0,0 +1,106 @@
+#include "RequestBody.hpp"
+#include <cstdlib> // For mkstemp
+#include <cstdio> // For rename
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <vector>
+
+// Memory held on to between requests; larger buffers are released after use
+static const size_t RETAINED_CAPACITY = 64 * 1024;
+
+RequestBody::RequestBody() : _fd(-1), _size(0) {}
+
+RequestBody::~RequestBody() {
+    reset();
+}
+
+bool RequestBody::openTempFile(const std::string& directory) {
+    /**
+     * @brief Switches the body to a new temporary file in directory.
+     * The file gets the permissions a regular create would have given it, so the
+     * rename in commit() does not leave an owner-only upload behind.
+     * @return false if the file could not be created.
+     */
+    reset();
+    std::string path_template = directory + "/.upload.XXXXXX";
+    std::vector<char> path(path_template.begin(), path_template.end());
+    path.push_back('\0');
+    int fd = mkstemp(&path[0]);
+    if (fd < 0) {
+        return false;
+    }
+    mode_t mask = umask(0);
+    umask(mask);
+    fchmod(fd, 0666 & ~mask);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    _fd = fd;
+    _temp_path = &path[0];
+    return true;
+}
+
+bool RequestBody::append(const char* data, size_t length) {
+    /**
+     * @brief Adds the next piece of the body.
+     * @return false if writing to the temporary file failed, e.g. with ENOSPC.
+     */
+    _size += length;
+    if (_fd < 0) {
+        _data.append(data, length);
+        return true;
+    }
+    while (length > 0) {
+        ssize_t written = write(_fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+bool RequestBody::commit(const std::string& path) {
+    /**
+     * @brief Atomically moves the completed temporary file to path.
+     * @return false if the body is not a file or the rename failed; the temporary
+     * file is removed in that case.
+     */
+    if (_fd < 0) {
+        return false;
+    }
+    bool ok = close(_fd) == 0;
+    _fd = -1;
+    if (ok && rename(_temp_path.c_str(), path.c_str()) == 0) {
+        _temp_path.clear();
+        return true;
+    }
+    unlink(_temp_path.c_str());
+    _temp_path.clear();
+    return false;
+}
+
+void RequestBody::reset() {
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+    if (!_temp_path.empty()) {
+        unlink(_temp_path.c_str());
+        _temp_path.clear();
+    }
+    if (_data.capacity() > RETAINED_CAPACITY) {
+        std::string().swap(_data);
+    } else {
+        _data.clear();
+    }
+    _size = 0;
+}
+
+bool RequestBody::isFile() const { return _fd >= 0; }
+size_t RequestBody::size() const { return _size; }
+const std::string& RequestBody::getData() const { return _data; }
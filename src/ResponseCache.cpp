@@ -0,0 +1,82 @@
+#include "ResponseCache.hpp"
+#include <ctime>
+
+ResponseCache::ResponseCache(size_t max_bytes, size_t max_file_size)
+    : _max_bytes(max_bytes), _max_file_size(max_file_size), _bytes(0), _hits(0), _misses(0) {}
+
+ResponseCache::~ResponseCache() {
+    while (!_entries.empty()) {
+        _erase(_entries.begin());
+    }
+}
+
+bool ResponseCache::isEnabled() const { return _max_bytes > 0; }
+
+bool ResponseCache::accepts(off_t body_size) const {
+    return isEnabled() && body_size >= 0 && static_cast<size_t>(body_size) <= _max_file_size;
+}
+
+SharedBuffer* ResponseCache::get(const std::string& key, const CachedFile* file) {
+    /**
+     * @brief Looks up a rendered response and checks it still matches the file on disk.
+     * @param key The cache key (resolved path plus response variant).
+     * @param file The current metadata for the file the response was rendered from.
+     * @return A retained buffer the caller must release(), or NULL on a miss.
+     */
+    std::map<std::string, Entry>::iterator it = _entries.find(key);
+    if (it == _entries.end()) {
+        _misses++;
+        return NULL;
+    }
+    Entry& entry = it->second;
+    if (entry.inode != file->getInode() || entry.size != file->getSize() || entry.mtime != file->getMtime()
+        || (entry.valid_until != 0 && time(NULL) >= entry.valid_until)) {
+        _erase(it);
+        _misses++;
+        return NULL;
+    }
+    _hits++;
+    _lru.splice(_lru.begin(), _lru, entry.lru_pos);
+    entry.buffer->retain();
+    return entry.buffer;
+}
+
+SharedBuffer* ResponseCache::put(const std::string& key, const CachedFile* file, const std::string& rendered, time_t valid_until) {
+    /**
+     * @brief Stores a rendered response, evicting least recently used entries to stay within budget.
+     * @return A retained buffer holding the response, which the caller must release().
+     */
+    SharedBuffer* buffer = new SharedBuffer(rendered);
+    if (rendered.size() > _max_bytes) {
+        return buffer;
+    }
+    std::map<std::string, Entry>::iterator existing = _entries.find(key);
+    if (existing != _entries.end()) {
+        _erase(existing);
+    }
+    while (_bytes + rendered.size() > _max_bytes && !_lru.empty()) {
+        _erase(_entries.find(*_lru.back()));
+    }
+    std::map<std::string, Entry>::iterator it = _entries.insert(std::make_pair(key, Entry())).first;
+    it->second.buffer = buffer;
+    it->second.inode = file->getInode();
+    it->second.size = file->getSize();
+    it->second.mtime = file->getMtime();
+    it->second.valid_until = valid_until;
+    _lru.push_front(&it->first);
+    it->second.lru_pos = _lru.begin();
+    _bytes += rendered.size();
+    buffer->retain(); // One reference for the cache, one for the caller
+    return buffer;
+}
+
+void ResponseCache::_erase(std::map<std::string, Entry>::iterator it) {
+    _bytes -= it->second.buffer->size();
+    _lru.erase(it->second.lru_pos);
+    it->second.buffer->release(); // Connections still sending it keep their own reference
+    _entries.erase(it);
+}
+
+size_t ResponseCache::getHits() const { return _hits; }
+size_t ResponseCache::getMisses() const { return _misses; }
+size_t ResponseCache::getBytes() const { return _bytes; }
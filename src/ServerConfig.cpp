@@ -1,6 +1,7 @@
 #include "ServerConfig.hpp"
 
-ServerConfig::ServerConfig() : _port(80), _client_max_body_size(1024 * 1024) {}
+ServerConfig::ServerConfig() : _port(80), _client_max_body_size(1024 * 1024), _keepalive_timeout(75), _keepalive_requests(1000),
+      _client_header_timeout(60), _client_body_timeout(60), _send_timeout(60) {}
 
 ServerConfig::~ServerConfig() {}
 
@@ -22,8 +23,34 @@ const std::string* ServerConfig::getErrorPage(int error_code) const {
 void ServerConfig::setClientMaxBodySize(size_t size) { _client_max_body_size = size; }
 size_t ServerConfig::getClientMaxBodySize() const { return _client_max_body_size; }
 
-void ServerConfig::addLocation(const Location& location) { _locations.push_back(location); }
+void ServerConfig::setKeepAliveTimeout(int seconds) { _keepalive_timeout = seconds; }
+int ServerConfig::getKeepAliveTimeout() const { return _keepalive_timeout; }
+
+void ServerConfig::setKeepAliveRequests(size_t max_requests) { _keepalive_requests = max_requests; }
+size_t ServerConfig::getKeepAliveRequests() const { return _keepalive_requests; }
+
+void ServerConfig::setClientHeaderTimeout(int seconds) { _client_header_timeout = seconds; }
+int ServerConfig::getClientHeaderTimeout() const { return _client_header_timeout; }
+
+void ServerConfig::setClientBodyTimeout(int seconds) { _client_body_timeout = seconds; }
+int ServerConfig::getClientBodyTimeout() const { return _client_body_timeout; }
+
+void ServerConfig::setSendTimeout(int seconds) { _send_timeout = seconds; }
+int ServerConfig::getSendTimeout() const { return _send_timeout; }
+
+void ServerConfig::addLocation(const Location& location) {
+    _locations.push_back(location);
+    _location_index.insert(location.getPath(), _locations.size() - 1);
+}
 const std::vector<Location>& ServerConfig::getLocations() const { return _locations; }
+
+const Location* ServerConfig::findLocation(const std::string& uri) const {
+    size_t index;
+    if (!_location_index.findLongestPrefix(uri, index)) {
+        return NULL;
+    }
+    return &_locations[index];
+}
 /**
  * @brief Gets the list of Location blocks for the server configuration.
  * @return A const reference to the vector of Location objects.
@@ -0,0 +1,16 @@
+#include "SharedBuffer.hpp"
+
+SharedBuffer::SharedBuffer(const std::string& data) : _data(data), _refcount(1) {}
+
+SharedBuffer::~SharedBuffer() {}
+
+void SharedBuffer::retain() { _refcount++; }
+
+void SharedBuffer::release() {
+    if (--_refcount == 0) {
+        delete this;
+    }
+}
+
+const std::string& SharedBuffer::getData() const { return _data; }
+size_t SharedBuffer::size() const { return _data.size(); }
@@ -0,0 +1,146 @@
+#include "TimerWheel.hpp"
+#include <ctime>
+
+TimerWheel::TimerWheel() : _current(now() / TICK_MS), _count(0) {
+    for (int level = 0; level < LEVELS; ++level) {
+        for (int slot = 0; slot < SLOTS; ++slot) {
+            _slots[level][slot].prev = &_slots[level][slot];
+            _slots[level][slot].next = &_slots[level][slot];
+        }
+    }
+}
+
+void TimerWheel::initTimer(Timer* timer, EventTarget* target) {
+    timer->target = target;
+    timer->expires = 0;
+    timer->prev = NULL;
+    timer->next = NULL;
+}
+
+bool TimerWheel::isScheduled(const Timer* timer) { return timer->prev != NULL; }
+size_t TimerWheel::size() const { return _count; }
+
+unsigned long TimerWheel::now() {
+    /**
+     * @brief Returns a monotonic clock in milliseconds, unaffected by changes to the wall clock.
+     */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long>(ts.tv_sec) * 1000 + static_cast<unsigned long>(ts.tv_nsec) / 1000000;
+}
+
+unsigned long TimerWheel::nowMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long>(ts.tv_sec) * 1000000 + static_cast<unsigned long>(ts.tv_nsec) / 1000;
+}
+
+void TimerWheel::schedule(Timer* timer, unsigned long deadline_ms) {
+    /**
+     * @brief Arms a timer, or moves it if it is already scheduled.
+     * @param deadline_ms Monotonic time from now(); the timer fires on the first tick at or after it.
+     */
+    cancel(timer);
+    timer->expires = (deadline_ms + TICK_MS - 1) / TICK_MS;
+    _insert(timer);
+    ++_count;
+}
+
+void TimerWheel::cancel(Timer* timer) {
+    if (!isScheduled(timer)) {
+        return;
+    }
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = NULL;
+    timer->next = NULL;
+    --_count;
+}
+
+void TimerWheel::_insert(Timer* timer) {
+    /**
+     * @brief Links a timer into the slot that covers its expiry tick.
+     * A timer is placed on the lowest level whose span reaches its expiry; one beyond
+     * the top level waits in its furthest slot and is placed again when cascaded.
+     */
+    unsigned long expires = timer->expires < _current ? _current : timer->expires;
+    unsigned long delta = expires - _current;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (1UL << (SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+    if (delta >= (1UL << (SLOT_BITS * LEVELS))) {
+        expires = _current + (1UL << (SLOT_BITS * LEVELS)) - 1;
+    }
+    Timer* head = &_slots[level][(expires >> (SLOT_BITS * level)) & (SLOTS - 1)];
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+void TimerWheel::_cascade(int level, int index) {
+    /**
+     * @brief Moves the timers of one higher-level slot to the levels below it.
+     */
+    Timer* head = &_slots[level][index];
+    Timer* timer = head->next;
+    head->prev = head;
+    head->next = head;
+    while (timer != head) {
+        Timer* next = timer->next;
+        _insert(timer);
+        timer = next;
+    }
+}
+
+void TimerWheel::advance(unsigned long now_ms, std::vector<Timer*>& expired) {
+    /**
+     * @brief Turns the wheel up to the current time and collects the timers that fired.
+     * Expired timers are unscheduled before they are returned, so handlers may
+     * schedule them again.
+     * @param now_ms The current time from now().
+     * @param expired Receives the expired timers, in no particular order.
+     */
+    unsigned long target = now_ms / TICK_MS;
+    if (_count == 0) {
+        _current = target + 1; // Nothing to expire on the way
+        return;
+    }
+    while (_current <= target) {
+        int index = static_cast<int>(_current & (SLOTS - 1));
+        for (int level = 1; index == 0 && level < LEVELS; ++level) {
+            index = static_cast<int>((_current >> (SLOT_BITS * level)) & (SLOTS - 1));
+            _cascade(level, index);
+        }
+        Timer* head = &_slots[0][_current & (SLOTS - 1)];
+        while (head->next != head) {
+            Timer* timer = head->next;
+            cancel(timer);
+            expired.push_back(timer);
+        }
+        ++_current;
+        if (_count == 0) {
+            _current = target + 1;
+        }
+    }
+}
+
+int TimerWheel::getTimeout(unsigned long now_ms) const {
+    /**
+     * @brief Tells the event loop how long it may sleep before a timer could be due.
+     * Level 0 is searched for the first occupied slot; without one, the loop wakes when
+     * the next cascade may bring timers down from a higher level.
+     * @return Milliseconds to wait, or -1 if no timer is scheduled.
+     */
+    if (_count == 0) {
+        return -1;
+    }
+    unsigned long tick = _current;
+    // A cascade happens at least once every SLOTS ticks, so the search is bounded
+    while ((tick & (SLOTS - 1)) != 0 && _slots[0][tick & (SLOTS - 1)].next == &_slots[0][tick & (SLOTS - 1)]) {
+        ++tick;
+    }
+    unsigned long due = tick * TICK_MS;
+    return due <= now_ms ? 0 : static_cast<int>(due - now_ms);
+}
@@ -0,0 +1,160 @@
+#include "VirtualHostMap.hpp"
+#include <cctype>
+
+static char lowerCase(char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+}
+
+VirtualHostMap::VirtualHostMap() {}
+
+VirtualHostMap::~VirtualHostMap() {}
+
+size_t VirtualHostMap::_hash(int port, const char* name, size_t length) {
+    // FNV-1a over the port and the lowercased name
+    size_t hash = 2166136261u;
+    hash = (hash ^ static_cast<size_t>(port & 0xff)) * 16777619u;
+    hash = (hash ^ static_cast<size_t>((port >> 8) & 0xff)) * 16777619u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(lowerCase(name[i]))) * 16777619u;
+    }
+    return hash;
+}
+
+void VirtualHostMap::_init_table(std::vector<Entry>& table, size_t count) {
+    /**
+     * @brief Sizes a table to a power of two at least twice the number of names,
+     * which keeps probe sequences short.
+     */
+    size_t capacity = 8;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    Entry empty;
+    empty.port = 0;
+    empty.server = NULL;
+    table.assign(capacity, empty);
+}
+
+void VirtualHostMap::_insert(std::vector<Entry>& table, int port, const std::string& name, const ServerConfig* server) {
+    size_t mask = table.size() - 1;
+    for (size_t slot = _hash(port, name.data(), name.size()) & mask; ; slot = (slot + 1) & mask) {
+        Entry& entry = table[slot];
+        if (!entry.server) {
+            entry.port = port;
+            entry.name = name;
+            entry.server = server;
+            return;
+        }
+        if (entry.port == port && entry.name == name) {
+            return; // The first server block to claim a name keeps it
+        }
+    }
+}
+
+const ServerConfig* VirtualHostMap::_lookup(const std::vector<Entry>& table, int port, const char* name, size_t length) {
+    if (table.empty()) {
+        return NULL;
+    }
+    size_t mask = table.size() - 1;
+    for (size_t slot = _hash(port, name, length) & mask; table[slot].server; slot = (slot + 1) & mask) {
+        const Entry& entry = table[slot];
+        if (entry.port != port || entry.name.size() != length) {
+            continue;
+        }
+        size_t i = 0;
+        while (i < length && entry.name[i] == lowerCase(name[i])) {
+            ++i;
+        }
+        if (i == length) {
+            return entry.server;
+        }
+    }
+    return NULL;
+}
+
+void VirtualHostMap::build(const std::vector<ServerConfig>& configs) {
+    /**
+     * @brief Compiles the server names of every server block into the lookup tables.
+     */
+    std::vector<int> ports;
+    std::vector<std::string> exact;
+    std::vector<std::string> wildcards;
+    std::vector<const ServerConfig*> exact_servers;
+    std::vector<const ServerConfig*> wildcard_servers;
+    _defaults.clear();
+    for (size_t i = 0; i < configs.size(); ++i) {
+        const ServerConfig* server = &configs[i];
+        if (_defaults.find(server->getPort()) == _defaults.end()) {
+            _defaults[server->getPort()] = server;
+        }
+        const std::vector<std::string>& names = server->getServerNames();
+        for (size_t j = 0; j < names.size(); ++j) {
+            std::string name;
+            for (size_t k = 0; k < names[j].size(); ++k) {
+                name += lowerCase(names[j][k]);
+            }
+            if (name.size() > 2 && name.compare(0, 2, "*.") == 0) {
+                wildcards.push_back(name.substr(1));
+                wildcard_servers.push_back(server);
+            } else if (name.size() > 1 && name[0] == '.') {
+                exact.push_back(name.substr(1));
+                exact_servers.push_back(server);
+                wildcards.push_back(name);
+                wildcard_servers.push_back(server);
+            } else {
+                exact.push_back(name);
+                exact_servers.push_back(server);
+            }
+        }
+    }
+    _init_table(_exact, exact.size());
+    for (size_t i = 0; i < exact.size(); ++i) {
+        _insert(_exact, exact_servers[i]->getPort(), exact[i], exact_servers[i]);
+    }
+    _wildcards.clear();
+    if (!wildcards.empty()) {
+        _init_table(_wildcards, wildcards.size());
+        for (size_t i = 0; i < wildcards.size(); ++i) {
+            _insert(_wildcards, wildcard_servers[i]->getPort(), wildcards[i], wildcard_servers[i]);
+        }
+    }
+}
+
+const ServerConfig* VirtualHostMap::find(int port, const std::string& host) const {
+    /**
+     * @brief Returns the server block for a Host header value on a port, or NULL if
+     * no server block listens on the port.
+     */
+    size_t length = host.size();
+    if (!host.empty() && host[0] == '[') {
+        size_t end = host.find(']'); // IPv6 literal, possibly followed by a port
+        if (end != std::string::npos) {
+            length = end + 1;
+        }
+    } else {
+        size_t colon = host.find(':');
+        if (colon != std::string::npos) {
+            length = colon;
+        }
+    }
+    if (length > 0 && host[length - 1] == '.') {
+        --length;
+    }
+    if (length > 0) {
+        const char* name = host.data();
+        const ServerConfig* server = _lookup(_exact, port, name, length);
+        if (server) {
+            return server;
+        }
+        if (!_wildcards.empty()) {
+            // Suffixes starting at each dot, longest first
+            for (size_t dot = 1; dot < length; ++dot) {
+                if (name[dot] == '.' && (server = _lookup(_wildcards, port, name + dot, length - dot))) {
+                    return server;
+                }
+            }
+        }
+    }
+    std::map<int, const ServerConfig*>::const_iterator it = _defaults.find(port);
+    return it != _defaults.end() ? it->second : NULL;
+}
@@ -1,8 +1,11 @@
 #include "WebServer.hpp"
 #include "ConfigParser.hpp"
-#include <iostream>
+#include "Gzip.hpp"
+#include "Logger.hpp"
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h> // For TCP_NODELAY
+#include <arpa/inet.h> // For inet_ntop
 #include <unistd.h>
 #include <fcntl.h> // For fcntl
 #include <cstring> // For memset
@@ -14,125 +17,795 @@
 #include <cerrno> // For errno
 #include <sys/wait.h> // For waitpid
 #include <vector> // For std::vector
+#include <cstdlib> // For exit
+#include <ctime> // For time
+#include <algorithm> // For std::transform
+#include <csignal> // For sig_atomic_t
+
+// How long in-flight requests may take to finish once shutdown has been requested
+static const int SHUTDOWN_TIMEOUT = 10;
+// More ranges than this in one request are answered with the full file
+static const size_t MAX_BYTE_RANGES = 64;
+// Larger files are sent uncompressed rather than compressed in memory on the event
+// loop; gzip_static serves precompressed copies of them instead
+static const off_t MAX_GZIP_FILE_SIZE = 4 * 1024 * 1024;
 
 // Global flag for graceful shutdown
-extern bool g_running;
+extern volatile sig_atomic_t g_running;
+// Set by SIGHUP to have the configuration file read again
+extern volatile sig_atomic_t g_reload;
+
+// Write end of the self-pipe that turns SIGCHLD, shutdown and reload signals into an event loop notification
+static int g_child_pipe = -1;
+
+static void childSignalHandler(int) {
+    int saved_errno = errno;
+    if (g_child_pipe >= 0) {
+        ssize_t ignored = write(g_child_pipe, "c", 1); // A full pipe already wakes the loop
+        (void)ignored;
+    }
+    errno = saved_errno;
+}
+
+// The event loop may sleep until the next timer is due, possibly indefinitely,
+// so a shutdown request has to wake it up as well
+static void stopSignalHandler(int) {
+    g_running = 0;
+    childSignalHandler(0);
+}
+
+static void reloadSignalHandler(int) {
+    g_reload = 1;
+    childSignalHandler(0);
+}
+
+static std::string portToString(int port) {
+    std::stringstream ss;
+    ss << port;
+    return ss.str();
+}
 
-WebServer::WebServer(const std::string& config_file) {
+WebServer::WebServer(const std::string& config_file)
+    : _config_file(config_file), _config(NULL), _event_loop(NULL), _file_cache(NULL), _response_cache(NULL), _access_log(NULL), _shutting_down(false),
+      _accepting(true), _spare_fd(-1), _connection_count(0) {
     ConfigParser parser(config_file);
-    _configs = parser.parse();
-    _setup_listening_sockets();
+    std::vector<ServerConfig> servers = parser.parse();
+    _global_config = parser.getGlobalConfig();
+    _event_loop = EventLoop::create(_global_config.getEventBackend());
+    _file_cache = new FileCache(_global_config.getOpenFileCacheMax(), _global_config.getOpenFileCacheValid());
+    _response_cache = new ResponseCache(_global_config.getStaticCacheSize(), _global_config.getStaticCacheMaxFileSize());
+    LOG(Logger::LEVEL_NOTICE, "Using " << _event_loop->getName() << " event backend");
+    _child_pipe[0] = -1;
+    _child_pipe[1] = -1;
+    _config = new ConfigGeneration(servers);
+    try {
+        if (!_global_config.getAccessLog().empty()) {
+            _access_log = new AccessLog(_global_config.getAccessLog(), _global_config.getLogFormat());
+        }
+        _setup_listening_sockets();
+        _setup_child_signal();
+        // Held in reserve so that a client can still be turned away at the fd limit
+        _spare_fd = open("/dev/null", O_RDONLY);
+        if (_spare_fd >= 0) {
+            fcntl(_spare_fd, F_SETFD, FD_CLOEXEC);
+        }
+    } catch (...) {
+        for (std::map<int, int>::iterator it = _listening_sockets.begin(); it != _listening_sockets.end(); ++it) {
+            close(it->second);
+        }
+        delete _access_log;
+        delete _response_cache;
+        delete _file_cache;
+        delete _event_loop;
+        delete _config;
+        throw;
+    }
 }
 
 WebServer::~WebServer() {
-    for (size_t i = 0; i < _fds.size(); ++i) {
-        close(_fds[i].fd);
+    // Scripts still running at exit are killed so that none outlives the server
+    for (std::map<pid_t, CgiProcess*>::iterator it = _cgi_processes.begin(); it != _cgi_processes.end(); ++it) {
+        it->second->kill();
+        waitpid(it->first, NULL, 0);
+        delete it->second;
+    }
+    for (std::map<std::string, FastCgiUpstream*>::iterator it = _fastcgi_upstreams.begin(); it != _fastcgi_upstreams.end(); ++it) {
+        delete it->second;
+    }
+    if (_child_pipe[0] >= 0) {
+        signal(SIGCHLD, SIG_DFL);
+        g_child_pipe = -1;
+        close(_child_pipe[0]);
+        close(_child_pipe[1]);
+    }
+    _delete_closed();
+    for (size_t fd = 0; fd < _connections.size(); ++fd) {
+        delete _connections[fd];
+    }
+    for (std::map<int, int>::iterator it = _listening_sockets.begin(); it != _listening_sockets.end(); ++it) {
+        close(it->second);
+    }
+    if (_spare_fd >= 0) {
+        close(_spare_fd);
+    }
+    delete _access_log;
+    delete _response_cache;
+    delete _file_cache; // After the connections, which may still reference cached files
+    delete _event_loop;
+    for (size_t i = 0; i < _retired_configs.size(); ++i) {
+        delete _retired_configs[i];
+    }
+    delete _config;
+}
+
+void WebServer::_setup_child_signal() {
+    /**
+     * @brief Routes SIGCHLD through a non-blocking self-pipe watched by the event loop,
+     * so exited CGI children are reaped from run() rather than inside the handler.
+     * SIGINT, SIGTERM and SIGHUP write to the same pipe so that a shutdown or reload
+     * is noticed at once.
+     */
+    if (pipe(_child_pipe) == -1) {
+        throw std::runtime_error("Cannot create SIGCHLD pipe");
+    }
+    for (int i = 0; i < 2; ++i) {
+        fcntl(_child_pipe[i], F_SETFL, O_NONBLOCK);
+        fcntl(_child_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+    g_child_pipe = _child_pipe[1];
+    _child_target.type = EventTarget::SIGNAL;
+    _child_target.fd = _child_pipe[0];
+    _child_target.owner = NULL;
+    _event_loop->add(_child_pipe[0], EventLoop::EVENT_READ, &_child_target);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = childSignalHandler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    sa.sa_handler = stopSignalHandler;
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    sa.sa_handler = reloadSignalHandler;
+    sigaction(SIGHUP, &sa, NULL);
+}
+
+void WebServer::_delete_closed() {
+    /**
+     * @brief Frees connections and scripts retired during the last loop iteration,
+     * and configurations replaced by a reload that no request uses any more.
+     */
+    for (size_t i = 0; i < _closed_connections.size(); ++i) {
+        delete _closed_connections[i];
+    }
+    _closed_connections.clear();
+    for (size_t i = 0; i < _finished_cgis.size(); ++i) {
+        delete _finished_cgis[i];
+    }
+    _finished_cgis.clear();
+    for (std::map<std::string, FastCgiUpstream*>::iterator it = _fastcgi_upstreams.begin(); it != _fastcgi_upstreams.end(); ++it) {
+        it->second->deleteClosed();
+    }
+    for (size_t i = 0; i < _retired_configs.size(); ) {
+        if (_retired_configs[i]->requests == 0) {
+            delete _retired_configs[i];
+            _retired_configs.erase(_retired_configs.begin() + i);
+            _metrics.forgetLocations(); // its Location addresses may be reused
+        } else {
+            ++i;
+        }
     }
 }
 
 void WebServer::_setup_listening_sockets() {
-    for (size_t i = 0; i < _configs.size(); ++i) {
-        int port = _configs[i].getPort();
+    for (size_t i = 0; i < _config->servers.size(); ++i) {
+        int port = _config->servers[i].getPort();
         if (_listening_sockets.find(port) == _listening_sockets.end()) {
-            int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-            if (server_fd < 0) {
-                throw std::runtime_error("Cannot create socket for port " + std::to_string(port));
-            }
+            _add_listener(port, _open_listener(port));
+        }
+    }
+}
 
-            // Set socket to non-blocking
-            if (fcntl(server_fd, F_SETFL, O_NONBLOCK) < 0) {
-                close(server_fd);
-                throw std::runtime_error("Cannot set socket to non-blocking for port " + std::to_string(port));
-            }
+int WebServer::_open_listener(int port) {
+    /**
+     * @brief Creates a non-blocking socket listening on the port on all addresses.
+     * @return The listening socket; throws if the port cannot be bound.
+     */
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+        throw std::runtime_error("Cannot create socket for port " + portToString(port));
+    }
 
-            // Allow socket to reuse address and port (for quick restart)
-            int opt = 1;
-            if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-                close(server_fd);
-                throw std::runtime_error("Cannot set SO_REUSEADDR for port " + std::to_string(port));
-            }
+    // Set socket to non-blocking; CGI children must not keep a place in the
+    // SO_REUSEPORT group, where connections hashed to them would never be accepted
+    if (fcntl(server_fd, F_SETFL, O_NONBLOCK) < 0 || fcntl(server_fd, F_SETFD, FD_CLOEXEC) < 0) {
+        close(server_fd);
+        throw std::runtime_error("Cannot set socket to non-blocking for port " + portToString(port));
+    }
+
+    // Allow socket to reuse address and port (for quick restart)
+    int opt = 1;
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        close(server_fd);
+        throw std::runtime_error("Cannot set SO_REUSEADDR for port " + portToString(port));
+    }
 #ifdef SO_REUSEPORT
-            if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
-                close(server_fd);
-                throw std::runtime_error("Cannot set SO_REUSEPORT for port " + std::to_string(port));
-            }
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        close(server_fd);
+        throw std::runtime_error("Cannot set SO_REUSEPORT for port " + portToString(port));
+    }
 #endif
 
-            sockaddr_in server_addr;
-            memset(&server_addr, 0, sizeof(server_addr));
-            server_addr.sin_family = AF_INET;
-            server_addr.sin_addr.s_addr = INADDR_ANY;
-            server_addr.sin_port = htons(port);
+    sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(port);
 
-            if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-                close(server_fd);
-                throw std::runtime_error("Cannot bind to port " + std::to_string(port));
-            }
+    if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        close(server_fd);
+        throw std::runtime_error("Cannot bind to port " + portToString(port));
+    }
 
-            if (listen(server_fd, 1024) < 0) { // SOMAXCONN is often 128, 1024 is a common high value
-                close(server_fd);
-                throw std::runtime_error("Cannot listen on port " + std::to_string(port));
-            }
+    if (listen(server_fd, 1024) < 0) { // SOMAXCONN is often 128, 1024 is a common high value
+        close(server_fd);
+        throw std::runtime_error("Cannot listen on port " + portToString(port));
+    }
+    return server_fd;
+}
+
+void WebServer::_add_listener(int port, int fd) {
+    LOG(Logger::LEVEL_NOTICE, "Server listening on port " << port);
+    _listening_sockets[port] = fd;
+    _listener_ports[fd] = port;
+    EventTarget& target = _listener_targets[fd];
+    target.type = EventTarget::LISTENER;
+    target.fd = fd;
+    target.owner = NULL;
+    if (_accepting) { // Otherwise registered by _resume_accepting()
+        _event_loop->add(fd, EventLoop::EVENT_READ, &target);
+    }
+}
+
+void WebServer::_remove_listener(int port) {
+    /**
+     * @brief Stops listening on a port. Connections accepted on it stay open.
+     */
+    int fd = _listening_sockets[port];
+    if (_accepting) {
+        _event_loop->remove(fd);
+    }
+    close(fd);
+    _pending_accepts.erase(std::remove(_pending_accepts.begin(), _pending_accepts.end(), fd), _pending_accepts.end());
+    _listener_ports.erase(fd);
+    _listener_targets.erase(fd);
+    _listening_sockets.erase(port);
+    LOG(Logger::LEVEL_NOTICE, "Stopped listening on port " << port);
+}
 
-            std::cout << "Server listening on port " << port << "..." << std::endl;
-            _fds.push_back((pollfd){server_fd, POLLIN, 0});
-            _listening_sockets[port] = server_fd;
+bool WebServer::_handle_new_connection(int listener_fd) {
+    /**
+     * @brief Accepts a batch of pending connections on a listening socket.
+     * At most accept_batch connections are taken per wakeup, so a burst of new
+     * clients cannot starve established ones; the caller revisits an edge-triggered
+     * listener that may still have a backlog. Once worker_connections are open the
+     * listeners are paused and further clients wait in the kernel's accept queue.
+     * @param listener_fd The listening socket that became readable.
+     * @return true if the batch ran out before the accept queue did.
+     */
+    size_t batch = _global_config.getAcceptBatch();
+    for (size_t accepted = 0; accepted < batch; ++accepted) {
+        if (_connection_count >= _global_config.getWorkerConnections()) {
+            _pause_accepting();
+            return false;
+        }
+        sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+#ifdef __linux__
+        int client_fd = accept4(listener_fd, (struct sockaddr *)&client_addr, &client_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        int client_fd = accept(listener_fd, (struct sockaddr *)&client_addr, &client_len);
+        if (client_fd >= 0 && (fcntl(client_fd, F_SETFL, O_NONBLOCK) < 0 || fcntl(client_fd, F_SETFD, FD_CLOEXEC) < 0)) {
+            close(client_fd);
+            LOG(Logger::LEVEL_ERROR, "Cannot set client socket to non-blocking");
+            continue;
+        }
+#endif
+        if (client_fd < 0) {
+            if (errno == EMFILE || errno == ENFILE) {
+                if (!_shed_connection(listener_fd)) {
+                    return false;
+                }
+                continue;
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            // Handle EAGAIN/EWOULDBLOCK for non-blocking sockets
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG(Logger::LEVEL_ERROR, "accept() failed: " << strerror(errno));
+            }
+            return false;
+        }
+        // Headers and a sendfile() body leave as separate segments; with Nagle on, the
+        // body would wait for the client's delayed ACK of the headers
+        int nodelay = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        char address[INET_ADDRSTRLEN];
+        if (!inet_ntop(AF_INET, &client_addr.sin_addr, address, sizeof(address))) {
+            address[0] = '\0';
+        }
+        size_t limit = _global_config.getLimitConnPerIp();
+        if (limit > 0) {
+            std::map<std::string, size_t>::iterator count = _connections_per_ip.find(address);
+            if (count != _connections_per_ip.end() && count->second >= limit) {
+                _turn_away(client_fd);
+                _metrics.connectionRefused();
+                continue;
+            }
         }
+        LOG(Logger::LEVEL_DEBUG, "New connection accepted on fd " << client_fd << " from " << address);
+        Connection* conn = new Connection(client_fd, _listener_ports[listener_fd], address);
+        // The Host header is not known yet, so the port's default server sets the timeouts
+        const ServerConfig* server_config = _get_server_config(*conn, "");
+        if (server_config) {
+            conn->setTimeouts(server_config->getClientHeaderTimeout(), server_config->getClientBodyTimeout(),
+                              server_config->getSendTimeout());
+        }
+        if (static_cast<size_t>(client_fd) >= _connections.size()) {
+            _connections.resize(client_fd + 1, NULL);
+        }
+        _connections[client_fd] = conn;
+        ++_connection_count;
+        ++_connections_per_ip[conn->getRemoteAddress()];
+        _metrics.connectionAccepted();
+        _event_loop->add(client_fd, EventLoop::EVENT_READ, conn->getEventTarget());
+        _update_connection_timer(*conn);
+    }
+    return true;
+}
+
+bool WebServer::_shed_connection(int listener_fd) {
+    /**
+     * @brief Turns away one queued client after accept() failed for lack of file
+     * descriptors. The spare descriptor is released so that the client can be
+     * accepted and answered with 503, then reopened. Without this the pending
+     * connection would keep the listener readable and the loop spinning on it.
+     * @return true if a client was turned away and accepting may go on.
+     */
+    LOG(Logger::LEVEL_ERROR, "Out of file descriptors, turning away a client");
+    if (_spare_fd < 0) {
+        // No way to drain the queue: wait for a connection to close instead
+        _pause_accepting();
+        return false;
+    }
+    close(_spare_fd);
+    int client_fd = accept(listener_fd, NULL, NULL);
+    if (client_fd >= 0) {
+        _turn_away(client_fd);
+        _metrics.connectionRefused();
+    }
+    _spare_fd = open("/dev/null", O_RDONLY);
+    if (_spare_fd >= 0) {
+        fcntl(_spare_fd, F_SETFD, FD_CLOEXEC);
+    }
+    return client_fd >= 0;
+}
+
+void WebServer::_turn_away(int client_fd) {
+    /**
+     * @brief Answers a client that is not going to be served with 503 and closes it.
+     * The response is a single non-blocking send(); if it does not fit, the client
+     * just sees the connection close.
+     */
+    static const char response[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                   "Content-Length: 0\r\n"
+                                   "Connection: close\r\n"
+                                   "\r\n";
+    ssize_t ignored = send(client_fd, response, sizeof(response) - 1, MSG_DONTWAIT);
+    (void)ignored;
+    close(client_fd);
+}
+
+void WebServer::_pause_accepting() {
+    /**
+     * @brief Stops watching the listeners until a connection closes.
+     */
+    if (!_accepting) {
+        return;
     }
+    LOG(Logger::LEVEL_WARN, _connection_count << " connections open, pausing accept");
+    for (std::map<int, int>::iterator it = _listener_ports.begin(); it != _listener_ports.end(); ++it) {
+        _event_loop->remove(it->first);
+    }
+    _pending_accepts.clear();
+    _accepting = false;
+}
+
+void WebServer::_resume_accepting() {
+    /**
+     * @brief Watches the listeners again after _pause_accepting(). Registering a
+     * listener reports a connection that queued up meanwhile with either backend.
+     */
+    if (_accepting || _shutting_down) {
+        return;
+    }
+    for (std::map<int, int>::iterator it = _listener_ports.begin(); it != _listener_ports.end(); ++it) {
+        _event_loop->add(it->first, EventLoop::EVENT_READ, &_listener_targets[it->first]);
+    }
+    _accepting = true;
 }
 
-void WebServer::_handle_new_connection(int listener_fd) {
-    sockaddr_in client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    int client_fd = accept(listener_fd, (struct sockaddr *)&client_addr, &client_len);
+void WebServer::_set_client_events(Connection& conn, int events) {
+    _event_loop->modify(conn.getFd(), events, conn.getEventTarget());
+}
+
+int WebServer::_backend_wait_events(const Connection& conn) const {
+    /**
+     * @brief What a client is watched for, besides writing, while a backend works on
+     * its request: the client shutting down its side, unless the connection closes
+     * after this response anyway. A connection that is gone is reported regardless.
+     */
+    return conn.getCgi() && conn.getCgi()->getKeepAlive() ? EventLoop::EVENT_PEER_SHUTDOWN : 0;
+}
 
-    if (client_fd < 0) {
-        // Handle EAGAIN/EWOULDBLOCK for non-blocking sockets
-        if (errno != EAGAIN && errno != EWOULDBLOCK) {
-            std::cerr << "Error: accept() failed" << std::endl;
+void WebServer::_close_connection(int client_fd) {
+    /**
+     * @brief Stops watching a client and schedules its Connection for deletion at the
+     * end of the current event loop iteration. A script or FastCGI request still
+     * working on the client's request is aborted.
+     */
+    _event_loop->remove(client_fd);
+    Connection* conn = static_cast<size_t>(client_fd) < _connections.size() ? _connections[client_fd] : NULL;
+    if (conn) {
+        if (conn->getCgi()) {
+            CgiRequest* cgi = conn->getCgi();
+            conn->setCgi(NULL);
+            _abort_cgi(*cgi);
+        }
+        _timers.cancel(conn->getTimer());
+        _unpin_config(*conn);
+        _metrics.connectionClosed(conn->getBytesReceived(), conn->getBytesSent());
+        conn->markClosed();
+        _connections[client_fd] = NULL;
+        --_connection_count;
+        _closed_connections.push_back(conn); // closes the socket once deleted
+        std::map<std::string, size_t>::iterator count = _connections_per_ip.find(conn->getRemoteAddress());
+        if (count != _connections_per_ip.end() && --count->second == 0) {
+            _connections_per_ip.erase(count);
+        }
+        if (_connection_count < _global_config.getWorkerConnections()) {
+            _resume_accepting();
         }
     } else {
-        // Set client socket to non-blocking
-        if (fcntl(client_fd, F_SETFL, O_NONBLOCK) < 0) {
-            close(client_fd);
-            std::cerr << "Error: Cannot set client socket to non-blocking" << std::endl;
-            return;
+        close(client_fd);
+    }
+}
+
+std::string WebServer::_make_etag(const CachedFile* file, bool weak) {
+    /**
+     * @brief Builds an entity tag from the file's inode, size and mtime.
+     * A strong tag promises byte-identical content; a weak one (W/ prefix) is used
+     * for representations derived from the file, such as compressed variants.
+     */
+    std::stringstream ss;
+    ss << (weak ? "W/\"" : "\"") << std::hex << file->getInode() << "-" << file->getSize() << "-" << file->getMtime() << "\"";
+    return ss.str();
+}
+
+bool WebServer::_etag_matches(const std::string& header, const std::string& etag) {
+    /**
+     * @brief Checks an If-None-Match list against an entity tag using weak comparison.
+     * @param header The If-None-Match value: "*" or a comma-separated list of tags.
+     * @param etag The current entity tag.
+     */
+    std::string opaque = etag.compare(0, 2, "W/") == 0 ? etag.substr(2) : etag;
+    size_t pos = 0;
+    while (pos < header.length()) {
+        size_t end = header.find(',', pos);
+        if (end == std::string::npos) end = header.length();
+        size_t first = header.find_first_not_of(" \t", pos);
+        size_t last = header.find_last_not_of(" \t", end - 1);
+        if (first != std::string::npos && first < end) {
+            std::string tag = header.substr(first, last - first + 1);
+            if (tag == "*") return true;
+            if (tag.compare(0, 2, "W/") == 0) tag = tag.substr(2);
+            if (tag == opaque) return true;
         }
-        std::cout << "New connection accepted on fd " << client_fd << std::endl;
-        _fds.push_back((pollfd){client_fd, POLLIN, 0});
+        pos = end + 1;
+    }
+    return false;
+}
+
+bool WebServer::_is_not_modified(const HttpRequest& request, const CachedFile* file, const std::string& etag) {
+    /**
+     * @brief Evaluates the request's cache validators against the file.
+     * If-None-Match takes precedence; If-Modified-Since is only consulted without it.
+     * @return true if a 304 Not Modified may be sent instead of the body.
+     */
+    const std::string& if_none_match = request.getHeader(HttpRequest::HEADER_IF_NONE_MATCH);
+    if (!if_none_match.empty()) {
+        return _etag_matches(if_none_match, etag);
+    }
+    const std::string& if_modified_since = request.getHeader(HttpRequest::HEADER_IF_MODIFIED_SINCE);
+    if (!if_modified_since.empty()) {
+        time_t since = HttpRequest::parseHttpDate(if_modified_since);
+        return since != -1 && file->getMtime() <= since;
     }
+    return false;
 }
 
-#include "HttpRequest.hpp"
-#include "HttpResponse.hpp"
+void WebServer::_set_cache_headers(const Location* location, const CachedFile* file, const std::string& etag, HttpResponse& response) {
+    /**
+     * @brief Adds validators (ETag, Last-Modified) and the location's freshness policy.
+     * 'expires' yields both an Expires date and a Cache-Control max-age; 'cache_control'
+     * values are placed in front of the max-age directive.
+     */
+    response.setHeader("ETag", etag);
+    response.setHeader("Last-Modified", HttpResponse::formatHttpDate(file->getMtime()));
+
+    std::string cache_control = location->getCacheControl();
+    if (location->getExpires() >= 0) {
+        std::stringstream max_age;
+        max_age << "max-age=" << location->getExpires();
+        cache_control += (cache_control.empty() ? "" : ", ") + max_age.str();
+        response.setHeader("Expires", HttpResponse::formatHttpDate(time(NULL) + location->getExpires()));
+    }
+    if (!cache_control.empty()) {
+        response.setHeader("Cache-Control", cache_control);
+    }
+}
 
-void WebServer::_serve_static_file(const std::string& file_path, HttpResponse& response) const {
-    std::ifstream file(file_path.c_str(), std::ios::in | std::ios::binary);
-    if (!file.is_open()) {
-        response.setStatusCode(404);
-        response.setBody("404 Not Found");
+bool WebServer::_if_range_matches(const HttpRequest& request, const CachedFile* file, const std::string& etag) {
+    /**
+     * @brief Evaluates If-Range: a Range is only honoured if the validator still matches.
+     * Entity tags use strong comparison, so weak tags never match; a date must equal
+     * Last-Modified exactly.
+     */
+    const std::string& if_range = request.getHeader(HttpRequest::HEADER_IF_RANGE);
+    if (if_range.empty()) {
+        return true;
+    }
+    if (if_range[0] == '"') {
+        return if_range == etag;
+    }
+    if (if_range.compare(0, 2, "W/") == 0) {
+        return false;
+    }
+    return HttpRequest::parseHttpDate(if_range) == file->getMtime();
+}
+
+void WebServer::_serve_byte_ranges(const Location* location, CachedFile* file, const std::string& content_type, const std::string& etag, const std::vector<ByteRange>& ranges, HttpResponse& response) {
+    /**
+     * @brief Fills a 206 response with the requested ranges of the file, or a 416 if none is
+     * satisfiable. Several ranges become a multipart/byteranges body whose parts are
+     * still streamed straight from the file.
+     */
+    std::stringstream complete_length;
+    complete_length << file->getSize();
+    response.setHeader("Accept-Ranges", "bytes");
+    if (ranges.empty()) {
+        response.setStatusCode(416);
+        response.setHeader("Content-Range", "bytes */" + complete_length.str());
+        return;
+    }
+
+    response.setStatusCode(206);
+    _set_cache_headers(location, file, etag, response);
+    file->retain(); // The response keeps its own reference while the body is sent
+    if (ranges.size() == 1) {
+        std::stringstream content_range;
+        content_range << "bytes " << ranges[0].first << "-" << ranges[0].last << "/" << file->getSize();
+        response.setBodyFile(file, ranges[0].first, static_cast<size_t>(ranges[0].last - ranges[0].first + 1));
+        response.setHeader("Content-Type", content_type);
+        response.setHeader("Content-Range", content_range.str());
+        return;
+    }
+
+    static unsigned long boundary_counter = 0;
+    std::stringstream boundary;
+    boundary << "webserv-" << std::hex << file->getInode() << "-" << ++boundary_counter;
+    response.setBodyFile(file, 0, 0);
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        std::stringstream part;
+        part << "\r\n--" << boundary.str() << "\r\n"
+             << "Content-Type: " << content_type << "\r\n"
+             << "Content-Range: bytes " << ranges[i].first << "-" << ranges[i].last << "/" << file->getSize() << "\r\n\r\n";
+        response.addBodyFileRange(part.str(), ranges[i].first, static_cast<size_t>(ranges[i].last - ranges[i].first + 1));
+    }
+    response.setBodyEpilogue("\r\n--" + boundary.str() + "--\r\n");
+    response.setHeader("Content-Type", "multipart/byteranges; boundary=" + boundary.str());
+}
+
+void WebServer::_serve_static_file(const HttpRequest& request, const Location* location, CachedFile* file, HttpResponse& response) const {
+    /**
+     * @brief Selects the representation of a static file to send.
+     * With gzip_static, a precompressed "<file>.gz" sibling is sent as is to clients
+     * that accept gzip; with gzip, suitable files are compressed on the fly. Responses
+     * of a file that has a compressed variant carry Vary: Accept-Encoding, so shared
+     * caches keep the variants apart.
+     * @param request The request being answered.
+     * @param location The matched location, for its caching and compression policy.
+     * @param file An open regular file, typically from the FileCache.
+     * @param response The response to fill; its Connection header is already set.
+     */
+    bool accepts_gzip = request.acceptsEncoding("gzip");
+    bool vary = false;
+    if (location->getGzipStatic()) {
+        CachedFile* variant = _file_cache->get(file->getPath() + ".gz");
+        if (variant->isRegularFile()) {
+            vary = true;
+            if (accepts_gzip) {
+                _serve_file_representation(request, location, variant, file->getContentType(), "gzip", true, response);
+                variant->release();
+                return;
+            }
+        }
+        variant->release();
+    }
+    if (location->getGzip() && location->isGzipType(file->getContentType())
+        && file->getSize() >= static_cast<off_t>(location->getGzipMinLength()) && file->getSize() <= MAX_GZIP_FILE_SIZE) {
+        vary = true;
+        if (accepts_gzip && _serve_compressed_file(request, location, file, response)) {
+            return;
+        }
+    }
+    _serve_file_representation(request, location, file, file->getContentType(), "", vary, response);
+}
+
+void WebServer::_serve_file_representation(const HttpRequest& request, const Location* location, CachedFile* file,
+                                           const std::string& content_type, const std::string& encoding, bool vary,
+                                           HttpResponse& response) const {
+    /**
+     * @brief Prepares a response for a stored file without reading it into memory.
+     * Conditional requests whose validators match get a bodyless 304, and Range requests
+     * a 206 built from offsets into the open file. Small files are
+     * answered from the ResponseCache when possible: the fully rendered response is
+     * queued as one shared buffer. Otherwise the open file is attached to the response
+     * and streamed with sendfile() after the headers.
+     * @param file The file to send: the requested one or its precompressed variant.
+     * @param content_type The media type of the requested file.
+     * @param encoding The Content-Encoding of file, empty for none.
+     * @param vary Whether the response depends on Accept-Encoding.
+     */
+    if (vary) {
+        response.setHeader("Vary", "Accept-Encoding");
+    }
+    std::string etag = _make_etag(file, false);
+    if (_is_not_modified(request, file, etag)) {
+        response.setStatusCode(304);
+        _set_cache_headers(location, file, etag, response);
         return;
     }
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    response.setBody(buffer.str());
+    std::vector<ByteRange> ranges;
+    if (request.getByteRanges(file->getSize(), ranges) && _if_range_matches(request, file, etag)) {
+        // Overlapping or excessive ranges could make the reply far larger than the file itself
+        off_t total = 0;
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            total += ranges[i].last - ranges[i].first + 1;
+        }
+        if (ranges.size() <= MAX_BYTE_RANGES && total <= file->getSize()) {
+            if (!encoding.empty() && !ranges.empty()) {
+                response.setHeader("Content-Encoding", encoding);
+            }
+            _serve_byte_ranges(location, file, content_type, etag, ranges, response);
+            return;
+        }
+    }
+
+    bool cacheable = _response_cache->accepts(file->getSize());
+    std::string cache_key;
+    if (cacheable) {
+        cache_key = file->getPath() + "|" + location->getPath() + "|" + response.getHeader("Connection") + (vary ? "|vary" : "");
+        SharedBuffer* cached = _response_cache->get(cache_key, file);
+        if (cached) {
+            response.setStatusCode(200);
+            response.setRendered(cached);
+            return;
+        }
+    }
+
+    file->retain(); // The response keeps its own reference while the body is sent
+    response.setBodyFile(file, 0, static_cast<size_t>(file->getSize()));
     response.setStatusCode(200);
+    response.setHeader("Content-Type", content_type);
+    if (!encoding.empty()) {
+        response.setHeader("Content-Encoding", encoding);
+    }
+    response.setHeader("Accept-Ranges", "bytes");
+    _set_cache_headers(location, file, etag, response);
+
+    if (cacheable) {
+        std::string rendered = response.headersToString();
+        size_t header_length = rendered.length();
+        rendered.resize(header_length + file->getSize());
+        ssize_t bytes_read = file->getSize() > 0 ? pread(file->getFd(), &rendered[header_length], file->getSize(), 0) : 0;
+        if (bytes_read == file->getSize()) {
+            // An Expires date goes stale, so such renderings are only reused within the second
+            time_t valid_until = location->getExpires() >= 0 ? time(NULL) + 1 : 0;
+            response.setRendered(_response_cache->put(cache_key, file, rendered, valid_until));
+        }
+    }
+}
 
-    // Basic Content-Type detection (can be improved)
-    if (file_path.find(".html") != std::string::npos) {
-        response.setHeader("Content-Type", "text/html");
-    } else if (file_path.find(".css") != std::string::npos) {
-        response.setHeader("Content-Type", "text/css");
-    } else if (file_path.find(".js") != std::string::npos) {
-        response.setHeader("Content-Type", "application/javascript");
-    } else if (file_path.find(".jpg") != std::string::npos || file_path.find(".jpeg") != std::string::npos) {
-        response.setHeader("Content-Type", "image/jpeg");
-    } else if (file_path.find(".png") != std::string::npos) {
-        response.setHeader("Content-Type", "image/png");
-    } else {
-        response.setHeader("Content-Type", "application/octet-stream");
+bool WebServer::_serve_compressed_file(const HttpRequest& request, const Location* location, CachedFile* file, HttpResponse& response) const {
+    /**
+     * @brief Answers with a gzip-compressed copy of the file, compressed on the fly.
+     * The compressed body is not byte-identical to the file, so it gets a weak ETag and
+     * Range requests are answered with the full body. Renderings go to the ResponseCache
+     * like those of uncompressed files, so a popular file is compressed once per change.
+     * @return false if the file could not be read or compressed; the caller then sends
+     * it uncompressed.
+     */
+    response.setHeader("Vary", "Accept-Encoding");
+    std::string etag = _make_etag(file, true);
+    if (_is_not_modified(request, file, etag)) {
+        response.setStatusCode(304);
+        _set_cache_headers(location, file, etag, response);
+        return true;
+    }
+
+    std::string cache_key = file->getPath() + "|" + location->getPath() + "|" + response.getHeader("Connection") + "|gzip";
+    SharedBuffer* cached = _response_cache->get(cache_key, file);
+    if (cached) {
+        response.setStatusCode(200);
+        response.setRendered(cached);
+        return true;
+    }
+
+    std::string content(static_cast<size_t>(file->getSize()), '\0');
+    ssize_t bytes_read = file->getSize() > 0 ? pread(file->getFd(), &content[0], content.size(), 0) : 0;
+    std::string compressed;
+    if (bytes_read != file->getSize()
+        || !Gzip::compress(content.data(), content.size(), location->getGzipCompLevel(), compressed)) {
+        return false;
+    }
+
+    response.setStatusCode(200);
+    response.setHeader("Content-Type", file->getContentType());
+    response.setHeader("Content-Encoding", "gzip");
+    _set_cache_headers(location, file, etag, response);
+    response.setBody(compressed);
+    if (_response_cache->accepts(compressed.size())) {
+        time_t valid_until = location->getExpires() >= 0 ? time(NULL) + 1 : 0;
+        response.setRendered(_response_cache->put(cache_key, file, response.headersToString() + compressed, valid_until));
+    }
+    return true;
+}
+
+void WebServer::_handle_get_request(const HttpRequest& request, const ServerConfig* server_config, const Location* location, HttpResponse& response) const {
+    /**
+     * @brief Serves a GET for a file or directory under the location's root.
+     * Path lookups, including the probe for a directory's index file, go through
+     * the FileCache so a hit costs no system call.
+     */
+    std::string full_path = location->getRoot() + request.getUri();
+    CachedFile* file = _file_cache->get(full_path);
+    if (!file->exists()) {
+        _serve_error_page(404, server_config, response);
+    } else if (file->isDirectory()) {
+        std::string index_file_path = full_path + (full_path[full_path.length() - 1] == '/' ? "" : "/") + location->getIndex();
+        CachedFile* index_file = _file_cache->get(index_file_path);
+        if (index_file->isRegularFile()) {
+            _serve_static_file(request, location, index_file, response);
+        } else if (location->getAutoIndex()) {
+            _generate_autoindex(full_path, request.getUri(), response);
+        } else {
+            _serve_error_page(403, server_config, response);
+        }
+        index_file->release();
+    } else if (file->isRegularFile()) {
+        _serve_static_file(request, location, file, response);
+    } else { // Not a regular file or directory
+        _serve_error_page(403, server_config, response);
     }
+    file->release();
 }
 
 void WebServer::_generate_autoindex(const std::string& directory_path, const std::string& uri_path, HttpResponse& response) const {
@@ -162,32 +835,19 @@ void WebServer::_generate_autoindex(const std::string& directory_path, const std
     response.setBody(ss.str());
 }
 
-void WebServer::_handle_post_request(const HttpRequest& request, const ServerConfig* server_config, const Location* location, HttpResponse& response) const {
-    // Check client_max_body_size
-    if (request.getBody().length() > server_config->getClientMaxBodySize()) {
-        response.setStatusCode(413);
-        response.setBody("413 Payload Too Large");
-        return;
-    }
-
-    std::string upload_dir = location->getRoot();
-    // Ensure upload directory exists
-    if (mkdir(upload_dir.c_str(), 0755) == -1 && errno != EEXIST) {
-        response.setStatusCode(500);
-        response.setBody("500 Internal Server Error: Could not create upload directory");
-        return;
-    }
-
-    std::string file_path = upload_dir + request.getUri().substr(location->getPath().length());
-    std::ofstream outfile(file_path.c_str(), std::ios::out | std::ios::binary);
-    if (!outfile.is_open()) {
+void WebServer::_handle_post_request(const HttpRequest& request, RequestBody& body, const Location* location, HttpResponse& response) const {
+    /**
+     * @brief Completes an upload whose body was streamed to a temporary file.
+     * The body size was enforced while it arrived (see _start_request_body()); here
+     * the temporary file only has to be renamed over its destination.
+     */
+    std::string file_path = location->getRoot() + request.getUri().substr(location->getPath().length());
+    if (!body.isFile() || !body.commit(file_path)) {
         response.setStatusCode(500);
-        response.setBody("500 Internal Server Error: Could not open file for writing");
+        response.setBody("500 Internal Server Error: Could not store the uploaded file");
         return;
     }
-
-    outfile << request.getBody();
-    outfile.close();
+    _file_cache->invalidate(file_path);
 
     response.setStatusCode(201);
     response.setBody("201 Created");
@@ -200,9 +860,7 @@ void WebServer::_handle_delete_request(const HttpRequest& request, const Locatio
     } else {
         file_path = location->getRoot() + request.getUri().substr(location->getPath().length());
     }
-    std::cout << "--- DELETE DEBUG ---" << std::endl;
-    std::cout << "File path: " << file_path << std::endl;
-    std::cout << "--------------------" << std::endl;
+    LOG(Logger::LEVEL_DEBUG, "DELETE " << file_path);
 
     struct stat s;
     if (stat(file_path.c_str(), &s) != 0) {
@@ -218,6 +876,7 @@ void WebServer::_handle_delete_request(const HttpRequest& request, const Locatio
     }
 
     if (remove(file_path.c_str()) == 0) {
+        _file_cache->invalidate(file_path);
         response.setStatusCode(200);
         response.setBody("200 OK: File deleted");
     } else {
@@ -226,161 +885,458 @@ void WebServer::_handle_delete_request(const HttpRequest& request, const Locatio
     }
 }
 
-void WebServer::_execute_cgi(const HttpRequest& request, const Location* location, HttpResponse& response) const {
-    const std::string* cgi_path_ptr = location->getCgiPath(".php"); // Assuming .php for now
-    if (!cgi_path_ptr) {
+std::vector<std::string> WebServer::_build_cgi_environment(const HttpRequest& request, int port, size_t content_length,
+                                                          const std::string& script_path, const std::string& query) {
+    /**
+     * @brief Builds the CGI/1.1 meta-variables for a request.
+     * Request headers are passed as HTTP_* variables, except those that already
+     * have a dedicated variable.
+     */
+    std::vector<std::string> env;
+    std::stringstream length;
+    length << content_length;
+    env.push_back("GATEWAY_INTERFACE=CGI/1.1");
+    env.push_back("SERVER_PROTOCOL=" + request.getHttpVersion());
+    env.push_back("SERVER_PORT=" + portToString(port));
+    env.push_back("REQUEST_METHOD=" + request.getMethod());
+    env.push_back("REQUEST_URI=" + request.getUri());
+    env.push_back("SCRIPT_NAME=" + request.getUri().substr(0, request.getUri().find('?')));
+    env.push_back("SCRIPT_FILENAME=" + script_path);
+    env.push_back("QUERY_STRING=" + query);
+    env.push_back("CONTENT_LENGTH=" + length.str());
+    env.push_back("CONTENT_TYPE=" + request.getHeader(HttpRequest::HEADER_CONTENT_TYPE));
+    env.push_back("REDIRECT_STATUS=200");
+    for (size_t i = 0; i < request.getHeaderCount(); ++i) {
+        std::string name = request.getHeaderName(i);
+        std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+        if (name == "CONTENT-TYPE" || name == "CONTENT-LENGTH") {
+            continue;
+        }
+        std::replace(name.begin(), name.end(), '-', '_');
+        env.push_back("HTTP_" + name + "=" + request.getHeaderValue(i));
+    }
+    return env;
+}
+
+void WebServer::_execute_cgi(Connection& conn, const Location* location, bool keep_alive, HttpResponse& response) {
+    /**
+     * @brief Starts the CGI script for a request without waiting for it.
+     * The script's pipes are added to the event loop and the connection waits for
+     * the response, which _finish_cgi() queues once the script is done. Only if the
+     * script cannot be started is an error written to response right away.
+     */
+    if (!location->getFastCgiPass().empty()) {
+        _pass_to_fastcgi(conn, location, keep_alive, response);
+        return;
+    }
+    const HttpRequest& request = conn.getRequest();
+    std::string path = request.getUri().substr(0, request.getUri().find('?'));
+    std::string query = path.length() < request.getUri().length() ? request.getUri().substr(path.length() + 1) : "";
+    const std::string* interpreter = location->getCgiPath(path.substr(path.rfind('.')));
+    if (!interpreter) {
+        _metrics.backendFailed(Metrics::BACKEND_CGI);
         response.setStatusCode(500);
         response.setBody("500 Internal Server Error: CGI path not configured");
         return;
     }
-    std::string cgi_path = *cgi_path_ptr;
-
-    int pipe_in[2]; // Parent writes to child's stdin
-    int pipe_out[2]; // Child writes to parent's stdout
+    if (_cgi_processes.size() >= _global_config.getCgiMaxProcesses()) {
+        LOG(Logger::LEVEL_WARN, "CGI limit of " << _global_config.getCgiMaxProcesses() << " processes reached");
+        _metrics.backendFailed(Metrics::BACKEND_CGI);
+        _serve_error_page(503, NULL, response);
+        response.setHeader("Retry-After", "1");
+        return;
+    }
 
-    if (pipe(pipe_in) == -1 || pipe(pipe_out) == -1) {
+    std::string script_path = location->getRoot() + path;
+    CgiProcess* cgi = new CgiProcess(&conn, keep_alive, location->getCgiTimeout());
+    if (!cgi->start(*interpreter, script_path, _build_cgi_environment(request, conn.getPort(), conn.getBody().size(), script_path, query),
+                    conn.getBody().getData())) {
+        delete cgi;
+        _metrics.backendFailed(Metrics::BACKEND_CGI);
         response.setStatusCode(500);
-        response.setBody("500 Internal Server Error: Pipe creation failed");
+        response.setBody("500 Internal Server Error: Could not start CGI process");
         return;
     }
+    LOG(Logger::LEVEL_DEBUG, "Started CGI " << script_path << " (pid " << cgi->getPid() << ")");
+    _cgi_processes[cgi->getPid()] = cgi;
+    _metrics.backendStarted(Metrics::BACKEND_CGI);
+    conn.setCgi(cgi);
+    conn.setUpstreamStart(TimerWheel::nowMicros());
+    _event_loop->add(cgi->getStdoutFd(), EventLoop::EVENT_READ, cgi->getStdoutTarget());
+    if (conn.getBody().size() > 0) {
+        _event_loop->add(cgi->getStdinFd(), EventLoop::EVENT_WRITE, cgi->getStdinTarget());
+        _handle_cgi_event(*cgi, cgi->getStdinFd());
+    } else {
+        cgi->closeStdin();
+    }
+}
 
-    pid_t pid = fork();
-    if (pid == -1) {
-        response.setStatusCode(500);
-        response.setBody("500 Internal Server Error: Fork failed");
+FastCgiUpstream* WebServer::_get_fastcgi_upstream(const Location* location) {
+    /**
+     * @brief Returns the connection pool for a location's fastcgi_pass, creating it on
+     * first use. Locations naming the same application with the same parameters
+     * share one pool.
+     */
+    std::stringstream key;
+    key << location->getFastCgiPass() << ' ' << location->getFastCgiMaxConnections() << ' ' << location->getFastCgiMultiplex();
+    std::map<std::string, FastCgiUpstream*>::iterator it = _fastcgi_upstreams.find(key.str());
+    if (it != _fastcgi_upstreams.end()) {
+        return it->second;
+    }
+    FastCgiUpstream* upstream = new FastCgiUpstream(location->getFastCgiPass(), location->getFastCgiMaxConnections(),
+                                                    location->getFastCgiMultiplex(), _event_loop);
+    _fastcgi_upstreams[key.str()] = upstream;
+    return upstream;
+}
+
+void WebServer::_pass_to_fastcgi(Connection& conn, const Location* location, bool keep_alive, HttpResponse& response) {
+    /**
+     * @brief Hands a request to the location's FastCGI application.
+     * Like _execute_cgi(), the connection then waits for the response, which
+     * _finish_fastcgi() queues; only if the application cannot be reached is a 502
+     * written to response right away.
+     */
+    const HttpRequest& request = conn.getRequest();
+    std::string path = request.getUri().substr(0, request.getUri().find('?'));
+    std::string query = path.length() < request.getUri().length() ? request.getUri().substr(path.length() + 1) : "";
+    std::string script_path = location->getRoot() + path;
+    FastCgiUpstream* upstream = _get_fastcgi_upstream(location);
+    FastCgiRequest* fastcgi = new FastCgiRequest(&conn, keep_alive, location->getCgiTimeout(), upstream,
+        _build_cgi_environment(request, conn.getPort(), conn.getBody().size(), script_path, query),
+        conn.getBody().getData());
+
+    std::vector<FastCgiRequest*> finished;
+    _metrics.backendStarted(Metrics::BACKEND_FASTCGI);
+    if (!upstream->submit(fastcgi, finished)) {
+        delete fastcgi;
+        _metrics.backendFailed(Metrics::BACKEND_FASTCGI);
+        _serve_error_page(502, NULL, response);
         return;
-    } else if (pid == 0) { // Child process
-        close(pipe_in[1]);
-        close(pipe_out[0]);
-        dup2(pipe_in[0], STDIN_FILENO);
-        dup2(pipe_out[1], STDOUT_FILENO);
-        close(pipe_in[0]);
-        close(pipe_out[1]);
-
-        std::vector<char*> argv_vec;
-        argv_vec.push_back(const_cast<char*>(cgi_path.c_str()));
-        argv_vec.push_back(NULL);
-
-        std::string script_full_path = location->getRoot() + request.getUri();
-
-        std::vector<std::string> env_strings;
-        env_strings.push_back("REQUEST_METHOD=" + request.getMethod());
-        if (request.getMethod() == "GET") {
-            env_strings.push_back("QUERY_STRING=" + request.getUri().substr(request.getUri().find("?") + 1));
-        } else {
-            env_strings.push_back("QUERY_STRING=");
-        }
-        std::stringstream ss_cl;
-        ss_cl << request.getBody().length();
-        env_strings.push_back("CONTENT_LENGTH=" + ss_cl.str());
-        env_strings.push_back("CONTENT_TYPE=" + request.getHeader("Content-Type"));
-        env_strings.push_back("SCRIPT_FILENAME=" + script_full_path);
-        env_strings.push_back("REDIRECT_STATUS=200");
-
-        std::vector<char*> envp_vec;
-        for (size_t i = 0; i < env_strings.size(); ++i) {
-            envp_vec.push_back(const_cast<char*>(env_strings[i].c_str()));
-        }
-        envp_vec.push_back(NULL);
-
-        std::cout << "--- CGI ENV DEBUG ---" << std::endl;
-        for (size_t i = 0; i < env_strings.size(); ++i) {
-            std::cout << env_strings[i] << std::endl;
-        }
-        std::cout << "---------------------" << std::endl;
-
-        execve(cgi_path.c_str(), &argv_vec[0], &envp_vec[0]);
-        perror("execve failed");
-        exit(1);
-    } else { // Parent process
-        close(pipe_in[0]);
-        close(pipe_out[1]);
-
-        const std::string& body = request.getBody();
-        std::cout << "--- CGI PARENT DEBUG ---" << std::endl;
-        std::cout << "Writing to child stdin (length: " << body.length() << "): [" << body << "]" << std::endl;
-        ssize_t bytes_written = write(pipe_in[1], body.c_str(), body.length());
-        if (bytes_written < 0) {
-            perror("write to cgi pipe failed");
-        }
-        std::cout << "Bytes written: " << bytes_written << std::endl;
-        close(pipe_in[1]);
-
-        std::string cgi_output;
-        char cgi_buffer[4096];
-        ssize_t bytes_read_cgi;
-        while ((bytes_read_cgi = read(pipe_out[0], cgi_buffer, sizeof(cgi_buffer) - 1)) > 0) {
-            cgi_buffer[bytes_read_cgi] = '\0';
-            cgi_output += cgi_buffer;
-        }
-        close(pipe_out[0]);
-
-        int status;
-        waitpid(pid, &status, 0);
-
-        std::cout << "Child exited with status: " << status << std::endl;
-        if (WIFEXITED(status)) {
-            std::cout << "Child exit code: " << WEXITSTATUS(status) << std::endl;
-        }
-        std::cout << "Raw CGI output:\n---\n" << cgi_output << "\n---" << std::endl;
-        std::cout << "------------------------" << std::endl;
-
-        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
-            size_t header_end = cgi_output.find("\r\n\r\n");
-            if (header_end == std::string::npos) {
-                response.setStatusCode(500);
-                response.setBody("500 Internal Server Error: Malformed CGI output");
-                return;
-            }
-            std::string cgi_headers = cgi_output.substr(0, header_end);
-            std::string cgi_body = cgi_output.substr(header_end + 4);
-            std::istringstream header_stream(cgi_headers);
-            std::string line;
-            while (std::getline(header_stream, line) && !line.empty()) {
-                size_t colon_pos = line.find(':');
-                if (colon_pos != std::string::npos) {
-                    std::string name = line.substr(0, colon_pos);
-                    std::string value = line.substr(colon_pos + 1);
-                    size_t first_char = value.find_first_not_of(" \t\r\n");
-                    size_t last_char = value.find_last_not_of(" \t\r\n");
-                    if (std::string::npos != first_char) {
-                        value = value.substr(first_char, (last_char - first_char + 1));
-                    } else {
-                        value = "";
-                    }
-                    response.setHeader(name, value);
-                }
-            }
-            response.setStatusCode(200);
-            response.setBody(cgi_body);
-        } else {
-            response.setStatusCode(500);
-            response.setBody("500 Internal Server Error: CGI script failed");
-            std::cerr << "CGI script failed. Child exit code: " << WEXITSTATUS(status) << std::endl;
+    }
+    conn.setCgi(fastcgi);
+    conn.setUpstreamStart(TimerWheel::nowMicros());
+    // Other requests may have failed along with a broken connection while sending;
+    // this one is answered through response since its caller is still running
+    for (size_t i = 0; i < finished.size(); ++i) {
+        if (finished[i] == fastcgi) {
+            fastcgi->detach();
+            conn.setCgi(NULL);
+            _metrics.backendFailed(Metrics::BACKEND_FASTCGI);
+            _serve_error_page(502, NULL, response);
         }
     }
+    _finish_fastcgi(finished);
 }
 
-std::string WebServer::_get_status_message_static(int code) {
-    switch (code) {
-        case 200: return "OK";
-        case 201: return "Created";
-        case 204: return "No Content";
-        case 400: return "Bad Request";
-        case 403: return "Forbidden";
-        case 404: return "Not Found";
-        case 405: return "Method Not Allowed";
-        case 413: return "Payload Too Large";
-        case 500: return "Internal Server Error";
-        case 501: return "Not Implemented";
-        default: return "";
+void WebServer::_handle_fastcgi_event(FastCgiConnection& backend, int events) {
+    /**
+     * @brief Drives a FastCGI backend connection, then relays whatever output its
+     * requests received and completes the requests the application ended.
+     */
+    std::vector<FastCgiRequest*> finished;
+    backend.upstream->handleEvent(backend, events, finished);
+    std::vector<FastCgiRequest*> updated;
+    for (std::map<unsigned short, FastCgiRequest*>::iterator it = backend.requests.begin(); it != backend.requests.end(); ++it) {
+        if (!it->second->getOutput().empty()) {
+            updated.push_back(it->second);
+        }
     }
+    for (size_t i = 0; i < updated.size(); ++i) {
+        _relay_cgi_output(*updated[i]);
+    }
+    _finish_fastcgi(finished);
 }
 
-void WebServer::_serve_error_page(int status_code, const ServerConfig* config, HttpResponse& response) const {
-    std::string error_body = WebServer::_get_status_message_static(status_code);
-    std::string content_type = "text/plain";
-
+void WebServer::_finish_fastcgi(const std::vector<FastCgiRequest*>& finished) {
+    /**
+     * @brief Completes FastCGI requests the application has ended, or that failed, and
+     * schedules them for deletion.
+     */
+    for (size_t i = 0; i < finished.size(); ++i) {
+        FastCgiRequest& fastcgi = *finished[i];
+        int error_status = 0;
+        if (fastcgi.hasFailed()) {
+            error_status = 502;
+        } else if (fastcgi.getProtocolStatus() == FastCgi::OVERLOADED) {
+            error_status = 503;
+        } else if (fastcgi.getProtocolStatus() != FastCgi::REQUEST_COMPLETE) {
+            error_status = 502;
+        }
+        _complete_cgi_response(fastcgi, error_status);
+        _finished_cgis.push_back(&fastcgi);
+    }
+}
+
+void WebServer::_handle_cgi_event(CgiProcess& cgi, int fd) {
+    /**
+     * @brief Moves data through a CGI pipe that became ready.
+     * @param cgi The script the pipe belongs to.
+     * @param fd The pipe; ignored if it was closed earlier in this loop iteration.
+     */
+    if (fd < 0) {
+        return;
+    }
+    if (fd == cgi.getStdinFd()) {
+        if (cgi.writeInput() != CgiProcess::IO_AGAIN) {
+            _event_loop->remove(fd);
+            cgi.closeStdin(); // The script sees end-of-file on its input
+        }
+    } else if (fd == cgi.getStdoutFd()) {
+        _read_cgi_output(cgi);
+    }
+    if (cgi.isFinished()) {
+        _finish_cgi(cgi);
+    }
+}
+
+void WebServer::_read_cgi_output(CgiProcess& cgi) {
+    /**
+     * @brief Reads a script's stdout and relays it to the client as it arrives.
+     * Once the client has enough queued (CgiRequest::isThrottled()) the pipe is no longer watched,
+     * so a script producing output faster than the client reads blocks on the full
+     * pipe instead of filling the server's memory; _resume_cgi() picks it up again.
+     */
+    while (cgi.getStdoutFd() >= 0) {
+        if (cgi.isThrottled()) {
+            _event_loop->remove(cgi.getStdoutFd());
+            cgi.setPaused(true);
+            return;
+        }
+        CgiProcess::IoStatus status = cgi.readOutput();
+        if (status == CgiProcess::IO_DONE) {
+            _event_loop->remove(cgi.getStdoutFd());
+            cgi.closeStdout();
+            return;
+        }
+        _relay_cgi_output(cgi);
+        if (status == CgiProcess::IO_AGAIN || !_event_loop->isEdgeTriggered()) {
+            return;
+        }
+    }
+}
+
+void WebServer::_resume_cgi(CgiRequest& request) {
+    /**
+     * @brief Watches a paused backend again once its client has caught up.
+     * Re-registering reports any output that is already waiting.
+     */
+    request.setPaused(false);
+    if (request.getType() == CgiRequest::FASTCGI) {
+        FastCgiRequest& fastcgi = static_cast<FastCgiRequest&>(request);
+        fastcgi.getUpstream()->resume(&fastcgi);
+        return;
+    }
+    CgiProcess& cgi = static_cast<CgiProcess&>(request);
+    if (cgi.getStdoutFd() >= 0) {
+        _event_loop->add(cgi.getStdoutFd(), EventLoop::EVENT_READ, cgi.getStdoutTarget());
+    }
+}
+
+void WebServer::_relay_cgi_output(CgiRequest& cgi) {
+    /**
+     * @brief Forwards the output received so far to the client.
+     * Until the CGI header block is complete nothing is sent; then the response head
+     * goes out, followed by body bytes as they arrive. Output for a client that is
+     * gone, or after an invalid header block, is dropped.
+     */
+    Connection* conn = cgi.getConnection();
+    if (!conn) {
+        cgi.discardOutput();
+        return;
+    }
+    if (!cgi.hasStartedBody()) {
+        CgiRequest::HeaderStatus status = cgi.parseHeaders();
+        if (status == CgiRequest::HEADERS_INVALID) {
+            cgi.discardOutput(); // Answered with 502 once the backend is done
+        }
+        if (status != CgiRequest::HEADERS_COMPLETE) {
+            return;
+        }
+        _send_cgi_head(*conn, cgi);
+    }
+    std::string wire;
+    if (cgi.takeBody(wire)) {
+        conn->queueResponse(wire);
+    }
+    if (conn->hasPendingOutput()) {
+        _handle_client_event(*conn, EventLoop::EVENT_WRITE);
+        if (!conn->isClosed()) {
+            _update_connection_timer(*conn);
+        }
+    }
+}
+
+void WebServer::_send_cgi_head(Connection& conn, CgiRequest& cgi) {
+    /**
+     * @brief Queues the response head built from the CGI headers and chooses how the
+     * streamed body is framed: the script's own Content-Length, chunked encoding for
+     * HTTP/1.1 clients, or closing the connection for HTTP/1.0 clients.
+     */
+    HttpResponse head;
+    head.setStatusCode(cgi.getStatusCode());
+    bool has_length = false;
+    size_t content_length = 0;
+    const std::vector<std::pair<std::string, std::string> >& headers = cgi.getHeaders();
+    for (size_t i = 0; i < headers.size(); ++i) {
+        std::string name = headers[i].first;
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (name == "content-length") {
+            const std::string& value = headers[i].second;
+            if (!value.empty() && value.length() <= 18 && value.find_first_not_of("0123456789") == std::string::npos) {
+                has_length = true;
+                content_length = 0;
+                for (size_t j = 0; j < value.length(); ++j) {
+                    content_length = content_length * 10 + (value[j] - '0');
+                }
+            }
+        } else if (name != "connection" && name != "keep-alive" && name != "transfer-encoding") {
+            // Hop-by-hop headers are the server's business
+            head.setHeader(headers[i].first, headers[i].second);
+        }
+    }
+
+    CgiRequest::Framing framing;
+    int status = cgi.getStatusCode();
+    if (status == 204 || status == 304) {
+        framing = CgiRequest::FRAMING_LENGTH;
+        content_length = 0;
+    } else if (has_length) {
+        framing = CgiRequest::FRAMING_LENGTH;
+        std::stringstream length;
+        length << content_length;
+        head.setHeader("Content-Length", length.str());
+    } else if (conn.getRequest().getHttpVersion() == "HTTP/1.1") {
+        framing = CgiRequest::FRAMING_CHUNKED;
+        head.setHeader("Transfer-Encoding", "chunked");
+    } else {
+        framing = CgiRequest::FRAMING_CLOSE;
+        head.setCloseDelimited(true);
+    }
+    bool keep_alive = cgi.getKeepAlive() && framing != CgiRequest::FRAMING_CLOSE;
+    head.setHeader("Connection", keep_alive ? "keep-alive" : "close");
+    conn.queueHeaders(head);
+    cgi.startBody(framing, content_length);
+}
+
+void WebServer::_complete_cgi_response(CgiRequest& cgi, int error_status) {
+    /**
+     * @brief Ends the response once the backend is done, then lets the connection go
+     * on with any pipelined requests.
+     * If nothing was sent yet the client gets error_status, or 502 for output
+     * without a valid header block. Once the head is out an error can only be
+     * signalled by closing the connection before the body is complete.
+     * @param error_status 0 if the backend finished normally.
+     */
+    _relay_cgi_output(cgi);
+    Connection* conn = cgi.getConnection();
+    if (!conn) {
+        return;
+    }
+    cgi.detach();
+    bool keep_alive = cgi.getKeepAlive();
+    if (error_status != 0 || !cgi.hasStartedBody()) {
+        _metrics.backendFailed(cgi.getType() == CgiRequest::FASTCGI ? Metrics::BACKEND_FASTCGI : Metrics::BACKEND_CGI);
+    }
+    if (!cgi.hasStartedBody()) {
+        if (error_status == 0) {
+            LOG(Logger::LEVEL_ERROR, "Malformed CGI output");
+            error_status = 502;
+        }
+        HttpResponse response;
+        _serve_error_page(error_status, NULL, response);
+        response.setHeader("Connection", keep_alive ? "keep-alive" : "close");
+        _queue_response(*conn, response);
+    } else if (error_status != 0 || !cgi.isBodyComplete() || cgi.getFraming() == CgiRequest::FRAMING_CLOSE) {
+        keep_alive = false;
+    } else if (cgi.getFraming() == CgiRequest::FRAMING_CHUNKED) {
+        conn->queueResponse("0\r\n\r\n");
+    }
+    conn->setCgi(NULL);
+    _record_request(*conn, cgi.hasStartedBody() ? cgi.getStatusCode() : error_status);
+    conn->consumeRequest();
+    _unpin_config(*conn);
+    if (!keep_alive) {
+        conn->setCloseAfterWrite(true);
+    }
+    _set_client_events(*conn, EventLoop::EVENT_READ);
+    _handle_client_event(*conn, EventLoop::EVENT_READ | EventLoop::EVENT_WRITE);
+    if (!conn->isClosed()) {
+        _update_connection_timer(*conn);
+    }
+}
+
+void WebServer::_reap_children() {
+    /**
+     * @brief Collects exited CGI children after SIGCHLD woke the event loop.
+     */
+    char buffer[64];
+    while (read(_child_pipe[0], buffer, sizeof(buffer)) > 0) {
+    }
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        std::map<pid_t, CgiProcess*>::iterator it = _cgi_processes.find(pid);
+        if (it == _cgi_processes.end()) {
+            continue;
+        }
+        CgiProcess* cgi = it->second;
+        cgi->setExitStatus(status);
+        if (cgi->isFinished()) {
+            _finish_cgi(*cgi);
+        }
+    }
+}
+
+void WebServer::_finish_cgi(CgiProcess& cgi) {
+    /**
+     * @brief Completes the request once its script has exited and closed its output,
+     * then schedules the CgiProcess for deletion.
+     */
+    if (_cgi_processes.erase(cgi.getPid()) == 0) {
+        return; // Already finished, e.g. aborted while its output was relayed
+    }
+    int status = cgi.getExitStatus();
+    bool failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    if (failed && cgi.getConnection()) {
+        LOG(Logger::LEVEL_ERROR, "CGI script failed. Child exit status: " << status);
+    }
+    _complete_cgi_response(cgi, failed ? 500 : 0);
+    _finished_cgis.push_back(&cgi);
+}
+
+void WebServer::_abort_cgi(CgiRequest& request) {
+    /**
+     * @brief Stops a script or FastCGI request whose response is no longer wanted.
+     * A script is killed and its pipes closed; the CgiProcess itself lives on until
+     * the child has been reaped. A FastCGI request is withdrawn from its upstream.
+     */
+    request.detach();
+    if (request.getType() == CgiRequest::FASTCGI) {
+        FastCgiRequest& fastcgi = static_cast<FastCgiRequest&>(request);
+        std::vector<FastCgiRequest*> finished;
+        fastcgi.getUpstream()->abort(&fastcgi, finished);
+        _finish_fastcgi(finished);
+        return;
+    }
+    CgiProcess& cgi = static_cast<CgiProcess&>(request);
+    cgi.kill();
+    if (cgi.getStdinFd() >= 0) {
+        _event_loop->remove(cgi.getStdinFd());
+        cgi.closeStdin();
+    }
+    if (cgi.getStdoutFd() >= 0) {
+        _event_loop->remove(cgi.getStdoutFd());
+        cgi.closeStdout();
+    }
+    if (cgi.isFinished()) {
+        _finish_cgi(cgi);
+    }
+}
+
+void WebServer::_serve_error_page(int status_code, const ServerConfig* config, HttpResponse& response) const {
+    std::string error_body = HttpResponse::getReasonPhrase(status_code);
+    std::string content_type = "text/plain";
+
     if (config) {
         const std::string* error_page_path = config->getErrorPage(status_code);
         if (error_page_path) {
@@ -398,105 +1354,436 @@ void WebServer::_serve_error_page(int status_code, const ServerConfig* config, H
     response.setBody(error_body);
 }
 
-void WebServer::_handle_client_data(int client_fd) {
-    std::string raw_request_data;
-    char buffer[4096];
-    ssize_t bytes_read;
-    HttpResponse response;
-    const ServerConfig* server_config = NULL;
+void WebServer::_handle_client_event(Connection& conn, int events) {
+    /**
+     * @brief Drives a client connection after a readiness notification.
+     * Queued responses are flushed first; only once the output is drained are
+     * further requests processed or more data read, which gives natural
+     * back-pressure against clients that do not read their responses. With poll()
+     * a single recv() is done per wakeup so one fast sender cannot monopolize the
+     * loop; with an edge-triggered backend the socket is read until EAGAIN, since
+     * no further notification would arrive otherwise.
+     * While a script or FastCGI application works on a request the socket is only
+     * watched for the client shutting down its side. A client that merely stopped
+     * sending still gets the response, after which the connection is closed; one
+     * whose connection is gone aborts the backend.
+     * @param conn The connection that became ready.
+     * @param events EventLoop::EVENT_READ, EVENT_WRITE, EVENT_HANGUP and/or
+     * EVENT_PEER_SHUTDOWN.
+     */
+    int client_fd = conn.getFd();
+    bool may_read = (events & EventLoop::EVENT_READ) != 0;
 
-    // Read all available data from the socket in a loop.
-    // This is a simplified approach. For a production server, a more
-    // sophisticated state machine for each client would be necessary to handle
-    // slow clients or large requests without blocking the entire server.
     while (true) {
-        bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-        if (bytes_read > 0) {
-            buffer[bytes_read] = '\0';
-            raw_request_data.append(buffer, bytes_read);
-        } else if (bytes_read == 0) {
-            // Client disconnected prematurely
-            break;
-        } else { // bytes_read < 0
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                // No more data to read right now.
-                // In a truly non-blocking server, we would return to the event loop here.
-                // For this project's architecture, we break and process what we have.
-                break;
-            } else {
-                // A real error occurred
-                std::cerr << "Error: recv() failed on fd " << client_fd << std::endl;
-                close(client_fd);
-                for (size_t i = 0; i < _fds.size(); ++i) {
-                    if (_fds[i].fd == client_fd) {
-                        _fds.erase(_fds.begin() + i);
-                        break;
-                    }
-                }
+        if (!conn.hasPendingOutput()) {
+            _process_pending_requests(conn);
+        }
+        if (conn.getCgi() && (events & EventLoop::EVENT_HANGUP)) {
+            LOG(Logger::LEVEL_INFO, "Client on fd " << client_fd << " closed the connection before the backend answered");
+            _close_connection(client_fd); // Aborts the backend
+            return;
+        }
+        if (conn.getCgi() && (events & EventLoop::EVENT_PEER_SHUTDOWN)) {
+            conn.getCgi()->setKeepAlive(false); // Answered, then closed
+        }
+        if (conn.hasPendingOutput()) {
+            Connection::IoStatus status = conn.writeToSocket();
+            if (status == Connection::IO_ERROR) {
+                _close_connection(client_fd);
                 return;
             }
+            if (status == Connection::IO_AGAIN) {
+                _set_client_events(conn, EventLoop::EVENT_WRITE | _backend_wait_events(conn));
+                return;
+            }
+            _set_client_events(conn, EventLoop::EVENT_READ);
+            may_read = true; // Reads were paused while the output was pending
+            continue;
+        }
+        if (conn.getCgi() && conn.getCgi()->isPaused()) {
+            _resume_cgi(*conn.getCgi()); // Everything relayed so far has been sent
         }
-        // Basic check to see if we have the full headers.
-        // This is not foolproof and depends on the client sending the request quickly.
-        if (raw_request_data.find("\r\n\r\n") != std::string::npos) {
-            // Now check if we have the full body
-            size_t content_length = 0;
-            size_t header_end_pos = raw_request_data.find("\r\n\r\n");
-            std::string headers_str = raw_request_data.substr(0, header_end_pos);
-            HttpRequest temp_request;
-            try {
-                temp_request.parse(headers_str + "\r\n\r\n");
-                std::string cl_str = temp_request.getHeader("content-length");
-                if (!cl_str.empty()) {
-                    content_length = static_cast<size_t>(std::atol(cl_str.c_str()));
+        if (conn.getCloseAfterWrite()) {
+            if (!conn.getLingerOnClose()) {
+                _close_connection(client_fd);
+                return;
+            }
+            if (!conn.isLingering()) {
+                conn.startLingeringClose();
+            }
+            // Drop what the client is still sending until it closes its side
+            while (may_read) {
+                Connection::IoStatus status = conn.discardInput();
+                if (status == Connection::IO_EOF || status == Connection::IO_ERROR) {
+                    _close_connection(client_fd);
+                    return;
+                }
+                if (status == Connection::IO_AGAIN || !_event_loop->isEdgeTriggered()) {
+                    break;
                 }
-            } catch (...) { /* Ignore parsing errors for this check */ }
-
-            size_t body_start_pos = header_end_pos + 4;
-            if (raw_request_data.length() >= body_start_pos + content_length) {
-                // We likely have the full request, break the read loop
-                break;
             }
+            return;
+        }
+        if (conn.getCgi()) {
+            // Input waits until the backend has answered the current request;
+            // _complete_cgi_response() watches for it again
+            _set_client_events(conn, _backend_wait_events(conn));
+            return;
+        }
+        if (!may_read) {
+            return;
+        }
+
+        Connection::IoStatus status = conn.readFromSocket();
+        if (status == Connection::IO_EOF) {
+            LOG(Logger::LEVEL_DEBUG, "Client disconnected on fd " << client_fd);
+            _close_connection(client_fd);
+            return;
+        }
+        if (status == Connection::IO_ERROR) {
+            LOG(Logger::LEVEL_INFO, "recv() failed on fd " << client_fd);
+            _close_connection(client_fd);
+            return;
+        }
+        if (status == Connection::IO_AGAIN) {
+            return;
+        }
+        if (!_event_loop->isEdgeTriggered()) {
+            may_read = false;
         }
     }
+}
 
-    if (raw_request_data.empty()) {
-        // This can happen if recv returned EAGAIN immediately, or client disconnected.
-        if (bytes_read == 0) {
-             std::cout << "Client disconnected on fd " << client_fd << std::endl;
+void WebServer::_start_request_body(Connection& conn) {
+    /**
+     * @brief Decides where the body of a request goes as soon as its head has arrived.
+     * A body that no location would accept, for a path without a location (404), a
+     * method the location does not allow (405) or a declared Content-Length above
+     * client_max_body_size (413), is refused right away, before any of it is read.
+     * Uploads are streamed into a temporary file in the location's root; all other
+     * bodies (e.g. for CGI) are kept in memory. Clients waiting on
+     * "Expect: 100-continue" are told to go ahead.
+     */
+    const HttpRequest& request = conn.getRequest();
+    const ServerConfig* server_config = _get_server_config(conn, request.getHeader(HttpRequest::HEADER_HOST));
+    const Location* location = server_config ? _get_location(server_config, request.getUri()) : NULL;
+    bool has_body = request.isChunked() || request.getContentLength() > 0;
+    if (has_body && server_config && !location) {
+        _reject_request_body(conn, 404, server_config);
+        return;
+    }
+    if (has_body && location && !_is_method_allowed(location, request.getMethod())) {
+        _reject_request_body(conn, 405, server_config);
+        return;
+    }
+    size_t limit = server_config ? server_config->getClientMaxBodySize() : 0;
+    if (!request.isChunked() && request.getContentLength() > limit) {
+        _reject_request_body(conn, 413, server_config);
+        return;
+    }
+
+    if (location && request.getMethod() == "POST" && !_is_cgi_request(location, request.getUri())) {
+        const std::string& upload_dir = location->getRoot();
+        if ((mkdir(upload_dir.c_str(), 0755) == -1 && errno != EEXIST) || !conn.getBody().openTempFile(upload_dir)) {
+            LOG(Logger::LEVEL_ERROR, "Cannot create a temporary upload file in " << upload_dir);
+            _reject_request_body(conn, 500, server_config);
+            return;
         }
-        close(client_fd);
-        for (size_t i = 0; i < _fds.size(); ++i) {
-            if (_fds[i].fd == client_fd) {
-                _fds.erase(_fds.begin() + i);
-                break;
+    }
+
+    std::string expect = request.getHeader(HttpRequest::HEADER_EXPECT);
+    std::transform(expect.begin(), expect.end(), expect.begin(), ::tolower);
+    if (has_body && expect == "100-continue" && request.getHttpVersion() == "HTTP/1.1"
+        && conn.getReadBuffer().length() == request.getHeaderLength()) {
+        conn.queueResponse("HTTP/1.1 100 Continue\r\n\r\n");
+    }
+    conn.startBody(limit);
+}
+
+void WebServer::_reject_request_body(Connection& conn, int status_code, const ServerConfig* server_config) {
+    /**
+     * @brief Answers a request with an error before reading its body, then closes.
+     */
+    LOG(Logger::LEVEL_INFO, "Rejected request on fd " << conn.getFd() << ": " << status_code);
+    HttpResponse response;
+    _serve_error_page(status_code, server_config, response);
+    response.setHeader("Connection", "close");
+    _queue_response(conn, response);
+    _record_request(conn, status_code);
+    conn.setCloseAfterWrite(true);
+    conn.setLingerOnClose(true);
+}
+
+bool WebServer::_is_method_allowed(const Location* location, const std::string& method) {
+    const std::vector<std::string>& allowed_methods = location->getAllowedMethods();
+    return std::find(allowed_methods.begin(), allowed_methods.end(), method) != allowed_methods.end();
+}
+
+bool WebServer::_is_cgi_request(const Location* location, const std::string& uri) {
+    if (!location->getFastCgiPass().empty()) {
+        return true;
+    }
+    std::string path = uri.substr(0, uri.find('?'));
+    size_t dot_pos = path.rfind('.');
+    if (dot_pos == std::string::npos) {
+        return false;
+    }
+    return location->getCgiPath(path.substr(dot_pos)) != NULL;
+}
+
+void WebServer::_process_pending_requests(Connection& conn) {
+    /**
+     * @brief Answers every complete request currently sitting in the connection's buffer.
+     * Pipelined requests are handled in arrival order and their responses queued
+     * back to back. Processing pauses once enough output is pending so that a client
+     * which does not read its responses cannot make the server buffer without bound;
+     * it resumes after the queued data has been flushed.
+     * @param conn The connection whose buffered requests should be processed.
+     */
+    static const size_t max_pending_output = 1024 * 1024;
+
+    while (!conn.getCgi() && !conn.getCloseAfterWrite() && conn.getPendingOutputSize() < max_pending_output
+           && conn.readRequestHead()) {
+        _pin_config(conn);
+        if (conn.getState() == Connection::HEAD_COMPLETE && conn.getErrorStatus() == 0) {
+            _start_request_body(conn);
+            if (conn.getCloseAfterWrite()) {
+                return; // Rejected before the body was read
             }
         }
+        if (!conn.hasCompleteRequest()) {
+            return;
+        }
+        HttpResponse response;
+        conn.setHandlerStart(TimerWheel::nowMicros());
+        bool keep_alive = _process_request(conn, response);
+        if (conn.getCgi()) {
+            return; // Answered by _finish_cgi() once the script is done
+        }
+        _queue_response(conn, response);
+        _record_request(conn, response.getStatusCode());
+        conn.consumeRequest();
+        _unpin_config(conn);
+        if (!keep_alive) {
+            conn.setCloseAfterWrite(true);
+        }
+    }
+}
+
+void WebServer::_queue_response(Connection& conn, HttpResponse& response) {
+    /**
+     * @brief Moves a finished response into the connection's output queue.
+     * Headers are serialized straight into the connection's output buffer; pre-rendered
+     * responses, in-memory bodies and file bodies are handed over rather than copied.
+     */
+    if (response.hasRendered()) {
+        conn.queueRendered(response.releaseRendered());
         return;
     }
+    conn.queueHeaders(response);
+    if (!response.hasBodyFile()) {
+        std::string body;
+        response.releaseBody(body);
+        conn.queueBody(body);
+    } else {
+        const std::vector<BodyFileRange>& ranges = response.getBodyFileRanges();
+        CachedFile* file = response.releaseBodyFile();
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            conn.queueResponse(ranges[i].preamble);
+            file->retain();
+            conn.queueFile(file, ranges[i].offset, ranges[i].length);
+        }
+        conn.queueResponse(response.getBodyEpilogue());
+        file->release();
+    }
+}
 
-    std::cout << "Received data from fd " << client_fd << ":\n" << raw_request_data << std::endl;
+void WebServer::_record_request(Connection& conn, int status) {
+    /**
+     * @brief Counts and logs a request whose response has been queued in full, and
+     * records its latencies with the location it was routed to.
+     */
+    unsigned long bytes_sent = conn.takeResponseBytes();
+    unsigned long now = TimerWheel::nowMicros();
+    _metrics.requestCompleted(conn.getRequest().getMethod(), status);
+    LocationMetrics* location_metrics = conn.getLocationMetrics();
+    if (location_metrics) {
+        location_metrics->parse.record(conn.getHeadComplete() - conn.getRequestStart());
+        location_metrics->handler.record(now - conn.getHandlerStart());
+        location_metrics->total.record(now - conn.getRequestStart());
+    }
+    if (!_access_log) {
+        return;
+    }
+    AccessLogEntry entry;
+    entry.remote_addr = &conn.getRemoteAddress();
+    entry.request = &conn.getRequest();
+    entry.status = status;
+    entry.bytes_sent = bytes_sent;
+    entry.request_time_us = now - conn.getRequestStart();
+    entry.upstream_time_us = conn.getUpstreamStart() ? static_cast<long>(now - conn.getUpstreamStart()) : -1;
+    _access_log->log(entry);
+}
 
-    try {
-        HttpRequest request;
-        request.parse(raw_request_data);
+void WebServer::_serve_status_page(const Location* location, HttpResponse& response) const {
+    /**
+     * @brief Answers a stub_status or metrics location with the worker's counters.
+     * Connection states are counted here, so keeping them costs nothing per request:
+     * a connection is writing from the moment a request reaches its handler until the
+     * response is sent, waiting between requests and reading while one arrives.
+     */
+    MetricsSnapshot snapshot;
+    snapshot.active_connections = _connection_count;
+    snapshot.reading_connections = 0;
+    snapshot.writing_connections = 0;
+    snapshot.waiting_connections = 0;
+    snapshot.open_bytes_received = 0;
+    snapshot.open_bytes_sent = 0;
+    for (size_t fd = 0; fd < _connections.size(); ++fd) {
+        const Connection* conn = _connections[fd];
+        if (!conn) {
+            continue;
+        }
+        if (conn->hasPendingOutput() || conn->getHandlerStart() != 0) {
+            ++snapshot.writing_connections;
+        } else if (conn->isIdle()) {
+            ++snapshot.waiting_connections;
+        } else {
+            ++snapshot.reading_connections;
+        }
+        snapshot.open_bytes_received += conn->getBytesReceived();
+        snapshot.open_bytes_sent += conn->getBytesSent();
+    }
+    snapshot.cgi_processes = _cgi_processes.size();
+    snapshot.file_cache_hits = _file_cache->getHits();
+    snapshot.file_cache_misses = _file_cache->getMisses();
+    snapshot.response_cache_hits = _response_cache->getHits();
+    snapshot.response_cache_misses = _response_cache->getMisses();
+
+    std::ostringstream body;
+    if (location->getStatusPage() == Location::STATUS_METRICS) {
+        _metrics.writePrometheus(body, snapshot);
+        response.setHeader("Content-Type", "text/plain; version=0.0.4");
+    } else {
+        _metrics.writeStubStatus(body, snapshot);
+        response.setHeader("Content-Type", "text/plain");
+    }
+    response.setStatusCode(200);
+    response.setHeader("Cache-Control", "no-cache");
+    response.setBody(body.str());
+}
 
-        std::cout << "Parsed Request:" << std::endl;
-        std::cout << "  Method: " << request.getMethod() << std::endl;
-        std::cout << "  URI: " << request.getUri() << std::endl;
-        std::cout << "  HTTP Version: " << request.getHttpVersion() << std::endl;
-        std::cout << "  Host Header: " << request.getHeader("Host") << std::endl;
-        std::cout << "  Body: " << request.getBody() << std::endl;
+bool WebServer::_wants_keep_alive(const HttpRequest& request) {
+    /**
+     * @brief Applies the HTTP persistence rules to a request.
+     * HTTP/1.1 connections are persistent unless the client sends "Connection: close";
+     * HTTP/1.0 connections are closed unless the client asks for "keep-alive".
+     * @param request The parsed request.
+     * @return true if the client allows the connection to stay open.
+     */
+    std::string connection = request.getHeader(HttpRequest::HEADER_CONNECTION);
+    std::transform(connection.begin(), connection.end(), connection.begin(), ::tolower);
+    if (connection.find("close") != std::string::npos) {
+        return false;
+    }
+    if (request.getHttpVersion() == "HTTP/1.0") {
+        return connection.find("keep-alive") != std::string::npos;
+    }
+    return true;
+}
 
-        // Get the port the client connected to
-        sockaddr_in addr;
-        socklen_t len = sizeof(addr);
-        if (getsockname(client_fd, (struct sockaddr*)&addr, &len) == -1) {
-            throw std::runtime_error("getsockname failed");
+void WebServer::_close_idle_connections() {
+    /**
+     * @brief Closes every idle connection once a shutdown has begun.
+     * Only connections that have nothing buffered in either direction are closed;
+     * busy ones are closed after their current response.
+     */
+    std::vector<int> idle;
+    for (size_t fd = 0; fd < _connections.size(); ++fd) {
+        if (_connections[fd] && _connections[fd]->isIdle()) {
+            idle.push_back(fd);
         }
-        int port = ntohs(addr.sin_port);
+    }
+    for (size_t i = 0; i < idle.size(); ++i) {
+        _close_connection(idle[i]);
+    }
+}
+
+void WebServer::_update_connection_timer(Connection& conn) {
+    /**
+     * @brief Moves the connection's timer to the deadline of its current phase.
+     * Called after every event on the connection, which is O(1) with the TimerWheel.
+     */
+    unsigned long deadline = conn.getDeadline();
+    if (deadline == 0) {
+        _timers.cancel(conn.getTimer());
+    } else {
+        _timers.schedule(conn.getTimer(), deadline);
+    }
+}
+
+void WebServer::_handle_connection_timeout(Connection& conn) {
+    /**
+     * @brief Handles an expired connection timer.
+     * The deadline is computed again first: a CGI backend's progress does not move the
+     * timer, so it may fire early and is then simply rearmed. A backend that made no
+     * progress within cgi_timeout is aborted and answered with 504; otherwise the
+     * client was too slow in its current phase and the connection is closed.
+     */
+    unsigned long now = TimerWheel::now();
+    unsigned long deadline = conn.getDeadline();
+    if (deadline == 0) {
+        return;
+    }
+    if (deadline > now) {
+        _timers.schedule(conn.getTimer(), deadline);
+        return;
+    }
+    CgiRequest* cgi = conn.getCgi();
+    if (cgi && cgi->getDeadline() != 0 && cgi->getDeadline() <= now) {
+        LOG(Logger::LEVEL_ERROR, (cgi->getType() == CgiRequest::FASTCGI ? "FastCGI request" : "CGI process") << " timed out");
+        _complete_cgi_response(*cgi, 504);
+        _abort_cgi(*cgi);
+        if (!conn.isClosed()) {
+            _update_connection_timer(conn);
+        }
+        return;
+    }
+    LOG(Logger::LEVEL_INFO, "Connection on fd " << conn.getFd() << " timed out");
+    _close_connection(conn.getFd());
+}
+
+bool WebServer::_process_request(Connection& conn, HttpResponse& response) {
+    const ServerConfig* server_config = NULL;
+    bool keep_alive = false;
+    const HttpRequest& request = conn.getRequest();
+
+    if (conn.getErrorStatus() != 0) {
+        LOG(Logger::LEVEL_INFO, "Rejected request on fd " << conn.getFd() << ": " << conn.getErrorStatus());
+        _serve_error_page(conn.getErrorStatus(), _get_server_config(conn, request.getHeader(HttpRequest::HEADER_HOST)), response);
+        response.setHeader("Connection", "close");
+        return false;
+    }
+
+    try {
+        LOG(Logger::LEVEL_DEBUG, "Request on fd " << conn.getFd() << ": " << request.getMethod() << " " << request.getUri()
+            << " " << request.getHttpVersion() << ", Host " << request.getHeader(HttpRequest::HEADER_HOST)
+            << ", " << conn.getBody().size() << " body bytes");
+
+        // The port was recorded when the connection was accepted
+        int port = conn.getPort();
+
+        server_config = _get_server_config(conn, request.getHeader(HttpRequest::HEADER_HOST));
+        if (server_config && server_config->getKeepAliveTimeout() > 0
+            && conn.getRequestsServed() + 1 < server_config->getKeepAliveRequests()) {
+            // A port dropped by a reload gets no further requests
+            keep_alive = !_shutting_down && _listening_sockets.find(port) != _listening_sockets.end()
+                         && _wants_keep_alive(request);
+            conn.setKeepAliveTimeout(server_config->getKeepAliveTimeout());
+        }
+        // Known before dispatch so that handlers can serve pre-rendered responses
+        response.setHeader("Connection", keep_alive ? "keep-alive" : "close");
 
-        server_config = _get_server_config(port, request.getHeader("Host"));
         if (!server_config) {
             _serve_error_page(500, NULL, response); // No server config found, use default 500
         } else {
@@ -504,51 +1791,18 @@ void WebServer::_handle_client_data(int client_fd) {
             if (!location) {
                 _serve_error_page(404, server_config, response);
             } else {
-                // Check allowed methods
-                const std::vector<std::string>& allowed_methods = location->getAllowedMethods();
-                bool method_allowed = false;
-                for (size_t i = 0; i < allowed_methods.size(); ++i) {
-                    if (allowed_methods[i] == request.getMethod()) {
-                        method_allowed = true;
-                        break;
-                    }
-                }
-                if (!method_allowed) {
+                conn.setLocationMetrics(_metrics.getLocation(*server_config, *location));
+                if (!_is_method_allowed(location, request.getMethod())) {
                     _serve_error_page(405, server_config, response);
                 } else {
-                    // Check for CGI
-                    size_t dot_pos = request.getUri().find('.');
-                    std::string extension;
-                    if (dot_pos != std::string::npos) {
-                        extension = request.getUri().substr(dot_pos);
-                    }
-
-                    if (!extension.empty() && location->getCgiPath(extension)) {
-                        _execute_cgi(request, location, response);
+                    if (location->getStatusPage() != Location::STATUS_OFF) {
+                        _serve_status_page(location, response);
+                    } else if (_is_cgi_request(location, request.getUri())) {
+                        _execute_cgi(conn, location, keep_alive, response);
                     } else if (request.getMethod() == "GET") {
-                        std::string full_path = location->getRoot() + request.getUri();
-                        struct stat s;
-                        if (stat(full_path.c_str(), &s) == 0) {
-                            if (s.st_mode & S_IFDIR) { // It's a directory
-                                std::string index_file_path = full_path + (full_path[full_path.length() - 1] == '/' ? "" : "/") + location->getIndex();
-                                std::ifstream index_file(index_file_path.c_str());
-                                if (index_file.good()) {
-                                    _serve_static_file(index_file_path, response);
-                                } else if (location->getAutoIndex()) {
-                                    _generate_autoindex(full_path, request.getUri(), response);
-                                } else {
-                                    _serve_error_page(403, server_config, response);
-                                }
-                            } else if (s.st_mode & S_IFREG) { // It's a regular file
-                                _serve_static_file(full_path, response);
-                            } else { // Not a regular file or directory
-                                _serve_error_page(403, server_config, response);
-                            }
-                        } else {
-                            _serve_error_page(404, server_config, response);
-                        }
+                        _handle_get_request(request, server_config, location, response);
                     } else if (request.getMethod() == "POST") {
-                        _handle_post_request(request, server_config, location, response);
+                        _handle_post_request(request, conn.getBody(), location, response);
                     } else if (request.getMethod() == "DELETE") {
                         _handle_delete_request(request, location, response);
                     } else {
@@ -560,104 +1814,275 @@ void WebServer::_handle_client_data(int client_fd) {
         }
 
     } catch (const std::exception& e) {
-        std::cerr << "Error processing request: " << e.what() << std::endl;
+        LOG(Logger::LEVEL_ERROR, "Error processing request: " << e.what());
         _serve_error_page(500, server_config, response); // Use server_config for 500 error page
+        keep_alive = false;
     }
 
-    std::string response_str = response.toString();
-    send(client_fd, response_str.c_str(), response_str.length(), 0);
-
-    // For now, close connection after sending response
-    close(client_fd);
-    for (size_t i = 0; i < _fds.size(); ++i) {
-        if (_fds[i].fd == client_fd) {
-            _fds.erase(_fds.begin() + i);
-            break;
-        }
+    if (!keep_alive && !response.hasRendered()) {
+        response.setHeader("Connection", "close");
     }
+    return keep_alive;
 }
 
+const ServerConfig* WebServer::_get_server_config(const Connection& conn, const std::string& host) const {
+    // A request is routed with the configuration it started under, even across a reload
+    const ConfigGeneration* config = conn.getConfig() ? conn.getConfig() : _config;
+    return config->virtual_hosts.find(conn.getPort(), host);
+}
 
-const ServerConfig* WebServer::_get_server_config(int port, const std::string& host) const {
-    const ServerConfig* default_server = NULL;
-    for (size_t i = 0; i < _configs.size(); ++i) {
-        if (_configs[i].getPort() == port) {
-            // Check for server_name match
-            const std::vector<std::string>& server_names = _configs[i].getServerNames();
-            for (size_t j = 0; j < server_names.size(); ++j) {
-                if (server_names[j] == host) {
-                    return &(_configs[i]);
-                }
-            }
-            // If no server_name matches, the first server block for that port is the default
-            if (!default_server) {
-                default_server = &(_configs[i]);
+const Location* WebServer::_get_location(const ServerConfig* config, const std::string& uri) const {
+    return config->findLocation(uri);
+}
+
+void WebServer::_reload() {
+    /**
+     * @brief Re-reads the configuration file after SIGHUP and switches to it.
+     * Nothing changes unless the whole file parses and every newly listed port can
+     * be bound. Listeners are then opened for added ports and closed for removed
+     * ones, while established connections stay open. Requests whose head has
+     * already arrived finish on the configuration they started under; later ones
+     * are routed with the new one. Both logs are reopened.
+     */
+    LOG(Logger::LEVEL_NOTICE, "Reloading configuration from " << _config_file);
+    GlobalConfig global;
+    std::vector<ServerConfig> servers;
+    std::map<int, int> opened; // port -> fd of listeners for added ports
+    AccessLog* access_log = NULL;
+    try {
+        ConfigParser parser(_config_file);
+        servers = parser.parse();
+        global = parser.getGlobalConfig();
+        for (size_t i = 0; i < servers.size(); ++i) {
+            int port = servers[i].getPort();
+            if (_listening_sockets.find(port) == _listening_sockets.end() && opened.find(port) == opened.end()) {
+                opened[port] = _open_listener(port);
             }
         }
+        // Log files are reopened, which also picks up rotated files
+        if (!global.getAccessLog().empty()) {
+            access_log = new AccessLog(global.getAccessLog(), global.getLogFormat());
+        }
+        Logger::configure(global.getErrorLogPath(), global.getErrorLogLevel());
+    } catch (const std::exception& e) {
+        for (std::map<int, int>::iterator it = opened.begin(); it != opened.end(); ++it) {
+            close(it->second);
+        }
+        delete access_log;
+        LOG(Logger::LEVEL_ERROR, "Reload failed, keeping the current configuration: " << e.what());
+        return;
     }
-    return default_server;
+
+    delete _access_log; // Flushes what it still held
+    _access_log = access_log;
+    ConfigGeneration* previous = _config;
+    _config = new ConfigGeneration(servers);
+    if (previous->requests == 0) {
+        delete previous;
+    } else {
+        _retired_configs.push_back(previous);
+    }
+
+    std::vector<int> removed;
+    for (std::map<int, int>::iterator it = _listening_sockets.begin(); it != _listening_sockets.end(); ++it) {
+        bool listed = false;
+        for (size_t i = 0; i < servers.size() && !listed; ++i) {
+            listed = servers[i].getPort() == it->first;
+        }
+        if (!listed) {
+            removed.push_back(it->first);
+        }
+    }
+    for (size_t i = 0; i < removed.size(); ++i) {
+        _remove_listener(removed[i]);
+    }
+    for (std::map<int, int>::iterator it = opened.begin(); it != opened.end(); ++it) {
+        _add_listener(it->first, it->second);
+    }
+    // Idle connections to a port that is gone are closed; busy ones after their response
+    std::vector<int> orphaned;
+    for (size_t fd = 0; fd < _connections.size(); ++fd) {
+        Connection* conn = _connections[fd];
+        if (conn && conn->isIdle() && _listening_sockets.find(conn->getPort()) == _listening_sockets.end()) {
+            orphaned.push_back(fd);
+        }
+    }
+    for (size_t i = 0; i < orphaned.size(); ++i) {
+        _close_connection(orphaned[i]);
+    }
+
+    // Settings that size structures created at startup keep their current values
+    if (global.getEventBackend() != _global_config.getEventBackend()
+        || global.getWorkerProcesses() != _global_config.getWorkerProcesses()
+        || global.getOpenFileCacheMax() != _global_config.getOpenFileCacheMax()
+        || global.getOpenFileCacheValid() != _global_config.getOpenFileCacheValid()) {
+        LOG(Logger::LEVEL_WARN, "event_backend, worker_processes and open_file_cache changes need a restart");
+    }
+    global.setEventBackend(_global_config.getEventBackend());
+    global.setWorkerProcesses(_global_config.getWorkerProcesses());
+    global.setOpenFileCache(_global_config.getOpenFileCacheMax(), _global_config.getOpenFileCacheValid());
+    _global_config = global;
+    // Cached renderings carry headers derived from the old locations
+    _metrics.retireResponseCache(_response_cache->getHits(), _response_cache->getMisses());
+    delete _response_cache;
+    _response_cache = new ResponseCache(_global_config.getStaticCacheSize(), _global_config.getStaticCacheMaxFileSize());
+    if (_connection_count < _global_config.getWorkerConnections()) {
+        _resume_accepting();
+    }
+    LOG(Logger::LEVEL_NOTICE, "Configuration reloaded: " << servers.size() << " server block(s) on "
+        << _listening_sockets.size() << " port(s)");
 }
 
-const Location* WebServer::_get_location(const ServerConfig* config, const std::string& uri) const {
-    const Location* best_match = NULL;
-    size_t max_match_len = 0;
-
-    const std::vector<Location>& locations = config->getLocations();
-    for (size_t i = 0; i < locations.size(); ++i) {
-        const std::string& location_path = locations[i].getPath();
-        if (uri.rfind(location_path, 0) == 0) { // URI starts with location path
-            if (location_path.length() > max_match_len) {
-                max_match_len = location_path.length();
-                best_match = &(locations[i]);
-            }
+void WebServer::_pin_config(Connection& conn) {
+    /**
+     * @brief Ties the connection's current request to the current configuration.
+     */
+    if (!conn.getConfig()) {
+        conn.setConfig(_config);
+        ++_config->requests;
+    }
+}
+
+void WebServer::_unpin_config(Connection& conn) {
+    /**
+     * @brief Releases the configuration of a request that has been answered. A
+     * retired generation is deleted by _delete_closed() once no request uses it.
+     */
+    ConfigGeneration* config = conn.getConfig();
+    if (config) {
+        conn.setConfig(NULL);
+        --config->requests;
+    }
+}
+
+void WebServer::_begin_shutdown() {
+    /**
+     * @brief Stops accepting connections and lets in-flight requests finish.
+     * Listeners are closed right away so that, with several workers, the kernel
+     * routes new connections elsewhere. Idle connections are closed by the next
+     * reaper pass and busy ones are closed after their current response.
+     */
+    LOG(Logger::LEVEL_NOTICE, "Shutdown requested, finishing " << _connection_count << " connection(s)");
+    _shutting_down = true;
+    for (std::map<int, int>::iterator it = _listener_ports.begin(); it != _listener_ports.end(); ++it) {
+        if (_accepting) {
+            _event_loop->remove(it->first);
         }
+        close(it->first);
     }
-    return best_match;
+    _pending_accepts.clear();
+    _listener_ports.clear();
+    _listener_targets.clear();
+    _listening_sockets.clear();
+    _close_idle_connections();
 }
 
 void WebServer::run() {
     /**
      * @brief Runs the main server event loop.
-     * Uses poll() to monitor listening and client sockets for incoming events.
-     * Handles new connections and processes client data.
+     * Waits on the configured EventLoop backend (epoll or poll) for listening and
+     * client sockets, accepts new connections and drives client connections.
+     * Once a shutdown signal arrives, in-flight requests get up to SHUTDOWN_TIMEOUT
+     * seconds to complete.
      */
-    while (g_running) {
-        int ret = poll(_fds.data(), _fds.size(), 1000); // 1 second timeout
+    time_t shutdown_deadline = 0;
+    std::vector<EventLoop::Event> ready;
+    Logger::setBatching(true);
+    std::vector<Timer*> expired;
+    while (true) {
+        if (g_reload) {
+            g_reload = 0;
+            if (!_shutting_down) {
+                _reload();
+            }
+        }
+        if (!g_running && !_shutting_down) {
+            _begin_shutdown();
+            shutdown_deadline = time(NULL) + SHUTDOWN_TIMEOUT;
+        }
+        if (_shutting_down && (_connection_count == 0 || time(NULL) >= shutdown_deadline)) {
+            break;
+        }
+
+        // Sleep until the next timer is due; while shutting down, idle connections are
+        // looked for every 100 ms. A listener with a backlog left by the last accept
+        // batch is not reported again, so the loop only polls before returning to it.
+        int timeout = _pending_accepts.empty() ? _timers.getTimeout(TimerWheel::now()) : 0;
+        if (_shutting_down && (timeout < 0 || timeout > 100)) {
+            timeout = 100;
+        }
+        int ret = _event_loop->wait(ready, timeout);
 
         if (ret < 0) {
-            if (g_running) {
-                std::cerr << "Error: poll() failed" << std::endl;
-            }
+            LOG(Logger::LEVEL_CRIT, _event_loop->getName() << " wait failed: " << strerror(errno));
             break;
         }
 
-        if (ret == 0) {
-            continue; // Timeout, no events
+        expired.clear();
+        _timers.advance(TimerWheel::now(), expired);
+        for (size_t i = 0; i < expired.size(); ++i) {
+            Connection* conn = static_cast<Connection*>(expired[i]->target->owner);
+            if (!conn->isClosed()) {
+                _handle_connection_timeout(*conn);
+            }
+        }
+        if (_shutting_down) {
+            _close_idle_connections();
         }
 
-        // Iterate through fds to check for events
-        for (size_t i = 0; i < _fds.size(); ++i) {
-            if (_fds[i].revents & POLLIN) {
-                bool is_listener = false;
-                for (std::map<int, int>::iterator it = _listening_sockets.begin(); it != _listening_sockets.end(); ++it) {
-                    if (it->second == _fds[i].fd) {
-                        is_listener = true;
-                        break;
-                    }
+        // Closed connections and finished scripts are only deleted after the batch,
+        // so notifications already collected for them are recognized and skipped
+        for (size_t i = 0; i < ready.size(); ++i) {
+            EventTarget* target = ready[i].target;
+            if (target->type == EventTarget::LISTENER) {
+                if (_handle_new_connection(target->fd) && _event_loop->isEdgeTriggered() &&
+                    std::find(_pending_accepts.begin(), _pending_accepts.end(), target->fd) == _pending_accepts.end()) {
+                    _pending_accepts.push_back(target->fd);
                 }
-
-                if (is_listener) {
-                    _handle_new_connection(_fds[i].fd);
-                } else {
-                    _handle_client_data(_fds[i].fd);
-                    // After handling client data, the client_fd might be closed and removed from _fds
-                    // So we need to adjust the loop index
-                    if (i < _fds.size() && _fds[i].fd == -1) { // Check if the current fd was removed
-                        i--;
-                    }
+                continue;
+            }
+            if (target->type == EventTarget::SIGNAL) {
+                _reap_children();
+                continue;
+            }
+            if (target->type == EventTarget::FASTCGI) {
+                _handle_fastcgi_event(*static_cast<FastCgiConnection*>(target->owner), ready[i].events);
+                continue;
+            }
+            if (target->type == EventTarget::CGI) {
+                _handle_cgi_event(*static_cast<CgiProcess*>(target->owner), target->fd);
+                continue;
+            }
+            Connection* conn = static_cast<Connection*>(target->owner);
+            if (conn->isClosed()) {
+                continue;
+            }
+            if (ready[i].events & EventLoop::EVENT_ERROR) {
+                _close_connection(conn->getFd());
+            } else {
+                _handle_client_event(*conn, ready[i].events);
+                if (!conn->isClosed()) {
+                    _update_connection_timer(*conn);
                 }
             }
         }
+        // Established connections had their turn, the listeners get the next batch
+        if (!_pending_accepts.empty()) {
+            std::vector<int> listeners;
+            listeners.swap(_pending_accepts);
+            for (size_t i = 0; i < listeners.size(); ++i) {
+                if (_accepting && _handle_new_connection(listeners[i])) {
+                    _pending_accepts.push_back(listeners[i]);
+                }
+            }
+        }
+        _delete_closed();
+        // Everything logged during the iteration goes out in one write per log
+        Logger::flush();
+        if (_access_log) {
+            _access_log->flush();
+        }
     }
-    std::cout << "Server shutting down..." << std::endl;
+    LOG(Logger::LEVEL_NOTICE, "Server shutting down");
+    Logger::setBatching(false);
 }
\ No newline at end of file
@@ -1,18 +1,43 @@
 #include "WebServer.hpp"
+#include "ConfigParser.hpp"
+#include "MasterProcess.hpp"
+#include "Logger.hpp"
 #include <iostream>
 #include <csignal>
+#include <sys/socket.h> // For SO_REUSEPORT
 
-bool g_running = true;
+volatile sig_atomic_t g_running = 1;
+volatile sig_atomic_t g_reload = 0;
 
 void signalHandler(int signum) {
-    std::cout << "\nCaught signal " << signum << ", shutting down..." << std::endl;
-    g_running = false;
+    (void)signum;
+    g_running = 0;
+}
+
+void reloadHandler(int signum) {
+    (void)signum;
+    g_reload = 1;
+}
+
+static void installSignalHandlers() {
+    // No SA_RESTART: blocking calls such as waitpid() in the master must return
+    // with EINTR so the shutdown flag is noticed
+    struct sigaction sa;
+    sa.sa_handler = signalHandler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = reloadHandler;
+    sigaction(SIGHUP, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN); // A client closing mid-response must not kill the server
 }
 
 int main(int argc, char **argv) {
     /**
      * @brief Main entry point of the webserv program.
-     * Parses command-line arguments, sets up signal handlers, and starts the WebServer.
+     * Parses command-line arguments, sets up signal handlers, and starts the WebServer,
+     * either directly or under a MasterProcess when worker_processes is greater than 1.
      * @param argc The number of command-line arguments.
      * @param argv An array of command-line argument strings.
      * @return 0 on successful execution, 1 on error.
@@ -22,10 +47,25 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    signal(SIGINT, signalHandler);
-    signal(SIGTERM, signalHandler);
+    installSignalHandlers();
 
     try {
+        ConfigParser parser(argv[1]);
+        parser.parse();
+        const GlobalConfig& global = parser.getGlobalConfig();
+        // Set up before any worker is forked, so that all of them inherit it
+        Logger::configure(global.getErrorLogPath(), global.getErrorLogLevel());
+        int workers = global.getWorkerProcesses();
+#ifndef SO_REUSEPORT
+        if (workers > 1) {
+            LOG(Logger::LEVEL_WARN, "SO_REUSEPORT unavailable, running a single worker");
+            workers = 1;
+        }
+#endif
+        if (workers > 1) {
+            MasterProcess master(argv[1], workers);
+            return master.run();
+        }
         WebServer server(argv[1]);
         server.run();
     } catch (const std::exception& e) {
@@ -34,4 +74,4 @@ int main(int argc, char **argv) {
     }
 
     return 0;
-}
\ No newline at end of file
+}